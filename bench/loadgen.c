@@ -0,0 +1,682 @@
+// Keep-alive HTTP/1.1 load generator for the firmware server, the QEMU image or the linux host build.
+//
+//   bench/build/loadgen -u http://mydevice.local -c 16 -d 10
+//   BENCH_URL=http://127.0.0.1:8080 bench/build/loadgen -m root=1,index=1
+//
+// Every connection sends one request at a time and reuses the connection until the server closes it. Requests
+// are drawn from a weighted mix: / with and without If-None-Match (the ETag is learned from the first answer to
+// /), /index.html, POST /api/led/on and /api/led/off. Latency is measured from the first byte sent to the last
+// byte of the response. The summary goes to stdout as JSON.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CONNS 1024
+#define BUF_LEN 16384
+#define REQ_LEN 512
+#define ETAG_LEN 128
+#define RETRY_NS 100000000ull // after a failed connect
+
+typedef struct {
+    const char *name;
+    const char *method;
+    const char *path;
+    bool inm; // send If-None-Match with the known ETag of /
+    unsigned weight;
+} kind_t;
+
+static kind_t kinds[] = {
+    {"root", "GET", "/", false, 4},
+    {"root_inm", "GET", "/", true, 4},
+    {"index", "GET", "/index.html", false, 2},
+    {"led_on", "POST", "/api/led/on", false, 1},
+    {"led_off", "POST", "/api/led/off", false, 1},
+};
+#define KINDS_COUNT (sizeof(kinds) / sizeof(kinds[0]))
+
+typedef struct {
+    uint32_t *v;
+    size_t len;
+    size_t cap;
+} samples_t;
+
+typedef enum {
+    C_IDLE, // waiting to reconnect
+    C_CONNECTING,
+    C_WRITING,
+    C_HEADERS,
+    C_BODY,
+    C_CHUNK_SIZE,
+    C_CHUNK_DATA,
+    C_CHUNK_CRLF,
+    C_TRAILER,
+    C_DONE, // finished after the run ended
+} conn_state_t;
+
+typedef struct {
+    int fd;
+    conn_state_t state;
+    size_t kind;
+    char req[REQ_LEN];
+    size_t req_len;
+    size_t req_off;
+    char buf[BUF_LEN]; // received, not yet parsed
+    size_t buf_len;
+    uint64_t body_left;
+    bool close_after;
+    bool until_close; // no length, the body ends with the connection
+    bool want_etag;
+    int status;
+    uint64_t start_ns; // request start, or the reconnect time in C_IDLE
+} conn_t;
+
+static struct {
+    uint64_t requests;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t err_connect;
+    uint64_t err_io;
+    uint64_t err_timeout;
+    uint64_t err_parse;
+    uint64_t reconnects;
+    uint64_t status[600];
+    samples_t latency[KINDS_COUNT];
+} stats;
+
+static struct addrinfo *s_addr;
+static char s_host[256];
+static int s_epoll;
+static uint64_t s_timeout_ns = 5000000000ull;
+static uint64_t s_rng = 0x9e3779b97f4a7c15ull;
+static unsigned s_weight_total;
+static char s_etag[ETAG_LEN];
+static bool s_stopping;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t rng_next(void) {
+    // xorshift64*, seeded with -s for a repeatable mix
+    s_rng ^= s_rng >> 12;
+    s_rng ^= s_rng << 25;
+    s_rng ^= s_rng >> 27;
+    return s_rng * 2685821657736338717ull;
+}
+
+static void samples_add(samples_t *s, uint32_t v) {
+    if (s->len == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 4096;
+        s->v = realloc(s->v, s->cap * sizeof(*s->v));
+        if (!s->v) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    s->v[s->len++] = v;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest rank on sorted samples
+static uint32_t percentile(const samples_t *s, double p) {
+    if (s->len == 0) {
+        return 0;
+    }
+    size_t rank = (size_t)(p * s->len + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return s->v[(rank > s->len ? s->len : rank) - 1];
+}
+
+static void conn_watch(conn_t *c, uint32_t events, int op) {
+    struct epoll_event ev = {.events = events, .data.ptr = c};
+    if (epoll_ctl(s_epoll, op, c->fd, &ev) != 0) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+}
+
+static void conn_close(conn_t *c) {
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->buf_len = 0;
+}
+
+static void conn_connect(conn_t *c) {
+    c->fd = socket(s_addr->ai_family, s_addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, s_addr->ai_protocol);
+    if (c->fd < 0) {
+        perror("socket");
+        exit(1);
+    }
+
+    const int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(c->fd, s_addr->ai_addr, s_addr->ai_addrlen) != 0 && errno != EINPROGRESS) {
+        stats.err_connect++;
+        conn_close(c);
+        c->state = C_IDLE;
+        c->start_ns = now_ns() + RETRY_NS;
+        return;
+    }
+
+    c->state = C_CONNECTING;
+    c->start_ns = now_ns();
+    conn_watch(c, EPOLLOUT, EPOLL_CTL_ADD);
+}
+
+static void conn_fail(conn_t *c, uint64_t *counter) {
+    (*counter)++;
+    conn_close(c);
+    c->state = C_IDLE;
+    c->start_ns = now_ns();
+}
+
+static void conn_send_next(conn_t *c) {
+    unsigned pick = rng_next() % s_weight_total;
+    size_t k = 0;
+    while (pick >= kinds[k].weight) {
+        pick -= kinds[k++].weight;
+    }
+
+    const kind_t *kind = &kinds[k];
+    int n = snprintf(c->req, sizeof(c->req),
+                     "%s %s HTTP/1.1\r\nHost: %s\r\nAccept-Encoding: gzip, deflate, br\r\nUser-Agent: loadgen\r\n",
+                     kind->method, kind->path, s_host);
+    if (kind->inm && s_etag[0]) {
+        n += snprintf(c->req + n, sizeof(c->req) - n, "If-None-Match: %s\r\n", s_etag);
+    }
+    if (strcmp(kind->method, "POST") == 0) {
+        n += snprintf(c->req + n, sizeof(c->req) - n, "Content-Length: 0\r\n");
+    }
+    n += snprintf(c->req + n, sizeof(c->req) - n, "\r\n");
+
+    c->kind = k;
+    c->want_etag = strcmp(kind->path, "/") == 0 && !s_etag[0];
+    c->req_len = n;
+    c->req_off = 0;
+    c->state = C_WRITING;
+    c->start_ns = now_ns();
+    conn_watch(c, EPOLLOUT, EPOLL_CTL_MOD);
+}
+
+static void conn_complete(conn_t *c) {
+    const uint64_t us = (now_ns() - c->start_ns) / 1000;
+    samples_add(&stats.latency[c->kind], us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+    stats.requests++;
+    stats.status[c->status]++;
+
+    // Anything beyond the response was not asked for
+    c->buf_len = 0;
+
+    if (c->close_after) {
+        stats.reconnects++;
+        conn_close(c);
+        c->state = C_IDLE;
+        c->start_ns = now_ns();
+    } else if (s_stopping) {
+        c->state = C_DONE;
+    } else {
+        conn_send_next(c);
+    }
+}
+
+// Finds "name:" in a header block, returns the trimmed value and its length
+static const char *header_value(const char *headers, size_t len, const char *name, size_t *value_len) {
+    const size_t name_len = strlen(name);
+    const char *end = headers + len;
+
+    for (const char *line = headers; line < end;) {
+        const char *eol = memmem(line, end - line, "\r\n", 2);
+        if (!eol) {
+            eol = end;
+        }
+        if ((size_t)(eol - line) > name_len && line[name_len] == ':' && strncasecmp(line, name, name_len) == 0) {
+            const char *v = line + name_len + 1;
+            while (v < eol && (*v == ' ' || *v == '\t')) {
+                v++;
+            }
+            *value_len = eol - v;
+            return v;
+        }
+        line = eol + 2;
+    }
+    return NULL;
+}
+
+static bool parse_headers(conn_t *c, size_t len) {
+    if (len < 12 || memcmp(c->buf, "HTTP/1.", 7) != 0) {
+        return false;
+    }
+    c->status = atoi(c->buf + 9);
+    if (c->status < 100 || c->status > 599) {
+        return false;
+    }
+
+    size_t vlen;
+    const char *v = header_value(c->buf, len, "Connection", &vlen);
+    c->close_after = v && vlen >= 5 && strncasecmp(v, "close", 5) == 0;
+
+    if (c->want_etag && c->status == 200 && (v = header_value(c->buf, len, "ETag", &vlen)) && vlen < ETAG_LEN) {
+        memcpy(s_etag, v, vlen);
+        s_etag[vlen] = '\0';
+    }
+
+    c->until_close = false;
+    if (c->status == 204 || c->status == 304 || c->status < 200) {
+        c->body_left = 0;
+        c->state = C_BODY;
+    } else if ((v = header_value(c->buf, len, "Transfer-Encoding", &vlen)) && vlen >= 7 &&
+               strncasecmp(v, "chunked", 7) == 0) {
+        c->state = C_CHUNK_SIZE;
+    } else if ((v = header_value(c->buf, len, "Content-Length", &vlen))) {
+        c->body_left = strtoull(v, NULL, 10);
+        c->state = C_BODY;
+    } else {
+        c->body_left = UINT64_MAX;
+        c->until_close = true;
+        c->close_after = true;
+        c->state = C_BODY;
+    }
+    return true;
+}
+
+// Consumes what the buffer holds, returns false on a malformed response
+static bool conn_parse(conn_t *c) {
+    size_t pos = 0;
+
+    for (;;) {
+        const char *p = c->buf + pos;
+        const size_t avail = c->buf_len - pos;
+        const char *eol;
+
+        switch (c->state) {
+        case C_HEADERS: {
+            const char *end = memmem(p, avail, "\r\n\r\n", 4);
+            if (!end) {
+                goto more;
+            }
+            if (!parse_headers(c, end + 2 - p)) {
+                return false;
+            }
+            pos += end + 4 - p;
+            break;
+        }
+        case C_BODY: {
+            const uint64_t n = avail < c->body_left ? avail : c->body_left;
+            if (!c->until_close) {
+                c->body_left -= n;
+            }
+            pos += n;
+            if (c->body_left == 0) {
+                conn_complete(c);
+                return true;
+            }
+            goto more;
+        }
+        case C_CHUNK_SIZE:
+            if (!(eol = memmem(p, avail, "\r\n", 2))) {
+                goto more;
+            }
+            c->body_left = strtoull(p, NULL, 16);
+            c->state = c->body_left ? C_CHUNK_DATA : C_TRAILER;
+            pos += eol + 2 - p;
+            break;
+        case C_CHUNK_DATA: {
+            const uint64_t n = avail < c->body_left ? avail : c->body_left;
+            c->body_left -= n;
+            pos += n;
+            if (c->body_left) {
+                goto more;
+            }
+            c->state = C_CHUNK_CRLF;
+            break;
+        }
+        case C_CHUNK_CRLF:
+            if (avail < 2) {
+                goto more;
+            }
+            if (p[0] != '\r' || p[1] != '\n') {
+                return false;
+            }
+            c->state = C_CHUNK_SIZE;
+            pos += 2;
+            break;
+        case C_TRAILER:
+            if (!(eol = memmem(p, avail, "\r\n", 2))) {
+                goto more;
+            }
+            pos += eol + 2 - p;
+            if (eol == p) {
+                conn_complete(c);
+                return true;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+
+more:
+    // Keep the unparsed tail, a header block larger than the buffer is an error
+    memmove(c->buf, c->buf + pos, c->buf_len - pos);
+    c->buf_len -= pos;
+    return c->buf_len < sizeof(c->buf);
+}
+
+static void conn_on_event(conn_t *c, uint32_t events) {
+    if (c->state == C_DONE) {
+        return;
+    }
+    if (c->state == C_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err || (events & (EPOLLERR | EPOLLHUP))) {
+            conn_fail(c, &stats.err_connect);
+            c->start_ns += RETRY_NS;
+            return;
+        }
+        conn_send_next(c);
+        return;
+    }
+
+    if (c->state == C_WRITING) {
+        ssize_t n = send(c->fd, c->req + c->req_off, c->req_len - c->req_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN) {
+                conn_fail(c, &stats.err_io);
+            }
+            return;
+        }
+        stats.bytes_sent += n;
+        c->req_off += n;
+        if (c->req_off == c->req_len) {
+            c->state = C_HEADERS;
+            conn_watch(c, EPOLLIN, EPOLL_CTL_MOD);
+        }
+        return;
+    }
+
+    ssize_t n = recv(c->fd, c->buf + c->buf_len, sizeof(c->buf) - c->buf_len, 0);
+    if (n < 0) {
+        if (errno != EAGAIN) {
+            conn_fail(c, &stats.err_io);
+        }
+        return;
+    }
+    if (n == 0) {
+        // A body without length ends here, anything else was cut off or the idle connection closed
+        if (c->state == C_BODY && c->until_close) {
+            conn_complete(c);
+        } else {
+            conn_fail(c, &stats.err_io);
+        }
+        return;
+    }
+
+    stats.bytes_received += n;
+    c->buf_len += n;
+    if (!conn_parse(c)) {
+        conn_fail(c, &stats.err_parse);
+    }
+}
+
+static bool parse_url(const char *url, char *host, size_t host_len, char *port, size_t port_len) {
+    if (strncmp(url, "http://", 7) != 0) {
+        return false;
+    }
+    url += 7;
+
+    const size_t len = strcspn(url, ":/");
+    if (len == 0 || len >= host_len) {
+        return false;
+    }
+    memcpy(host, url, len);
+    host[len] = '\0';
+
+    snprintf(port, port_len, "80");
+    if (url[len] == ':') {
+        const size_t plen = strcspn(url + len + 1, "/");
+        if (plen == 0 || plen >= port_len) {
+            return false;
+        }
+        memcpy(port, url + len + 1, plen);
+        port[plen] = '\0';
+    }
+    return true;
+}
+
+// "root=4,index=1": kinds not listed get weight 0
+static bool parse_mix(char *spec) {
+    for (size_t k = 0; k < KINDS_COUNT; k++) {
+        kinds[k].weight = 0;
+    }
+
+    for (char *item = strtok(spec, ","); item; item = strtok(NULL, ",")) {
+        char *eq = strchr(item, '=');
+        if (eq) {
+            *eq = '\0';
+        }
+        size_t k = 0;
+        while (k < KINDS_COUNT && strcmp(kinds[k].name, item) != 0) {
+            k++;
+        }
+        if (k == KINDS_COUNT) {
+            return false;
+        }
+        kinds[k].weight = eq ? (unsigned)atoi(eq + 1) : 1;
+    }
+    return true;
+}
+
+static void print_latency(const samples_t *s) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < s->len; i++) {
+        sum += s->v[i];
+    }
+    printf("{\"count\": %zu, \"min\": %" PRIu32 ", \"mean\": %.1f, \"p50\": %" PRIu32 ", \"p90\": %" PRIu32
+           ", \"p99\": %" PRIu32 ", \"p999\": %" PRIu32 ", \"max\": %" PRIu32 "}",
+           s->len, s->len ? s->v[0] : 0, s->len ? (double)sum / s->len : 0.0, percentile(s, 0.5),
+           percentile(s, 0.9), percentile(s, 0.99), percentile(s, 0.999), s->len ? s->v[s->len - 1] : 0);
+}
+
+static void print_report(const char *url, unsigned conns, double elapsed) {
+    samples_t all = {0};
+    for (size_t k = 0; k < KINDS_COUNT; k++) {
+        qsort(stats.latency[k].v, stats.latency[k].len, sizeof(uint32_t), cmp_u32);
+        for (size_t i = 0; i < stats.latency[k].len; i++) {
+            samples_add(&all, stats.latency[k].v[i]);
+        }
+    }
+    qsort(all.v, all.len, sizeof(uint32_t), cmp_u32);
+
+    printf("{\n  \"url\": \"%s\",\n  \"connections\": %u,\n  \"duration_s\": %.3f,\n", url, conns, elapsed);
+    printf("  \"requests\": %" PRIu64 ",\n  \"rps\": %.1f,\n", stats.requests, stats.requests / elapsed);
+    printf("  \"bytes\": {\"sent\": %" PRIu64 ", \"received\": %" PRIu64 "},\n", stats.bytes_sent,
+           stats.bytes_received);
+    printf("  \"errors\": {\"connect\": %" PRIu64 ", \"io\": %" PRIu64 ", \"timeout\": %" PRIu64
+           ", \"parse\": %" PRIu64 "},\n",
+           stats.err_connect, stats.err_io, stats.err_timeout, stats.err_parse);
+    printf("  \"reconnects\": %" PRIu64 ",\n  \"status\": {", stats.reconnects);
+    const char *sep = "";
+    for (int i = 0; i < 600; i++) {
+        if (stats.status[i]) {
+            printf("%s\"%d\": %" PRIu64, sep, i, stats.status[i]);
+            sep = ", ";
+        }
+    }
+    printf("},\n  \"latency_us\": ");
+    print_latency(&all);
+    printf(",\n  \"by_kind\": {");
+    sep = "";
+    for (size_t k = 0; k < KINDS_COUNT; k++) {
+        if (kinds[k].weight) {
+            printf("%s\n    \"%s\": ", sep, kinds[k].name);
+            print_latency(&stats.latency[k]);
+            sep = ",";
+        }
+    }
+    printf("\n  }\n}\n");
+    free(all.v);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: loadgen [-u http://host[:port]] [-c connections] [-d seconds] [-n requests]\n"
+                    "               [-t timeout_ms] [-m root=4,root_inm=4,index=2,led_on=1,led_off=1] [-s seed]\n"
+                    "The URL defaults to $BENCH_URL.\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *url = getenv("BENCH_URL");
+    unsigned conns_count = 16;
+    double duration = 10;
+    uint64_t max_requests = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "u:c:d:n:t:m:s:")) != -1) {
+        switch (opt) {
+        case 'u':
+            url = optarg;
+            break;
+        case 'c':
+            conns_count = (unsigned)atoi(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'n':
+            max_requests = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            s_timeout_ns = strtoull(optarg, NULL, 10) * 1000000ull;
+            break;
+        case 'm':
+            if (!parse_mix(optarg)) {
+                usage();
+            }
+            break;
+        case 's':
+            s_rng = strtoull(optarg, NULL, 10) | 1;
+            break;
+        default:
+            usage();
+        }
+    }
+
+    for (size_t k = 0; k < KINDS_COUNT; k++) {
+        s_weight_total += kinds[k].weight;
+    }
+
+    char port[8];
+    if (!url || !parse_url(url, s_host, sizeof(s_host), port, sizeof(port)) || conns_count == 0 ||
+        conns_count > MAX_CONNS || duration <= 0 || s_weight_total == 0) {
+        usage();
+    }
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    int err = getaddrinfo(s_host, port, &hints, &s_addr);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", s_host, gai_strerror(err));
+        return 1;
+    }
+
+    s_epoll = epoll_create1(EPOLL_CLOEXEC);
+    conn_t *conns = calloc(conns_count, sizeof(conn_t));
+    if (s_epoll < 0 || !conns) {
+        perror("setup");
+        return 1;
+    }
+
+    const uint64_t start = now_ns();
+    const uint64_t end = start + (uint64_t)(duration * 1e9);
+    for (unsigned i = 0; i < conns_count; i++) {
+        conns[i].fd = -1;
+        conn_connect(&conns[i]);
+    }
+
+    struct epoll_event events[64];
+    for (;;) {
+        const uint64_t now = now_ns();
+        if (!s_stopping && (now >= end || (max_requests && stats.requests >= max_requests))) {
+            // In-flight requests may finish, no new ones start
+            s_stopping = true;
+        }
+
+        bool busy = false;
+        for (unsigned i = 0; i < conns_count; i++) {
+            conn_t *c = &conns[i];
+            switch (c->state) {
+            case C_IDLE:
+                if (!s_stopping && now >= c->start_ns) {
+                    conn_connect(c);
+                }
+                break;
+            case C_DONE:
+                break;
+            case C_CONNECTING:
+                if (s_stopping) {
+                    conn_close(c);
+                    c->state = C_DONE;
+                } else if (now - c->start_ns > s_timeout_ns) {
+                    conn_fail(c, &stats.err_connect);
+                }
+                break;
+            default:
+                if (now - c->start_ns > s_timeout_ns) {
+                    conn_fail(c, &stats.err_timeout);
+                } else {
+                    busy = true;
+                }
+            }
+        }
+        if (s_stopping && !busy) {
+            break;
+        }
+
+        const int n = epoll_wait(s_epoll, events, 64, 10);
+        for (int i = 0; i < n; i++) {
+            conn_t *c = events[i].data.ptr;
+            if (c->fd >= 0) {
+                conn_on_event(c, events[i].events);
+            }
+        }
+    }
+
+    const double elapsed = (now_ns() - start) / 1e9;
+    print_report(url, conns_count, elapsed);
+
+    for (unsigned i = 0; i < conns_count; i++) {
+        conn_close(&conns[i]);
+    }
+    freeaddrinfo(s_addr);
+    return stats.requests ? 0 : 1;
+}
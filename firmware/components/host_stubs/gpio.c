@@ -0,0 +1,34 @@
+#include "driver/gpio.h"
+
+#include "esp_log.h"
+
+static const char *TAG = "gpio";
+
+static uint64_t s_levels = 0;
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    if (!config || config->pin_bit_mask >> GPIO_PIN_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    if (gpio_num < 0 || gpio_num >= GPIO_PIN_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const uint64_t bit = 1ULL << gpio_num;
+    if (!!(s_levels & bit) != !!level) {
+        ESP_LOGD(TAG, "GPIO%d -> %u", gpio_num, (unsigned)!!level);
+    }
+    s_levels = level ? s_levels | bit : s_levels & ~bit;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= GPIO_PIN_COUNT) {
+        return 0;
+    }
+    return !!(s_levels & (1ULL << gpio_num));
+}
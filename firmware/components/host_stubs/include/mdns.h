@@ -0,0 +1,40 @@
+/**
+ * @file mdns.h
+ * @brief Host stand-in for the mDNS component: every call succeeds and does nothing
+ *
+ * The host is reached by its own name or address. Covers the subset of
+ * mdns.h the firmware uses, with the same names and signatures.
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _HOST_STUBS_MDNS_H_
+#define _HOST_STUBS_MDNS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *key;
+    const char *value;
+} mdns_txt_item_t;
+
+esp_err_t mdns_init(void);
+void mdns_free(void);
+esp_err_t mdns_hostname_set(const char *hostname);
+esp_err_t mdns_instance_name_set(const char *instance_name);
+esp_err_t mdns_service_add(const char *instance_name, const char *service_type, const char *proto, uint16_t port,
+                           mdns_txt_item_t txt[], size_t num_items);
+esp_err_t mdns_service_port_set(const char *service_type, const char *proto, uint16_t port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_STUBS_MDNS_H_ */
@@ -0,0 +1,61 @@
+/**
+ * @file miniz.h
+ * @brief Host stand-in for the ROM miniz inflater, on top of zlib
+ *
+ * Covers tinfl_init() and tinfl_decompress() for raw deflate streams, as
+ * gunzip.h uses them: output goes to a 32 KB buffer that may wrap, input
+ * may come in pieces with TINFL_FLAG_HAS_MORE_INPUT.
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _HOST_STUBS_MINIZ_H_
+#define _HOST_STUBS_MINIZ_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+typedef enum {
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef struct {
+    mz_uint32 m_state; /*!< 0 until the next tinfl_decompress() resets the stream */
+    bool ready;        /*!< z holds an initialized stream */
+    z_stream z;
+} tinfl_decompressor;
+
+#define tinfl_init(r)                                                                                                  \
+    do {                                                                                                               \
+        (r)->m_state = 0;                                                                                              \
+    } while (0)
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+                              mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size,
+                              const mz_uint32 decomp_flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_STUBS_MINIZ_H_ */
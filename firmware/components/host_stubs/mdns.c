@@ -0,0 +1,30 @@
+#include "mdns.h"
+
+#include "esp_log.h"
+
+static const char *TAG = "mdns";
+
+esp_err_t mdns_init(void) {
+    return ESP_OK;
+}
+
+void mdns_free(void) {
+}
+
+esp_err_t mdns_hostname_set(const char *hostname) {
+    ESP_LOGI(TAG, "host build, %s.local is not announced", hostname);
+    return ESP_OK;
+}
+
+esp_err_t mdns_instance_name_set(const char *instance_name) {
+    return ESP_OK;
+}
+
+esp_err_t mdns_service_add(const char *instance_name, const char *service_type, const char *proto, uint16_t port,
+                           mdns_txt_item_t txt[], size_t num_items) {
+    return ESP_OK;
+}
+
+esp_err_t mdns_service_port_set(const char *service_type, const char *proto, uint16_t port) {
+    return ESP_OK;
+}
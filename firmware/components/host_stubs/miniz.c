@@ -0,0 +1,41 @@
+#include "rom/miniz.h"
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+                              mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size,
+                              const mz_uint32 decomp_flags) {
+    // tinfl_init() only marks the state, the zlib stream is set up or reset here
+    if (r->m_state == 0) {
+        if (!r->ready) {
+            r->z = (z_stream){0};
+            if (inflateInit2(&r->z, -MAX_WBITS) != Z_OK) {
+                return TINFL_STATUS_FAILED;
+            }
+            r->ready = true;
+        } else if (inflateReset(&r->z) != Z_OK) {
+            return TINFL_STATUS_FAILED;
+        }
+        r->m_state = 1;
+    }
+
+    // zlib keeps its own window, the wrapping output buffer of tinfl is just a place to put bytes
+    r->z.next_in = (Bytef *)pIn_buf_next;
+    r->z.avail_in = *pIn_buf_size;
+    r->z.next_out = pOut_buf_next;
+    r->z.avail_out = *pOut_buf_size;
+
+    const int ret = inflate(&r->z, Z_NO_FLUSH);
+    *pIn_buf_size -= r->z.avail_in;
+    *pOut_buf_size -= r->z.avail_out;
+
+    if (ret == Z_STREAM_END) {
+        return TINFL_STATUS_DONE;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return TINFL_STATUS_FAILED;
+    }
+    if (r->z.avail_out == 0) {
+        return TINFL_STATUS_HAS_MORE_OUTPUT;
+    }
+    return decomp_flags & TINFL_FLAG_HAS_MORE_INPUT ? TINFL_STATUS_NEEDS_MORE_INPUT
+                                                    : TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file api_routes.h
+ * @brief The endpoints other than the static assets, in the order the server registers them
+ *
+ * An X-macro list without include guard: define
+ *
+ *     API_ROUTE(uri, method, handler, recorded)
+ *
+ * and include the file where the list is needed. main.c registers the
+ * handlers from it, right after GET and HEAD of every web asset, and the
+ * microbench app times the URI lookup over the same list, so the two cannot
+ * drift apart. recorded is false for the endpoints CONFIG_HTTPD_RECORD
+ * leaves out of its capture.
+ *
+ * Example usage:
+ * @code
+ *     static const httpd_uri_t uris[] = {
+ *     #define API_ROUTE(uri, method, handler, recorded) {uri, method, handler, NULL},
+ *     #include "api_routes.h"
+ *     #undef API_ROUTE
+ *     };
+ * @endcode
+ *
+ * @version 0.0.1
+ */
+
+API_ROUTE("/index.html", HTTP_GET, index_html_get_handler, true)
+API_ROUTE("/api/metrics", HTTP_GET, api_metrics_get_handler, true)
+API_ROUTE("/api/state", HTTP_GET, api_state_get_handler, true)
+
+#if CONFIG_HTTPD_LOG_RING
+API_ROUTE("/api/logs", HTTP_GET, api_logs_get_handler, true)
+#endif
+
+#if CONFIG_HTTPD_TASK_STATS
+API_ROUTE("/api/tasks", HTTP_GET, api_tasks_get_handler, true)
+#endif
+
+#if CONFIG_HTTPD_BENCH
+API_ROUTE("/bench/download", HTTP_GET, bench_download_get_handler, true)
+API_ROUTE("/bench/upload", HTTP_POST, bench_upload_post_handler, true)
+API_ROUTE("/bench/echo", HTTP_GET, bench_echo_handler, true)
+API_ROUTE("/bench/echo", HTTP_POST, bench_echo_handler, true)
+#endif
+
+#if CONFIG_HTTPD_SCHED
+API_ROUTE("/api/schedule", HTTP_GET, api_schedule_get_handler, true)
+API_ROUTE("/api/schedule", HTTP_POST, api_schedule_post_handler, true)
+API_ROUTE("/api/schedule", HTTP_DELETE, api_schedule_delete_handler, true)
+#endif
+
+API_ROUTE("/api/rum", HTTP_POST, api_rum_post_handler, true)
+API_ROUTE("/api/led/on", HTTP_POST, api_led_post_on_handler, true)
+API_ROUTE("/api/led/off", HTTP_POST, api_led_post_off_handler, true)
+
+#if CONFIG_HTTPD_OTA
+API_ROUTE("/api/ota", HTTP_GET, api_ota_get_handler, true)
+API_ROUTE("/api/ota", HTTP_PUT, api_ota_put_handler, true)
+API_ROUTE("/api/ota/delta", HTTP_PUT, api_ota_delta_put_handler, true)
+API_ROUTE("/api/ota", HTTP_DELETE, api_ota_delete_handler, true)
+#endif
+
+API_ROUTE("/api/config", HTTP_GET, api_config_get_handler, true)
+
+#if CONFIG_HTTPD_RECORD
+API_ROUTE("/api/record", HTTP_GET, api_record_get_handler, false)
+API_ROUTE("/api/record", HTTP_DELETE, api_record_delete_handler, false)
+#endif
+
+#if CONFIG_HTTPD_CONFIG_WRITE
+API_ROUTE("/api/config", HTTP_PATCH, api_config_patch_handler, true)
+#endif
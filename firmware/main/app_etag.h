@@ -0,0 +1,76 @@
+/**
+ * @file app_etag.h
+ * @brief ETag of everything baked into the running image
+ *
+ * The tag is the start of the app ELF SHA-256, so it changes with every
+ * build and stays the same across reboots of one. Computed once at start,
+ * kept in the microbench app to see what that costs.
+ *
+ * Example usage:
+ * @code
+ *     static char etag[APP_ETAG_LEN];
+ *     ESP_ERROR_CHECK(make_etag(etag, sizeof(etag)));
+ * @endcode
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _APP_ETAG_H_
+#define _APP_ETAG_H_
+
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Buffer size that holds the quoted tag.
+ */
+#define APP_ETAG_LEN 24
+
+/**
+ * @brief Writes the quoted ETag of the running image, from the app ELF SHA-256.
+ *
+ * @param etag_len At least 20 bytes.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a short buffer, ESP_FAIL without an app description.
+ */
+esp_err_t make_etag(char *etag, size_t etag_len);
+
+#ifdef APP_ETAG_IMPLEMENTATION
+
+#include <stdio.h>
+
+#include "esp_app_desc.h"
+
+esp_err_t make_etag(char *etag, size_t etag_len) {
+    if (unlikely(!etag || etag_len < 20)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const esp_app_desc_t *desc = esp_app_get_description();
+    if (unlikely(!desc)) {
+        return ESP_FAIL;
+    }
+
+    int written =
+        snprintf(etag, etag_len, "\"%02x%02x%02x%02x%02x%02x%02x%02x\"", desc->app_elf_sha256[0],
+                 desc->app_elf_sha256[1], desc->app_elf_sha256[2], desc->app_elf_sha256[3], desc->app_elf_sha256[4],
+                 desc->app_elf_sha256[5], desc->app_elf_sha256[6], desc->app_elf_sha256[7]);
+
+    if (unlikely((written < 0 || (size_t)written >= etag_len))) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return ESP_OK;
+}
+
+#endif /* APP_ETAG_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _APP_ETAG_H_ */
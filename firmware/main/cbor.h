@@ -0,0 +1,624 @@
+/**
+ * @file cbor.h
+ * @brief Zero-allocation CBOR (RFC 8949) encoder and decoder
+ *
+ * The encoder hands every encoded item to a write callback as soon as it
+ * is complete, e.g. straight into an http_stream_t, so no document is ever
+ * assembled in memory. The decoder walks a buffer in place: strings are
+ * returned as pointers into it.
+ *
+ * Errors are sticky on both sides: once an operation fails every further
+ * one is a no-op returning the same error, so a sequence of calls can be
+ * checked once at the end.
+ *
+ * Example usage:
+ * @code
+ *     cbor_writer_t w;
+ *     cbor_writer_init(&w, write_fn, ctx);
+ *     cbor_put_map(&w, 1);
+ *     cbor_put_text(&w, "led");
+ *     cbor_put_bool(&w, true);
+ *     if (w.err != ESP_OK) { ... }
+ *
+ *     cbor_reader_t r;
+ *     cbor_reader_init(&r, buf, len);
+ *     size_t n;
+ *     if (cbor_get_map(&r, &n) == ESP_OK) { ... }
+ * @endcode
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _CBOR_H_
+#define _CBOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Length of an indefinite-length array or map in cbor_get_array() and cbor_get_map().
+ */
+#define CBOR_INDEFINITE SIZE_MAX
+
+/**
+ * @brief Major types, plus CBOR_FLOAT and CBOR_BOOL/CBOR_NULL split out of major type 7.
+ */
+typedef enum {
+    CBOR_UINT,
+    CBOR_NINT,
+    CBOR_BYTES,
+    CBOR_TEXT,
+    CBOR_ARRAY,
+    CBOR_MAP,
+    CBOR_TAG,
+    CBOR_SIMPLE,
+    CBOR_BOOL,
+    CBOR_NULL,
+    CBOR_FLOAT,
+    CBOR_BREAK,
+    CBOR_END, /*!< no more data, or the reader failed */
+} cbor_type_t;
+
+/**
+ * @brief Output callback of the encoder.
+ *
+ * @return ESP_OK to continue, any other value stops the encoder.
+ */
+typedef esp_err_t (*cbor_write_fn_t)(void *ctx, const void *buf, size_t len);
+
+/**
+ * @brief Encoder state.
+ */
+typedef struct {
+    cbor_write_fn_t write;
+    void *ctx;
+    esp_err_t err; /*!< first error */
+} cbor_writer_t;
+
+/**
+ * @brief Decoder state.
+ */
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    esp_err_t err; /*!< first error */
+} cbor_reader_t;
+
+void cbor_writer_init(cbor_writer_t *w, cbor_write_fn_t write, void *ctx);
+
+esp_err_t cbor_put_uint(cbor_writer_t *w, uint64_t value);
+esp_err_t cbor_put_int(cbor_writer_t *w, int64_t value);
+esp_err_t cbor_put_bool(cbor_writer_t *w, bool value);
+esp_err_t cbor_put_null(cbor_writer_t *w);
+
+/**
+ * @brief Encodes a floating-point number as float32 when that is exact, float64 otherwise.
+ */
+esp_err_t cbor_put_double(cbor_writer_t *w, double value);
+
+esp_err_t cbor_put_text(cbor_writer_t *w, const char *s);
+esp_err_t cbor_put_text_n(cbor_writer_t *w, const char *s, size_t len);
+esp_err_t cbor_put_bytes(cbor_writer_t *w, const void *data, size_t len);
+
+/**
+ * @brief Starts an array of count items, or an indefinite one closed by cbor_put_break().
+ */
+esp_err_t cbor_put_array(cbor_writer_t *w, size_t count);
+
+/**
+ * @brief Starts a map of count key/value pairs, or an indefinite one closed by cbor_put_break().
+ */
+esp_err_t cbor_put_map(cbor_writer_t *w, size_t count);
+
+esp_err_t cbor_put_break(cbor_writer_t *w);
+
+void cbor_reader_init(cbor_reader_t *r, const void *data, size_t len);
+
+/**
+ * @brief Returns the type of the next item without consuming it.
+ */
+cbor_type_t cbor_peek(const cbor_reader_t *r);
+
+/**
+ * @brief Decodes an unsigned integer.
+ *
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_STATE if the next item is of another type,
+ *         ESP_ERR_INVALID_SIZE if the data ends early.
+ */
+esp_err_t cbor_get_uint(cbor_reader_t *r, uint64_t *out);
+
+/**
+ * @brief Decodes a signed integer.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE also when the value does not fit.
+ */
+esp_err_t cbor_get_int(cbor_reader_t *r, int64_t *out);
+
+esp_err_t cbor_get_bool(cbor_reader_t *r, bool *out);
+
+/**
+ * @brief Decodes a number: any integer or a half, single or double precision float.
+ */
+esp_err_t cbor_get_double(cbor_reader_t *r, double *out);
+
+/**
+ * @brief Decodes a definite-length text string, pointing into the input. The text is not NUL-terminated.
+ */
+esp_err_t cbor_get_text(cbor_reader_t *r, const char **out, size_t *len);
+
+/**
+ * @brief Decodes a definite-length byte string, pointing into the input.
+ */
+esp_err_t cbor_get_bytes(cbor_reader_t *r, const uint8_t **out, size_t *len);
+
+/**
+ * @brief Enters an array. count is CBOR_INDEFINITE for an indefinite one, see cbor_at_break().
+ */
+esp_err_t cbor_get_array(cbor_reader_t *r, size_t *count);
+
+/**
+ * @brief Enters a map. count is CBOR_INDEFINITE for an indefinite one, see cbor_at_break().
+ */
+esp_err_t cbor_get_map(cbor_reader_t *r, size_t *count);
+
+/**
+ * @brief Consumes the break that ends an indefinite array or map.
+ *
+ * @return true if the next item was a break.
+ */
+bool cbor_at_break(cbor_reader_t *r);
+
+/**
+ * @brief Skips the next item, including everything nested in it.
+ */
+esp_err_t cbor_skip(cbor_reader_t *r);
+
+/**
+ * @brief Compares a decoded text string with a C string.
+ */
+bool cbor_text_eq(const char *text, size_t len, const char *s);
+
+#ifdef CBOR_IMPLEMENTATION
+
+#include <math.h>
+#include <string.h>
+
+#ifndef CBOR_MAX_DEPTH
+#define CBOR_MAX_DEPTH 16
+#endif
+
+#define CBOR_AI_INDEFINITE 31
+
+static esp_err_t cbor_write(cbor_writer_t *w, const void *buf, size_t len) {
+    if (w->err == ESP_OK && len) {
+        w->err = w->write(w->ctx, buf, len);
+    }
+    return w->err;
+}
+
+// Initial byte and argument in the shortest form
+static esp_err_t cbor_put_head(cbor_writer_t *w, uint8_t major, uint64_t arg) {
+    uint8_t buf[9];
+    size_t len;
+
+    if (arg < 24) {
+        buf[0] = major << 5 | arg;
+        len = 1;
+    } else if (arg <= UINT8_MAX) {
+        buf[0] = major << 5 | 24;
+        len = 2;
+    } else if (arg <= UINT16_MAX) {
+        buf[0] = major << 5 | 25;
+        len = 3;
+    } else if (arg <= UINT32_MAX) {
+        buf[0] = major << 5 | 26;
+        len = 5;
+    } else {
+        buf[0] = major << 5 | 27;
+        len = 9;
+    }
+
+    for (size_t i = 1; i < len; i++) {
+        buf[i] = arg >> (8 * (len - 1 - i));
+    }
+
+    return cbor_write(w, buf, len);
+}
+
+void cbor_writer_init(cbor_writer_t *w, cbor_write_fn_t write, void *ctx) {
+    w->write = write;
+    w->ctx = ctx;
+    w->err = write ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t cbor_put_uint(cbor_writer_t *w, uint64_t value) {
+    return cbor_put_head(w, 0, value);
+}
+
+esp_err_t cbor_put_int(cbor_writer_t *w, int64_t value) {
+    return value < 0 ? cbor_put_head(w, 1, -(value + 1)) : cbor_put_head(w, 0, value);
+}
+
+esp_err_t cbor_put_bool(cbor_writer_t *w, bool value) {
+    const uint8_t b = value ? 0xf5 : 0xf4;
+    return cbor_write(w, &b, 1);
+}
+
+esp_err_t cbor_put_null(cbor_writer_t *w) {
+    const uint8_t b = 0xf6;
+    return cbor_write(w, &b, 1);
+}
+
+esp_err_t cbor_put_double(cbor_writer_t *w, double value) {
+    uint8_t buf[9];
+    const float f = value;
+
+    if ((double)f == value || isnan(value)) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        buf[0] = 0xfa;
+        for (size_t i = 0; i < 4; i++) {
+            buf[1 + i] = bits >> (24 - 8 * i);
+        }
+        return cbor_write(w, buf, 5);
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buf[0] = 0xfb;
+    for (size_t i = 0; i < 8; i++) {
+        buf[1 + i] = bits >> (56 - 8 * i);
+    }
+    return cbor_write(w, buf, 9);
+}
+
+esp_err_t cbor_put_text(cbor_writer_t *w, const char *s) {
+    return cbor_put_text_n(w, s, strlen(s));
+}
+
+esp_err_t cbor_put_text_n(cbor_writer_t *w, const char *s, size_t len) {
+    cbor_put_head(w, 3, len);
+    return cbor_write(w, s, len);
+}
+
+esp_err_t cbor_put_bytes(cbor_writer_t *w, const void *data, size_t len) {
+    cbor_put_head(w, 2, len);
+    return cbor_write(w, data, len);
+}
+
+static esp_err_t cbor_put_container(cbor_writer_t *w, uint8_t major, size_t count) {
+    if (count == CBOR_INDEFINITE) {
+        const uint8_t b = major << 5 | CBOR_AI_INDEFINITE;
+        return cbor_write(w, &b, 1);
+    }
+    return cbor_put_head(w, major, count);
+}
+
+esp_err_t cbor_put_array(cbor_writer_t *w, size_t count) {
+    return cbor_put_container(w, 4, count);
+}
+
+esp_err_t cbor_put_map(cbor_writer_t *w, size_t count) {
+    return cbor_put_container(w, 5, count);
+}
+
+esp_err_t cbor_put_break(cbor_writer_t *w) {
+    const uint8_t b = 0xff;
+    return cbor_write(w, &b, 1);
+}
+
+void cbor_reader_init(cbor_reader_t *r, const void *data, size_t len) {
+    r->p = data;
+    r->end = r->p + len;
+    r->err = data || !len ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t cbor_fail(cbor_reader_t *r, esp_err_t err) {
+    if (r->err == ESP_OK) {
+        r->err = err;
+    }
+    return r->err;
+}
+
+cbor_type_t cbor_peek(const cbor_reader_t *r) {
+    if (r->err != ESP_OK || r->p >= r->end) {
+        return CBOR_END;
+    }
+
+    const uint8_t b = *r->p;
+    if (b >> 5 != 7) {
+        return (cbor_type_t)(b >> 5);
+    }
+
+    switch (b & 0x1f) {
+    case 20:
+    case 21:
+        return CBOR_BOOL;
+    case 22:
+        return CBOR_NULL;
+    case 25:
+    case 26:
+    case 27:
+        return CBOR_FLOAT;
+    case 31:
+        return CBOR_BREAK;
+    default:
+        return CBOR_SIMPLE;
+    }
+}
+
+// Reads the initial byte and its argument; *indefinite is set for additional information 31
+static esp_err_t cbor_get_head(cbor_reader_t *r, uint8_t *major, uint64_t *arg, bool *indefinite) {
+    if (r->err != ESP_OK) {
+        return r->err;
+    }
+    if (r->p >= r->end) {
+        return cbor_fail(r, ESP_ERR_INVALID_SIZE);
+    }
+
+    const uint8_t b = *r->p++;
+    const uint8_t ai = b & 0x1f;
+    *major = b >> 5;
+    *indefinite = false;
+
+    if (ai < 24) {
+        *arg = ai;
+        return ESP_OK;
+    }
+    if (ai == CBOR_AI_INDEFINITE) {
+        *indefinite = true;
+        *arg = 0;
+        return ESP_OK;
+    }
+    if (ai > 27) {
+        return cbor_fail(r, ESP_ERR_INVALID_STATE);
+    }
+
+    const size_t len = 1u << (ai - 24);
+    if ((size_t)(r->end - r->p) < len) {
+        return cbor_fail(r, ESP_ERR_INVALID_SIZE);
+    }
+
+    *arg = 0;
+    for (size_t i = 0; i < len; i++) {
+        *arg = *arg << 8 | *r->p++;
+    }
+    return ESP_OK;
+}
+
+// Consumes the next head if it is of the expected major type and definite
+static esp_err_t cbor_expect(cbor_reader_t *r, uint8_t major, uint64_t *arg) {
+    const uint8_t *start = r->p;
+    uint8_t m;
+    bool indefinite;
+
+    if (cbor_get_head(r, &m, arg, &indefinite) != ESP_OK) {
+        return r->err;
+    }
+    if (m != major || indefinite) {
+        r->p = start;
+        return cbor_fail(r, ESP_ERR_INVALID_STATE);
+    }
+    return ESP_OK;
+}
+
+esp_err_t cbor_get_uint(cbor_reader_t *r, uint64_t *out) {
+    return cbor_expect(r, 0, out);
+}
+
+esp_err_t cbor_get_int(cbor_reader_t *r, int64_t *out) {
+    const cbor_type_t type = cbor_peek(r);
+    uint64_t arg;
+
+    if (type != CBOR_UINT && type != CBOR_NINT) {
+        return cbor_fail(r, ESP_ERR_INVALID_STATE);
+    }
+    if (cbor_expect(r, type, &arg) != ESP_OK) {
+        return r->err;
+    }
+    if (arg > INT64_MAX) {
+        return cbor_fail(r, ESP_ERR_INVALID_STATE);
+    }
+
+    *out = type == CBOR_UINT ? (int64_t)arg : -1 - (int64_t)arg;
+    return ESP_OK;
+}
+
+esp_err_t cbor_get_bool(cbor_reader_t *r, bool *out) {
+    if (cbor_peek(r) != CBOR_BOOL) {
+        return cbor_fail(r, ESP_ERR_INVALID_STATE);
+    }
+
+    *out = *r->p++ == 0xf5;
+    return ESP_OK;
+}
+
+// IEEE 754 half precision, RFC 8949 appendix D
+static double cbor_half_to_double(uint16_t half) {
+    const int exp = (half >> 10) & 0x1f;
+    const int mant = half & 0x3ff;
+    double val;
+
+    if (exp == 0) {
+        val = ldexp(mant, -24);
+    } else if (exp != 31) {
+        val = ldexp(mant + 1024, exp - 25);
+    } else {
+        val = mant == 0 ? INFINITY : NAN;
+    }
+    return half & 0x8000 ? -val : val;
+}
+
+esp_err_t cbor_get_double(cbor_reader_t *r, double *out) {
+    const cbor_type_t type = cbor_peek(r);
+
+    if (type == CBOR_UINT || type == CBOR_NINT) {
+        int64_t i;
+        if (cbor_get_int(r, &i) != ESP_OK) {
+            return r->err;
+        }
+        *out = i;
+        return ESP_OK;
+    }
+    if (type != CBOR_FLOAT) {
+        return cbor_fail(r, ESP_ERR_INVALID_STATE);
+    }
+
+    uint8_t major;
+    uint64_t bits;
+    bool indefinite;
+    const uint8_t ai = *r->p & 0x1f;
+    if (cbor_get_head(r, &major, &bits, &indefinite) != ESP_OK) {
+        return r->err;
+    }
+
+    if (ai == 25) {
+        *out = cbor_half_to_double(bits);
+    } else if (ai == 26) {
+        const uint32_t b32 = bits;
+        float f;
+        memcpy(&f, &b32, sizeof(f));
+        *out = f;
+    } else {
+        memcpy(out, &bits, sizeof(*out));
+    }
+    return ESP_OK;
+}
+
+static esp_err_t cbor_get_string(cbor_reader_t *r, uint8_t major, const uint8_t **out, size_t *len) {
+    uint64_t arg;
+
+    if (cbor_expect(r, major, &arg) != ESP_OK) {
+        return r->err;
+    }
+    if (arg > (uint64_t)(r->end - r->p)) {
+        return cbor_fail(r, ESP_ERR_INVALID_SIZE);
+    }
+
+    *out = r->p;
+    *len = arg;
+    r->p += arg;
+    return ESP_OK;
+}
+
+esp_err_t cbor_get_text(cbor_reader_t *r, const char **out, size_t *len) {
+    return cbor_get_string(r, 3, (const uint8_t **)out, len);
+}
+
+esp_err_t cbor_get_bytes(cbor_reader_t *r, const uint8_t **out, size_t *len) {
+    return cbor_get_string(r, 2, out, len);
+}
+
+static esp_err_t cbor_get_container(cbor_reader_t *r, uint8_t major, size_t *count) {
+    const uint8_t *start = r->p;
+    uint8_t m;
+    uint64_t arg;
+    bool indefinite;
+
+    if (cbor_get_head(r, &m, &arg, &indefinite) != ESP_OK) {
+        return r->err;
+    }
+    if (m != major) {
+        r->p = start;
+        return cbor_fail(r, ESP_ERR_INVALID_STATE);
+    }
+
+    // Every item takes at least a byte, a larger count can only be garbage
+    if (!indefinite && arg > (uint64_t)(r->end - r->p)) {
+        return cbor_fail(r, ESP_ERR_INVALID_SIZE);
+    }
+
+    *count = indefinite ? CBOR_INDEFINITE : (size_t)arg;
+    return ESP_OK;
+}
+
+esp_err_t cbor_get_array(cbor_reader_t *r, size_t *count) {
+    return cbor_get_container(r, 4, count);
+}
+
+esp_err_t cbor_get_map(cbor_reader_t *r, size_t *count) {
+    return cbor_get_container(r, 5, count);
+}
+
+bool cbor_at_break(cbor_reader_t *r) {
+    if (cbor_peek(r) != CBOR_BREAK) {
+        return false;
+    }
+    r->p++;
+    return true;
+}
+
+static esp_err_t cbor_skip_depth(cbor_reader_t *r, int depth) {
+    uint8_t major;
+    uint64_t arg;
+    bool indefinite;
+
+    if (depth > CBOR_MAX_DEPTH) {
+        return cbor_fail(r, ESP_ERR_INVALID_STATE);
+    }
+    if (cbor_get_head(r, &major, &arg, &indefinite) != ESP_OK) {
+        return r->err;
+    }
+
+    switch (major) {
+    case 2:
+    case 3:
+        if (indefinite) {
+            // Chunks of the same major type until the break
+            while (!cbor_at_break(r) && r->err == ESP_OK) {
+                cbor_skip_depth(r, depth + 1);
+            }
+            return r->err;
+        }
+        if (arg > (uint64_t)(r->end - r->p)) {
+            return cbor_fail(r, ESP_ERR_INVALID_SIZE);
+        }
+        r->p += arg;
+        return ESP_OK;
+    case 4:
+    case 5: {
+        if (indefinite) {
+            while (!cbor_at_break(r) && r->err == ESP_OK) {
+                cbor_skip_depth(r, depth + 1);
+            }
+            return r->err;
+        }
+        const uint64_t items = major == 5 ? arg * 2 : arg;
+        for (uint64_t i = 0; i < items && r->err == ESP_OK; i++) {
+            cbor_skip_depth(r, depth + 1);
+        }
+        return r->err;
+    }
+    case 6:
+        return cbor_skip_depth(r, depth + 1);
+    case 7:
+        // A lone break is not an item
+        return indefinite ? cbor_fail(r, ESP_ERR_INVALID_STATE) : ESP_OK;
+    default:
+        return indefinite ? cbor_fail(r, ESP_ERR_INVALID_STATE) : ESP_OK;
+    }
+}
+
+esp_err_t cbor_skip(cbor_reader_t *r) {
+    return cbor_skip_depth(r, 0);
+}
+
+bool cbor_text_eq(const char *text, size_t len, const char *s) {
+    return strlen(s) == len && memcmp(text, s, len) == 0;
+}
+
+#endif /* CBOR_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CBOR_H_ */
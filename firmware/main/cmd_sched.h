@@ -0,0 +1,187 @@
+/**
+ * @file cmd_sched.h
+ * @brief Fixed-capacity min-heap of timed commands
+ *
+ * Keeps pending commands ordered by due time in caller-provided storage, so
+ * the earliest one is always at hand for arming a single one-shot timer.
+ * Commands due at the same time come out in the order they were pushed.
+ * Not thread-safe, the caller serializes access.
+ *
+ * Example usage:
+ * @code
+ *     static cmd_sched_entry_t storage[16];
+ *     static cmd_sched_t sched;
+ *     cmd_sched_init(&sched, storage, 16);
+ *     uint32_t id = cmd_sched_push(&sched, now + 250000, ACTION_ON);
+ *     ...
+ *     cmd_sched_entry_t e;
+ *     while (cmd_sched_peek(&sched) && cmd_sched_peek(&sched)->at_us <= now && cmd_sched_pop(&sched, &e)) { ... }
+ * @endcode
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _CMD_SCHED_H_
+#define _CMD_SCHED_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pending command.
+ */
+typedef struct {
+    int64_t at_us; /*!< due time, esp_timer_get_time() base */
+    uint32_t id;   /*!< unique, increasing, never 0 */
+    uint8_t action;
+} cmd_sched_entry_t;
+
+/**
+ * @brief Scheduler state.
+ */
+typedef struct {
+    cmd_sched_entry_t *entries;
+    size_t len;
+    size_t cap;
+    uint32_t next_id;
+} cmd_sched_t;
+
+void cmd_sched_init(cmd_sched_t *s, cmd_sched_entry_t *storage, size_t cap);
+
+/**
+ * @brief Adds a command.
+ *
+ * @return Id of the entry, 0 if the scheduler is full.
+ */
+uint32_t cmd_sched_push(cmd_sched_t *s, int64_t at_us, uint8_t action);
+
+/**
+ * @brief Earliest entry, NULL if empty.
+ */
+const cmd_sched_entry_t *cmd_sched_peek(const cmd_sched_t *s);
+
+/**
+ * @brief Removes the earliest entry.
+ *
+ * @return false if empty.
+ */
+bool cmd_sched_pop(cmd_sched_t *s, cmd_sched_entry_t *out);
+
+/**
+ * @brief Removes the entry with the given id.
+ *
+ * @return false if there is no such entry.
+ */
+bool cmd_sched_cancel(cmd_sched_t *s, uint32_t id);
+
+#ifdef CMD_SCHED_IMPLEMENTATION
+
+// Ids grow with every push, so they break ties in push order
+static inline bool cmd_sched_less(const cmd_sched_entry_t *a, const cmd_sched_entry_t *b) {
+    return a->at_us < b->at_us || (a->at_us == b->at_us && a->id < b->id);
+}
+
+static inline void cmd_sched_swap(cmd_sched_entry_t *a, cmd_sched_entry_t *b) {
+    const cmd_sched_entry_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static void cmd_sched_up(cmd_sched_t *s, size_t i) {
+    while (i > 0) {
+        const size_t parent = (i - 1) / 2;
+        if (!cmd_sched_less(&s->entries[i], &s->entries[parent])) {
+            break;
+        }
+        cmd_sched_swap(&s->entries[i], &s->entries[parent]);
+        i = parent;
+    }
+}
+
+static void cmd_sched_down(cmd_sched_t *s, size_t i) {
+    for (;;) {
+        const size_t left = 2 * i + 1;
+        const size_t right = left + 1;
+        size_t min = i;
+
+        if (left < s->len && cmd_sched_less(&s->entries[left], &s->entries[min])) {
+            min = left;
+        }
+        if (right < s->len && cmd_sched_less(&s->entries[right], &s->entries[min])) {
+            min = right;
+        }
+        if (min == i) {
+            return;
+        }
+        cmd_sched_swap(&s->entries[i], &s->entries[min]);
+        i = min;
+    }
+}
+
+void cmd_sched_init(cmd_sched_t *s, cmd_sched_entry_t *storage, size_t cap) {
+    s->entries = storage;
+    s->len = 0;
+    s->cap = cap;
+    s->next_id = 1;
+}
+
+uint32_t cmd_sched_push(cmd_sched_t *s, int64_t at_us, uint8_t action) {
+    if (s->len == s->cap) {
+        return 0;
+    }
+
+    const uint32_t id = s->next_id++;
+    if (s->next_id == 0) {
+        s->next_id = 1;
+    }
+
+    s->entries[s->len] = (cmd_sched_entry_t){.at_us = at_us, .id = id, .action = action};
+    cmd_sched_up(s, s->len++);
+    return id;
+}
+
+const cmd_sched_entry_t *cmd_sched_peek(const cmd_sched_t *s) {
+    return s->len ? &s->entries[0] : NULL;
+}
+
+bool cmd_sched_pop(cmd_sched_t *s, cmd_sched_entry_t *out) {
+    if (s->len == 0) {
+        return false;
+    }
+
+    *out = s->entries[0];
+    s->entries[0] = s->entries[--s->len];
+    cmd_sched_down(s, 0);
+    return true;
+}
+
+// Linear search, the capacity is small. The last entry fills the hole and may need to move either way.
+bool cmd_sched_cancel(cmd_sched_t *s, uint32_t id) {
+    for (size_t i = 0; i < s->len; i++) {
+        if (s->entries[i].id != id) {
+            continue;
+        }
+
+        s->entries[i] = s->entries[--s->len];
+        if (i < s->len) {
+            cmd_sched_up(s, i);
+            cmd_sched_down(s, i);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+#endif /* CMD_SCHED_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CMD_SCHED_H_ */
@@ -0,0 +1,235 @@
+/**
+ * @file gunzip.h
+ * @brief Streaming gzip decoder on top of the ROM miniz inflater
+ *
+ * Decodes a gzip stream that is fully mapped in memory (e.g. an embedded
+ * asset in flash) and hands the output to a callback piece by piece, so
+ * no uncompressed copy has to exist anywhere. Streams made of several
+ * concatenated gzip members are decoded as one.
+ *
+ * Raw deflate data that arrives in pieces, e.g. a request body, is decoded
+ * incrementally with gunzip_inflate_begin() and gunzip_inflate_push().
+ *
+ * The inflater state and its 32 KB window are static: the decoder is not
+ * reentrant and must only be used from one task (the httpd task).
+ *
+ * @version 0.0.2
+ */
+
+#ifndef _GUNZIP_H_
+#define _GUNZIP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Output callback, called with consecutive pieces of the decoded data.
+ *
+ * @return ESP_OK to continue, any other value aborts the decoding and is returned by gunzip_stream().
+ */
+typedef esp_err_t (*gunzip_write_fn_t)(void *ctx, const uint8_t *buf, size_t len);
+
+/**
+ * @brief Decodes a gzip stream.
+ *
+ * @param src Compressed data.
+ * @param len Size of the compressed data.
+ * @param write Output callback.
+ * @param ctx Context passed to the callback.
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if an argument is NULL,
+ *         ESP_ERR_INVALID_RESPONSE if the data is not a valid gzip stream,
+ *         or the error returned by the callback.
+ */
+esp_err_t gunzip_stream(const uint8_t *src, size_t len, gunzip_write_fn_t write, void *ctx);
+
+/**
+ * @brief Starts decoding a raw deflate stream that arrives in pieces.
+ *
+ * Shares the static inflater with gunzip_stream(): nothing else may be decoded until the last piece is pushed.
+ */
+void gunzip_inflate_begin(void);
+
+/**
+ * @brief Decodes the next piece of a raw deflate stream started with gunzip_inflate_begin().
+ *
+ * @param src Compressed data.
+ * @param len Size of the compressed data.
+ * @param last true for the final piece, the stream must end with it.
+ * @param write Output callback.
+ * @param ctx Context passed to the callback.
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if an argument is NULL,
+ *         ESP_ERR_INVALID_RESPONSE if the data is not a valid deflate stream or continues past its end,
+ *         or the error returned by the callback.
+ */
+esp_err_t gunzip_inflate_push(const uint8_t *src, size_t len, bool last, gunzip_write_fn_t write, void *ctx);
+
+#ifdef GUNZIP_IMPLEMENTATION
+
+#include "rom/miniz.h"
+
+#define GUNZIP_FHCRC 0x02
+#define GUNZIP_FEXTRA 0x04
+#define GUNZIP_FNAME 0x08
+#define GUNZIP_FCOMMENT 0x10
+
+#define GUNZIP_TRAILER_LEN 8
+
+static tinfl_decompressor s_gunzip_inflator;
+static uint8_t s_gunzip_window[TINFL_LZ_DICT_SIZE];
+
+// Returns the offset of the deflate data behind a member header, or 0 if the header is invalid
+static size_t gunzip_header_len(const uint8_t *src, size_t len) {
+    if (len < 10 || src[0] != 0x1f || src[1] != 0x8b || src[2] != 8) {
+        return 0;
+    }
+
+    const uint8_t flags = src[3];
+    size_t pos = 10;
+
+    if (flags & GUNZIP_FEXTRA) {
+        if (pos + 2 > len) {
+            return 0;
+        }
+        pos += 2 + (src[pos] | (src[pos + 1] << 8));
+    }
+    if (flags & GUNZIP_FNAME) {
+        while (pos < len && src[pos]) {
+            pos++;
+        }
+        pos++;
+    }
+    if (flags & GUNZIP_FCOMMENT) {
+        while (pos < len && src[pos]) {
+            pos++;
+        }
+        pos++;
+    }
+    if (flags & GUNZIP_FHCRC) {
+        pos += 2;
+    }
+
+    return pos < len ? pos : 0;
+}
+
+// Inflates one member, returns the number of deflate bytes consumed or 0 on error
+static size_t gunzip_member(const uint8_t *src, size_t len, gunzip_write_fn_t write, void *ctx, esp_err_t *err) {
+    tinfl_decompressor *inflator = &s_gunzip_inflator;
+    tinfl_init(inflator);
+
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+
+    for (;;) {
+        size_t in_len = len - in_pos;
+        size_t out_len = TINFL_LZ_DICT_SIZE - out_pos;
+
+        // The whole input is mapped, so TINFL_FLAG_HAS_MORE_INPUT is never set
+        tinfl_status status = tinfl_decompress(inflator, src + in_pos, &in_len, s_gunzip_window,
+                                               s_gunzip_window + out_pos, &out_len, 0);
+        in_pos += in_len;
+
+        if (out_len) {
+            *err = write(ctx, s_gunzip_window + out_pos, out_len);
+            if (*err != ESP_OK) {
+                return 0;
+            }
+        }
+        out_pos = (out_pos + out_len) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (status == TINFL_STATUS_DONE) {
+            return in_pos;
+        }
+        if (status != TINFL_STATUS_HAS_MORE_OUTPUT) {
+            *err = ESP_ERR_INVALID_RESPONSE;
+            return 0;
+        }
+    }
+}
+
+esp_err_t gunzip_stream(const uint8_t *src, size_t len, gunzip_write_fn_t write, void *ctx) {
+    if (unlikely(!src || !write)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t pos = 0;
+    do {
+        const size_t header = gunzip_header_len(src + pos, len - pos);
+        if (unlikely(header == 0)) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        pos += header;
+
+        esp_err_t err = ESP_OK;
+        const size_t consumed = gunzip_member(src + pos, len - pos, write, ctx, &err);
+        if (unlikely(consumed == 0)) {
+            return err;
+        }
+
+        // The CRC is not checked: by the time it could fail the data is already on the wire
+        pos += consumed + GUNZIP_TRAILER_LEN;
+    } while (pos < len);
+
+    return pos == len ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+static size_t s_gunzip_out_pos;
+static bool s_gunzip_done;
+
+void gunzip_inflate_begin(void) {
+    tinfl_init(&s_gunzip_inflator);
+    s_gunzip_out_pos = 0;
+    s_gunzip_done = false;
+}
+
+esp_err_t gunzip_inflate_push(const uint8_t *src, size_t len, bool last, gunzip_write_fn_t write, void *ctx) {
+    if (unlikely((!src && len) || !write)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t in_pos = 0;
+    while (!s_gunzip_done) {
+        size_t in_len = len - in_pos;
+        size_t out_len = TINFL_LZ_DICT_SIZE - s_gunzip_out_pos;
+
+        tinfl_status status = tinfl_decompress(&s_gunzip_inflator, src + in_pos, &in_len, s_gunzip_window,
+                                               s_gunzip_window + s_gunzip_out_pos, &out_len,
+                                               last ? 0 : TINFL_FLAG_HAS_MORE_INPUT);
+        in_pos += in_len;
+
+        if (out_len) {
+            esp_err_t err = write(ctx, s_gunzip_window + s_gunzip_out_pos, out_len);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        s_gunzip_out_pos = (s_gunzip_out_pos + out_len) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (status == TINFL_STATUS_DONE) {
+            s_gunzip_done = true;
+        } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && !last) {
+            return ESP_OK;
+        } else if (status != TINFL_STATUS_HAS_MORE_OUTPUT) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    // Nothing may follow the end of the stream
+    return in_pos == len ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+#endif /* GUNZIP_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GUNZIP_H_ */
@@ -0,0 +1,402 @@
+/**
+ * @file gzip.h
+ * @brief Small-window streaming gzip encoder
+ *
+ * Compresses a byte stream into a single gzip member made of one
+ * fixed-Huffman deflate block, using greedy LZ77 matching over a small
+ * sliding window with a single-entry hash table. The whole state lives in
+ * a caller-provided gzip_t of a few KB, nothing is allocated.
+ *
+ * The ratio is below zlib's (no dynamic Huffman tables, no lazy matching),
+ * the point is that it fits: miniz's tdefl needs ~300 KB of state.
+ *
+ * gzip_stored() wraps data into a member of a single stored block instead,
+ * without copying it. Concatenated after or between other members, it
+ * splices live data into a precompressed stream at no compression cost.
+ *
+ * Example usage:
+ * @code
+ *     static gzip_t gz;
+ *     gzip_begin(&gz, write_fn, ctx);
+ *     gzip_write(&gz, data, len);
+ *     gzip_finish(&gz);
+ * @endcode
+ *
+ * @version 0.0.2
+ */
+
+#ifndef _GZIP_H_
+#define _GZIP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief log2 of the LZ77 window, at most 15.
+ */
+#ifndef GZIP_WINDOW_BITS
+#define GZIP_WINDOW_BITS 11
+#endif
+
+/**
+ * @brief log2 of the number of hash table entries.
+ */
+#ifndef GZIP_HASH_BITS
+#define GZIP_HASH_BITS 10
+#endif
+
+/**
+ * @brief Size of the output staging buffer handed to the write callback.
+ */
+#ifndef GZIP_OUT_LEN
+#define GZIP_OUT_LEN 512
+#endif
+
+/**
+ * @brief Bytes gzip_stored() adds around the data: header, block header and trailer.
+ */
+#define GZIP_STORED_OVERHEAD (10 + 5 + 8)
+
+/**
+ * @brief Largest payload of a gzip_stored() member, the limit of a single stored block.
+ */
+#define GZIP_STORED_MAX 0xffff
+
+#define GZIP_WINDOW (1u << GZIP_WINDOW_BITS)
+#define GZIP_HASH_SIZE (1u << GZIP_HASH_BITS)
+
+/**
+ * @brief Output callback, called with consecutive pieces of the compressed stream.
+ *
+ * @return ESP_OK to continue, any other value aborts the encoding.
+ */
+typedef esp_err_t (*gzip_write_fn_t)(void *ctx, const uint8_t *buf, size_t len);
+
+/**
+ * @brief Encoder state. Treat as opaque.
+ */
+typedef struct {
+    gzip_write_fn_t write;
+    void *ctx;
+    esp_err_t err;
+    uint32_t crc;
+    uint32_t bits;
+    uint8_t bit_count;
+    size_t start;
+    size_t end;
+    size_t out_len;
+    size_t in_total;  /*!< uncompressed bytes consumed so far */
+    size_t out_total; /*!< compressed bytes handed to the callback so far */
+    uint16_t head[GZIP_HASH_SIZE];
+    uint8_t buf[2 * GZIP_WINDOW];
+    uint8_t out[GZIP_OUT_LEN];
+} gzip_t;
+
+/**
+ * @brief Starts a gzip member.
+ *
+ * @param gz Encoder state.
+ * @param write Output callback.
+ * @param ctx Context passed to the callback.
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if gz or write is NULL.
+ */
+esp_err_t gzip_begin(gzip_t *gz, gzip_write_fn_t write, void *ctx);
+
+/**
+ * @brief Compresses data. Output is emitted whenever the staging buffer fills up.
+ *
+ * @param gz Encoder state.
+ * @param data Uncompressed data.
+ * @param len Size of the data.
+ * @return ESP_OK on success, or the first error returned by the callback.
+ */
+esp_err_t gzip_write(gzip_t *gz, const void *data, size_t len);
+
+/**
+ * @brief Compresses the pending input, writes the trailer and flushes everything.
+ *
+ * @param gz Encoder state.
+ * @return ESP_OK on success, or the first error returned by the callback.
+ */
+esp_err_t gzip_finish(gzip_t *gz);
+
+/**
+ * @brief Writes a complete gzip member holding data uncompressed.
+ *
+ * The data is passed to the callback as is, between the generated header
+ * and trailer. The member is GZIP_STORED_OVERHEAD bytes larger than the data.
+ *
+ * @param data Data.
+ * @param len Size of the data, at most GZIP_STORED_MAX.
+ * @param write Output callback.
+ * @param ctx Context passed to the callback.
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if write is NULL,
+ *         ESP_ERR_INVALID_SIZE if the data does not fit in a stored block,
+ *         or the first error returned by the callback.
+ */
+esp_err_t gzip_stored(const void *data, size_t len, gzip_write_fn_t write, void *ctx);
+
+#ifdef GZIP_IMPLEMENTATION
+
+#include <string.h>
+
+#include "esp_rom_crc.h"
+
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+
+static const uint16_t gzip_len_base[] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                         31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t gzip_len_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                         2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t gzip_dist_base[] = {1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+                                          33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+                                          1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+static const uint8_t gzip_dist_extra[] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                          6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static void gzip_flush_out(gzip_t *gz) {
+    if (gz->out_len == 0 || gz->err != ESP_OK) {
+        return;
+    }
+
+    gz->err = gz->write(gz->ctx, gz->out, gz->out_len);
+    gz->out_total += gz->out_len;
+    gz->out_len = 0;
+}
+
+static inline void gzip_put_byte(gzip_t *gz, uint8_t b) {
+    gz->out[gz->out_len++] = b;
+    if (gz->out_len == GZIP_OUT_LEN) {
+        gzip_flush_out(gz);
+    }
+}
+
+// Deflate packs data elements starting at the least significant bit
+static inline void gzip_put_bits(gzip_t *gz, uint32_t value, uint8_t count) {
+    gz->bits |= value << gz->bit_count;
+    gz->bit_count += count;
+    while (gz->bit_count >= 8) {
+        gzip_put_byte(gz, gz->bits & 0xff);
+        gz->bits >>= 8;
+        gz->bit_count -= 8;
+    }
+}
+
+// Huffman codes are defined most significant bit first
+static inline void gzip_put_code(gzip_t *gz, uint32_t code, uint8_t count) {
+    uint32_t reversed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    gzip_put_bits(gz, reversed, count);
+}
+
+// Fixed Huffman literal/length alphabet, RFC 1951 section 3.2.6
+static void gzip_put_symbol(gzip_t *gz, uint16_t sym) {
+    if (sym < 144) {
+        gzip_put_code(gz, 0x30 + sym, 8);
+    } else if (sym < 256) {
+        gzip_put_code(gz, 0x190 + sym - 144, 9);
+    } else if (sym < 280) {
+        gzip_put_code(gz, sym - 256, 7);
+    } else {
+        gzip_put_code(gz, 0xc0 + sym - 280, 8);
+    }
+}
+
+static void gzip_put_match(gzip_t *gz, size_t len, size_t dist) {
+    int i = sizeof(gzip_len_base) / sizeof(gzip_len_base[0]) - 1;
+    while (gzip_len_base[i] > len) {
+        i--;
+    }
+    gzip_put_symbol(gz, 257 + i);
+    gzip_put_bits(gz, len - gzip_len_base[i], gzip_len_extra[i]);
+
+    int j = sizeof(gzip_dist_base) / sizeof(gzip_dist_base[0]) - 1;
+    while (gzip_dist_base[j] > dist) {
+        j--;
+    }
+    gzip_put_code(gz, j, 5);
+    gzip_put_bits(gz, dist - gzip_dist_base[j], gzip_dist_extra[j]);
+}
+
+static inline uint32_t gzip_hash(const uint8_t *p) {
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - GZIP_HASH_BITS);
+}
+
+// Encodes buffered input, keeping a full match of lookahead unless the stream ends
+static void gzip_deflate(gzip_t *gz, bool finish) {
+    while (gz->start < gz->end) {
+        const size_t avail = gz->end - gz->start;
+        if (!finish && avail < GZIP_MAX_MATCH) {
+            break;
+        }
+
+        size_t best_len = 0;
+        size_t dist = 0;
+
+        if (avail >= GZIP_MIN_MATCH) {
+            const uint32_t h = gzip_hash(gz->buf + gz->start);
+            const size_t candidate = gz->head[h];
+            gz->head[h] = gz->start + 1;
+
+            if (candidate) {
+                dist = gz->start - (candidate - 1);
+                if (dist > 0 && dist <= GZIP_WINDOW) {
+                    const uint8_t *a = gz->buf + candidate - 1;
+                    const uint8_t *b = gz->buf + gz->start;
+                    const size_t max = avail < GZIP_MAX_MATCH ? avail : GZIP_MAX_MATCH;
+                    while (best_len < max && a[best_len] == b[best_len]) {
+                        best_len++;
+                    }
+                }
+            }
+        }
+
+        if (best_len >= GZIP_MIN_MATCH) {
+            gzip_put_match(gz, best_len, dist);
+            for (size_t k = 1; k < best_len; k++) {
+                const size_t p = gz->start + k;
+                if (gz->end - p >= GZIP_MIN_MATCH) {
+                    gz->head[gzip_hash(gz->buf + p)] = p + 1;
+                }
+            }
+            gz->start += best_len;
+        } else {
+            gzip_put_symbol(gz, gz->buf[gz->start]);
+            gz->start++;
+        }
+    }
+}
+
+// Drops the oldest window worth of history once the buffer is full
+static void gzip_slide(gzip_t *gz) {
+    memmove(gz->buf, gz->buf + GZIP_WINDOW, gz->end - GZIP_WINDOW);
+    gz->start -= GZIP_WINDOW;
+    gz->end -= GZIP_WINDOW;
+
+    for (size_t i = 0; i < GZIP_HASH_SIZE; i++) {
+        gz->head[i] = gz->head[i] > GZIP_WINDOW ? gz->head[i] - GZIP_WINDOW : 0;
+    }
+}
+
+esp_err_t gzip_begin(gzip_t *gz, gzip_write_fn_t write, void *ctx) {
+    if (unlikely(!gz || !write)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(gz->head, 0, sizeof(gz->head));
+    gz->write = write;
+    gz->ctx = ctx;
+    gz->err = ESP_OK;
+    gz->crc = 0;
+    gz->bits = 0;
+    gz->bit_count = 0;
+    gz->start = 0;
+    gz->end = 0;
+    gz->out_len = 0;
+    gz->in_total = 0;
+    gz->out_total = 0;
+
+    // ID1 ID2 CM=deflate FLG=0 MTIME=0 XFL=0 OS=unknown
+    static const uint8_t header[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+    for (size_t i = 0; i < sizeof(header); i++) {
+        gzip_put_byte(gz, header[i]);
+    }
+
+    // The whole member is one final fixed-Huffman block: BFINAL=1, BTYPE=01
+    gzip_put_bits(gz, 1, 1);
+    gzip_put_bits(gz, 1, 2);
+
+    return gz->err;
+}
+
+esp_err_t gzip_write(gzip_t *gz, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    while (len && gz->err == ESP_OK) {
+        size_t n = sizeof(gz->buf) - gz->end;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(gz->buf + gz->end, p, n);
+        gz->crc = esp_rom_crc32_le(gz->crc, p, n);
+        gz->in_total += n;
+        gz->end += n;
+        p += n;
+        len -= n;
+
+        if (gz->end == sizeof(gz->buf)) {
+            gzip_deflate(gz, false);
+            gzip_slide(gz);
+        }
+    }
+
+    return gz->err;
+}
+
+esp_err_t gzip_finish(gzip_t *gz) {
+    gzip_deflate(gz, true);
+    gzip_put_symbol(gz, 256);
+    if (gz->bit_count) {
+        gzip_put_bits(gz, 0, 8 - gz->bit_count);
+    }
+
+    const uint32_t trailer[] = {gz->crc, (uint32_t)gz->in_total};
+    for (size_t i = 0; i < 2; i++) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            gzip_put_byte(gz, (trailer[i] >> shift) & 0xff);
+        }
+    }
+
+    gzip_flush_out(gz);
+    return gz->err;
+}
+
+esp_err_t gzip_stored(const void *data, size_t len, gzip_write_fn_t write, void *ctx) {
+    if (unlikely(!write || (!data && len))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (unlikely(len > GZIP_STORED_MAX)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // gzip header as in gzip_begin(), then BFINAL=1 BTYPE=00 padded to the byte, LEN and NLEN
+    const uint8_t header[] = {
+        0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff, 0x01, len & 0xff, len >> 8, ~len & 0xff, (~len >> 8) & 0xff,
+    };
+
+    const uint32_t crc = esp_rom_crc32_le(0, data, len);
+    const uint8_t trailer[] = {
+        crc & 0xff, (crc >> 8) & 0xff, (crc >> 16) & 0xff, crc >> 24, len & 0xff, len >> 8, 0, 0,
+    };
+
+    esp_err_t err = write(ctx, header, sizeof(header));
+    if (err == ESP_OK && len) {
+        err = write(ctx, data, len);
+    }
+    if (err == ESP_OK) {
+        err = write(ctx, trailer, sizeof(trailer));
+    }
+
+    return err;
+}
+
+#endif /* GZIP_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GZIP_H_ */
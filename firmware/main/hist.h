@@ -0,0 +1,130 @@
+/**
+ * @file hist.h
+ * @brief Fixed-size log-linear latency histogram
+ *
+ * Records non-negative values (e.g. microseconds) into buckets that split
+ * every power of two into HIST_SUB_BUCKETS linear steps, so the relative
+ * error of a percentile estimate stays below 1 / HIST_SUB_BUCKETS at any
+ * magnitude. Recording is O(1) and the histogram is a plain struct, it can
+ * be copied or reset with memset.
+ *
+ * Example usage:
+ * @code
+ *     static hist_t h;
+ *     hist_add(&h, elapsed_us);
+ *     uint32_t p99 = hist_percentile(&h, 990);
+ * @endcode
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _HIST_H_
+#define _HIST_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief log2 of the number of linear steps per power of two.
+ */
+#ifndef HIST_SUB_BITS
+#define HIST_SUB_BITS 2
+#endif
+
+#define HIST_SUB_BUCKETS (1u << HIST_SUB_BITS)
+
+/**
+ * @brief Number of buckets, enough for every uint32_t value.
+ */
+#define HIST_BUCKETS ((32 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/**
+ * @brief Histogram state.
+ */
+typedef struct {
+    uint32_t count;
+    uint64_t sum;
+    uint32_t max;
+    uint32_t buckets[HIST_BUCKETS];
+} hist_t;
+
+/**
+ * @brief Records a value.
+ *
+ * @param h Histogram.
+ * @param value Value.
+ */
+void hist_add(hist_t *h, uint32_t value);
+
+/**
+ * @brief Estimates a percentile.
+ *
+ * @param h Histogram.
+ * @param permille Percentile in thousandths, e.g. 500 for the median or 999 for p99.9.
+ * @return Midpoint of the bucket holding the percentile, 0 if the histogram is empty.
+ */
+uint32_t hist_percentile(const hist_t *h, uint32_t permille);
+
+#ifdef HIST_IMPLEMENTATION
+
+// Values below HIST_SUB_BUCKETS get a bucket each, above that every power of two is split linearly
+static inline uint32_t hist_bucket(uint32_t value) {
+    if (value < HIST_SUB_BUCKETS) {
+        return value;
+    }
+
+    const uint32_t msb = 31 - __builtin_clz(value);
+    const uint32_t sub = (value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+static inline uint64_t hist_bucket_low(uint32_t bucket) {
+    if (bucket < HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    const uint32_t msb = bucket / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+    const uint32_t sub = bucket % HIST_SUB_BUCKETS;
+    return ((uint64_t)HIST_SUB_BUCKETS + sub) << (msb - HIST_SUB_BITS);
+}
+
+void hist_add(hist_t *h, uint32_t value) {
+    h->count++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+    h->buckets[hist_bucket(value)]++;
+}
+
+uint32_t hist_percentile(const hist_t *h, uint32_t permille) {
+    if (h->count == 0) {
+        return 0;
+    }
+
+    // Nearest rank
+    const uint64_t rank = ((uint64_t)h->count * permille + 999) / 1000;
+    uint64_t seen = 0;
+
+    for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank && seen) {
+            const uint64_t low = hist_bucket_low(i);
+            const uint64_t mid = (low + hist_bucket_low(i + 1) - 1) / 2;
+            return mid < h->max ? mid : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+#endif /* HIST_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HIST_H_ */
@@ -0,0 +1,172 @@
+/**
+ * @file http_accept.h
+ * @brief Accept and Accept-Encoding negotiation helpers for esp_http_server
+ *
+ * Parses the content codings or media types and quality values of an
+ * Accept-Encoding or Accept header value without allocating.
+ *
+ * @version 0.0.2
+ */
+
+#ifndef _HTTP_ACCEPT_H_
+#define _HTTP_ACCEPT_H_
+
+#include <stdbool.h>
+
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Longest Accept-Encoding value that is evaluated.
+ */
+#ifndef HTTP_ACCEPT_HDR_MAX
+#define HTTP_ACCEPT_HDR_MAX 128
+#endif
+
+/**
+ * @brief Returns the quality value of a content coding in an Accept-Encoding value.
+ *
+ * A coding that is not listed takes the quality of "*" when present.
+ *
+ * @param value Header value, e.g. "gzip, deflate;q=0.5, br".
+ * @param coding Content coding to look up, compared case-insensitively.
+ * @return Quality in thousandths (0..1000), or -1 if neither the coding nor "*" is listed.
+ */
+int http_accept_q(const char *value, const char *coding);
+
+/**
+ * @brief Checks whether the client accepts a content coding.
+ *
+ * A request without Accept-Encoding is treated as identity-only: RFC 9110
+ * would allow any coding, but clients that omit the header (curl without
+ * --compressed, small embedded clients) do not decode anything.
+ *
+ * @param req Request.
+ * @param coding Content coding, e.g. "gzip".
+ * @return true if the coding is listed with a non-zero quality.
+ */
+bool http_accepts_encoding(httpd_req_t *req, const char *coding);
+
+/**
+ * @brief Checks whether the client explicitly asks for a media type rather than the default one.
+ *
+ * Wildcard media ranges never select the alternative: a request without
+ * Accept, or with only wildcards, gets the default type.
+ *
+ * @param req Request.
+ * @param type Alternative media type, e.g. "application/cbor".
+ * @param fallback Default media type, e.g. "application/json".
+ * @return true if type is listed with a non-zero quality not below that of fallback.
+ */
+bool http_prefers_type(httpd_req_t *req, const char *type, const char *fallback);
+
+#ifdef HTTP_ACCEPT_IMPLEMENTATION
+
+#include <string.h>
+#include <strings.h>
+
+// Parses a qvalue ("1", "0.5", "0.125") into thousandths
+static int http_accept_parse_q(const char *s, const char *end) {
+    while (s < end && (*s == ' ' || *s == '\t')) {
+        s++;
+    }
+
+    if (s >= end || (*s != '0' && *s != '1')) {
+        return 1000;
+    }
+
+    int q = (*s++ - '0') * 1000;
+    if (s < end && *s == '.') {
+        s++;
+        for (int scale = 100; scale > 0 && s < end && *s >= '0' && *s <= '9'; scale /= 10, s++) {
+            q += (*s - '0') * scale;
+        }
+    }
+
+    return q > 1000 ? 1000 : q;
+}
+
+int http_accept_q(const char *value, const char *coding) {
+    if (unlikely(!value || !coding)) {
+        return -1;
+    }
+
+    const size_t coding_len = strlen(coding);
+    int any = -1;
+    const char *p = value;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+
+        const char *token = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        const size_t token_len = p - token;
+
+        const char *params = p;
+        while (*p && *p != ',') {
+            p++;
+        }
+
+        if (token_len == 0) {
+            continue;
+        }
+
+        int q = 1000;
+        for (const char *param = params; param < p; param++) {
+            if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=' && param > params &&
+                (param[-1] == ';' || param[-1] == ' ' || param[-1] == '\t')) {
+                q = http_accept_parse_q(param + 2, p);
+                break;
+            }
+        }
+
+        if (token_len == coding_len && strncasecmp(token, coding, coding_len) == 0) {
+            return q;
+        }
+        if (token_len == 1 && token[0] == '*') {
+            any = q;
+        }
+    }
+
+    return any;
+}
+
+bool http_accepts_encoding(httpd_req_t *req, const char *coding) {
+    char value[HTTP_ACCEPT_HDR_MAX];
+
+    // An oversized value is evaluated truncated, the list is only ever cut at its end
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+
+    return http_accept_q(value, coding) > 0;
+}
+
+bool http_prefers_type(httpd_req_t *req, const char *type, const char *fallback) {
+    char value[HTTP_ACCEPT_HDR_MAX];
+
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept", value, sizeof(value));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+
+    // A media range "*/*" is a token of its own to http_accept_q(), it never counts for either type
+    const int q = http_accept_q(value, type);
+    return q > 0 && q >= http_accept_q(value, fallback);
+}
+
+#endif /* HTTP_ACCEPT_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HTTP_ACCEPT_H_ */
@@ -0,0 +1,187 @@
+/**
+ * @file http_auth.h
+ * @brief Shared-key signatures of HTTP requests that change the device
+ *
+ * Requests carry the key of the UDP commands (udp_cmd.h) as an HMAC in
+ *
+ *     Authorization: HMAC-SHA256 <seq>:<mac>
+ *
+ * seq is a decimal sequence number above 0, mac the hex HMAC-SHA256 of
+ *
+ *     <method> SP <uri> LF <seq> LF <digest>
+ *
+ * truncated to HTTP_AUTH_MAC_LEN bytes. uri is the request target as sent,
+ * digest the value of the RFC 9530 digest field the endpoint names,
+ * "sha-256=:<base64>:". The MAC binds the body through that field without
+ * being computed over it, so bodies can stream: the endpoint checks what
+ * it received against the digest before the change takes effect.
+ *
+ * As with UDP commands, each accepted number must be above the last one,
+ * which the caller persists, so captured requests are refused, after a
+ * reboot too. Clients should derive numbers from the wall clock, e.g.
+ * microseconds since the epoch, see tools/http-auth.mjs.
+ *
+ * Example usage:
+ * @code
+ *     http_auth_t auth;
+ *     uint8_t digest[32];
+ *     if (http_auth_parse(authorization, &auth) == ESP_OK &&
+ *         http_auth_verify(&auth, "PUT", uri, digest_field, key, key_len) == ESP_OK &&
+ *         http_auth_digest_decode(digest_field, digest) == ESP_OK && auth.seq > last_seq) {
+ *         ...
+ *     }
+ * @endcode
+ *
+ * @version 0.0.2
+ */
+
+#ifndef _HTTP_AUTH_H_
+#define _HTTP_AUTH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_AUTH_SCHEME "HMAC-SHA256"
+#define HTTP_AUTH_MAC_LEN 16
+
+/**
+ * @brief Buffer size for the longest Authorization value that parses, including the terminator.
+ */
+#define HTTP_AUTH_VALUE_MAX (sizeof(HTTP_AUTH_SCHEME) + 20 + 1 + 2 * HTTP_AUTH_MAC_LEN + 1)
+
+/**
+ * @brief Buffer size for a "sha-256=:<base64>:" digest field, including the terminator.
+ */
+#define HTTP_AUTH_DIGEST_FIELD_MAX 64
+
+/**
+ * @brief Parsed Authorization value.
+ */
+typedef struct {
+    uint64_t seq;
+    uint8_t mac[HTTP_AUTH_MAC_LEN];
+} http_auth_t;
+
+/**
+ * @brief Parses an Authorization value.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for another scheme, a malformed value or sequence number 0.
+ */
+esp_err_t http_auth_parse(const char *value, http_auth_t *out);
+
+/**
+ * @brief Checks the MAC of a request.
+ *
+ * @param digest Value of the digest field of the request, as received.
+ * @return ESP_OK, ESP_ERR_INVALID_CRC for a wrong MAC.
+ */
+esp_err_t http_auth_verify(const http_auth_t *auth, const char *method, const char *uri, const char *digest,
+                           const uint8_t *key, size_t key_len);
+
+/**
+ * @brief Decodes the SHA-256 out of a "sha-256=:<base64>:" digest field.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the field holds no SHA-256.
+ */
+esp_err_t http_auth_digest_decode(const char *value, uint8_t digest[32]);
+
+#ifdef HTTP_AUTH_IMPLEMENTATION
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mac_equal.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/md.h"
+
+static int http_auth_hex(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+esp_err_t http_auth_parse(const char *value, http_auth_t *out) {
+    const size_t scheme_len = strlen(HTTP_AUTH_SCHEME);
+    if (strncmp(value, HTTP_AUTH_SCHEME, scheme_len) != 0 || value[scheme_len] != ' ') {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *p = value + scheme_len + 1;
+    out->seq = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        const uint64_t digit = *p - '0';
+        if (out->seq > (UINT64_MAX - digit) / 10) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        out->seq = out->seq * 10 + digit;
+    }
+    if (out->seq == 0 || *p++ != ':') {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < HTTP_AUTH_MAC_LEN; i++) {
+        const int hi = http_auth_hex(p[2 * i]);
+        const int lo = hi >= 0 ? http_auth_hex(p[2 * i + 1]) : -1;
+        if (lo < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        out->mac[i] = hi << 4 | lo;
+    }
+    return p[2 * HTTP_AUTH_MAC_LEN] == '\0' ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t http_auth_verify(const http_auth_t *auth, const char *method, const char *uri, const char *digest,
+                           const uint8_t *key, size_t key_len) {
+    char seq[24];
+    const int seq_len = snprintf(seq, sizeof(seq), "\n%" PRIu64 "\n", auth->seq);
+
+    mbedtls_md_context_t ctx;
+    mbedtls_md_init(&ctx);
+    uint8_t full[32];
+    int ret = mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    ret = ret ? ret : mbedtls_md_hmac_starts(&ctx, key, key_len);
+    ret = ret ? ret : mbedtls_md_hmac_update(&ctx, (const unsigned char *)method, strlen(method));
+    ret = ret ? ret : mbedtls_md_hmac_update(&ctx, (const unsigned char *)" ", 1);
+    ret = ret ? ret : mbedtls_md_hmac_update(&ctx, (const unsigned char *)uri, strlen(uri));
+    ret = ret ? ret : mbedtls_md_hmac_update(&ctx, (const unsigned char *)seq, seq_len);
+    ret = ret ? ret : mbedtls_md_hmac_update(&ctx, (const unsigned char *)digest, strlen(digest));
+    ret = ret ? ret : mbedtls_md_hmac_finish(&ctx, full);
+    mbedtls_md_free(&ctx);
+    if (ret != 0) {
+        return ESP_FAIL;
+    }
+
+    return mac_equal(full, auth->mac, HTTP_AUTH_MAC_LEN) ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+esp_err_t http_auth_digest_decode(const char *value, uint8_t digest[32]) {
+    const char *start = strstr(value, "sha-256=:");
+    const char *end = start ? strchr(start + strlen("sha-256=:"), ':') : NULL;
+    if (!end) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    start += strlen("sha-256=:");
+
+    size_t len;
+    if (mbedtls_base64_decode(digest, 32, &len, (const unsigned char *)start, end - start) != 0 || len != 32) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+#endif /* HTTP_AUTH_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HTTP_AUTH_H_ */
@@ -0,0 +1,505 @@
+/**
+ * @file http_cond.h
+ * @brief RFC 9110 conditional request evaluation for esp_http_server
+ *
+ * Evaluates If-Match, If-Unmodified-Since, If-None-Match and
+ * If-Modified-Since in the order required by RFC 9110 section 13.2.2.
+ * Entity-tag lists, weak tags (W/) and "*" are supported. HTTP dates are
+ * accepted in all three formats a recipient must understand (IMF-fixdate,
+ * RFC 850 and asctime) and are produced as IMF-fixdate.
+ *
+ * Single byte-range requests (Range, guarded by If-Range) are resolved
+ * against the selected representation; multiple ranges are ignored, which
+ * RFC 9110 permits, and the full representation is sent instead.
+ *
+ * Nothing here allocates: header values are read into bounded stack
+ * buffers and a header that does not fit is treated as absent, which
+ * degrades to a full response instead of a wrong 304.
+ *
+ * Example usage:
+ * @code
+ *     http_cond_result_t cond = http_cond_evaluate(req, etag, last_modified);
+ *     if (cond == HTTP_COND_NOT_MODIFIED) {
+ *         return send_not_modified(req); // raw head, see http_cond_send()
+ *     }
+ *     if (cond != HTTP_COND_NONE) {
+ *         return http_cond_send(req, cond);
+ *     }
+ * @endcode
+ *
+ * @version 0.0.4
+ */
+
+#ifndef _HTTP_COND_H_
+#define _HTTP_COND_H_
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Longest conditional header value that is evaluated.
+ */
+#ifndef HTTP_COND_HDR_MAX
+#define HTTP_COND_HDR_MAX 256
+#endif
+
+/**
+ * @brief Buffer size required by http_date_format(), including the terminator.
+ */
+#define HTTP_DATE_LEN 30
+
+/**
+ * @brief Outcome of the precondition evaluation.
+ */
+typedef enum {
+    HTTP_COND_NONE = 0,               /*!< no precondition decided the response, send it in full */
+    HTTP_COND_NOT_MODIFIED,           /*!< answer with 304 Not Modified */
+    HTTP_COND_PRECONDITION_FAILED,    /*!< answer with 412 Precondition Failed */
+} http_cond_result_t;
+
+/**
+ * @brief Outcome of the Range evaluation.
+ */
+typedef enum {
+    HTTP_RANGE_NONE = 0,       /*!< no usable Range, send the full representation */
+    HTTP_RANGE_PARTIAL,        /*!< answer with 206 Partial Content for the resolved range */
+    HTTP_RANGE_UNSATISFIABLE,  /*!< answer with 416 Range Not Satisfiable */
+} http_range_result_t;
+
+/**
+ * @brief Checks an entity-tag list header value against an entity tag.
+ *
+ * @param list Header value: "*" or a comma separated list of entity tags.
+ * @param etag Entity tag of the selected representation, including quotes and optional W/ prefix, or NULL if
+ *             there is no current representation, which nothing matches, not even "*".
+ * @param weak true for weak comparison (If-None-Match), false for strong comparison (If-Match).
+ * @return true if any member of the list matches.
+ */
+bool http_etag_list_match(const char *list, const char *etag, bool weak);
+
+/**
+ * @brief Formats a timestamp as IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+ *
+ * @param t Seconds since the epoch, UTC.
+ * @param[out] buf Output buffer, at least HTTP_DATE_LEN bytes.
+ * @param len Size of buf.
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if buf is NULL,
+ *         ESP_ERR_INVALID_SIZE if buf is too small.
+ */
+esp_err_t http_date_format(time_t t, char *buf, size_t len);
+
+/**
+ * @brief Parses an HTTP date in IMF-fixdate, RFC 850 or asctime format.
+ *
+ * @param s Date string.
+ * @param[out] out Seconds since the epoch, UTC.
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if s or out is NULL or s is not a valid date.
+ */
+esp_err_t http_date_parse(const char *s, time_t *out);
+
+/**
+ * @brief Converts a civil date to seconds since the epoch without consulting the timezone.
+ */
+time_t http_date_from_civil(int year, int month, int day, int hour, int min, int sec);
+
+/**
+ * @brief Evaluates the request preconditions for a GET or HEAD request.
+ *
+ * @param req Request.
+ * @param etag Entity tag of the selected representation or NULL if there is no current one.
+ * @param last_modified Last modification time of the representation or 0 if unknown.
+ * @return The response the preconditions demand.
+ */
+http_cond_result_t http_cond_evaluate(httpd_req_t *req, const char *etag, time_t last_modified);
+
+/**
+ * @brief Sends the bodyless 412 response for a failed precondition.
+ *
+ * Headers set on the response beforehand are kept. A 304 is not sent
+ * here: esp_http_server always adds Content-Length, and a 304 must not
+ * carry one that differs from the selected representation's (RFC 9110
+ * section 15.4.5), so the caller writes its head raw.
+ *
+ * @param req Request.
+ * @param cond HTTP_COND_PRECONDITION_FAILED.
+ * @return Result of the send, ESP_ERR_INVALID_ARG for any other cond.
+ */
+esp_err_t http_cond_send(httpd_req_t *req, http_cond_result_t cond);
+
+/**
+ * @brief Parses a single byte-range Range header value.
+ *
+ * @param value Header value, e.g. "bytes=0-499", "bytes=500-" or "bytes=-500".
+ * @param size Size of the selected representation.
+ * @param[out] start First byte of the range.
+ * @param[out] len Length of the range.
+ * @return The response the range demands.
+ */
+http_range_result_t http_range_parse(const char *value, size_t size, size_t *start, size_t *len);
+
+/**
+ * @brief Evaluates Range and If-Range for a GET or HEAD request.
+ *
+ * Call after http_cond_evaluate() returned HTTP_COND_NONE.
+ *
+ * @param req Request.
+ * @param etag Entity tag of the selected representation or NULL if there is no current one.
+ * @param last_modified Last modification time of the representation or 0 if unknown.
+ * @param size Size of the selected representation.
+ * @param[out] start First byte of the range.
+ * @param[out] len Length of the range.
+ * @return The response the range demands.
+ */
+http_range_result_t http_cond_range(httpd_req_t *req, const char *etag, time_t last_modified, size_t size,
+                                    size_t *start, size_t *len);
+
+#ifdef HTTP_COND_IMPLEMENTATION
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const http_date_wkdays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *const http_date_months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                               "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static inline bool http_cond_is_ows(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Splits W/"opaque" into its opaque part; returns false on malformed tags
+static bool http_etag_split(const char *s, size_t len, const char **opaque, size_t *opaque_len, bool *is_weak) {
+    *is_weak = false;
+    if (len >= 2 && s[0] == 'W' && s[1] == '/') {
+        *is_weak = true;
+        s += 2;
+        len -= 2;
+    }
+
+    if (unlikely(len < 2 || s[0] != '"' || s[len - 1] != '"')) {
+        return false;
+    }
+
+    *opaque = s + 1;
+    *opaque_len = len - 2;
+    return true;
+}
+
+bool http_etag_list_match(const char *list, const char *etag, bool weak) {
+    if (unlikely(!list)) {
+        return false;
+    }
+
+    // Without a current representation nothing can match
+    const char *own = NULL;
+    size_t own_len = 0;
+    bool own_weak = false;
+    if (etag && unlikely(!http_etag_split(etag, strlen(etag), &own, &own_len, &own_weak))) {
+        return false;
+    }
+
+    const char *p = list;
+    while (*p) {
+        while (http_cond_is_ows(*p) || *p == ',') {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+
+        if (*p == '*') {
+            return own != NULL;
+        }
+
+        // An entity tag ends at its closing quote, commas inside the opaque part are allowed
+        const char *start = p;
+        if (p[0] == 'W' && p[1] == '/') {
+            p += 2;
+        }
+        if (*p != '"') {
+            while (*p && *p != ',') {
+                p++;
+            }
+            continue;
+        }
+        const char *close = strchr(p + 1, '"');
+        if (!close) {
+            return false;
+        }
+        p = close + 1;
+
+        const char *other;
+        size_t other_len;
+        bool other_weak;
+        if (!http_etag_split(start, p - start, &other, &other_len, &other_weak)) {
+            continue;
+        }
+
+        if (!own || (!weak && (own_weak || other_weak))) {
+            continue;
+        }
+
+        if (other_len == own_len && memcmp(other, own, own_len) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+time_t http_date_from_civil(int year, int month, int day, int hour, int min, int sec) {
+    // Howard Hinnant's days_from_civil
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yoe = (unsigned)(year - era * 400);
+    const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const long long days = (long long)era * 146097 + (long long)doe - 719468;
+
+    return (time_t)(days * 86400 + hour * 3600 + min * 60 + sec);
+}
+
+esp_err_t http_date_format(time_t t, char *buf, size_t len) {
+    if (unlikely(!buf)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct tm tm;
+    if (unlikely(!gmtime_r(&t, &tm))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int written = snprintf(buf, len, "%s, %02d %s %04d %02d:%02d:%02d GMT", http_date_wkdays[tm.tm_wday], tm.tm_mday,
+                           http_date_months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+    if (unlikely(written < 0 || (size_t)written >= len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return ESP_OK;
+}
+
+static int http_date_month(const char *name) {
+    for (int i = 0; i < 12; i++) {
+        if (strcmp(name, http_date_months[i]) == 0) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+esp_err_t http_date_parse(const char *s, time_t *out) {
+    if (unlikely(!s || !out)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char mon[4] = {0};
+    int day, year, hour, min, sec;
+
+    if (sscanf(s, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, mon, &year, &hour, &min, &sec) == 6) {
+        // IMF-fixdate
+    } else if (sscanf(s, "%*[A-Za-z], %2d-%3s-%2d %2d:%2d:%2d GMT", &day, mon, &year, &hour, &min, &sec) == 6) {
+        // RFC 850, two digit years from 70 on belong to the previous century
+        year += year >= 70 ? 1900 : 2000;
+    } else if (sscanf(s, "%*3s %3s %2d %2d:%2d:%2d %4d", mon, &day, &hour, &min, &sec, &year) == 6) {
+        // asctime
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const int month = http_date_month(mon);
+    if (unlikely(month == 0 || day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *out = http_date_from_civil(year, month, day, hour, min, sec);
+    return ESP_OK;
+}
+
+// Reads a header into buf, a missing, empty or oversized header reads as absent
+static bool http_cond_get_hdr(httpd_req_t *req, const char *field, char *buf, size_t len) {
+    size_t value_len = httpd_req_get_hdr_value_len(req, field);
+    if (value_len == 0 || value_len >= len) {
+        return false;
+    }
+
+    return httpd_req_get_hdr_value_str(req, field, buf, len) == ESP_OK;
+}
+
+http_cond_result_t http_cond_evaluate(httpd_req_t *req, const char *etag, time_t last_modified) {
+    char value[HTTP_COND_HDR_MAX];
+    time_t date;
+
+    // 1. If-Match, strong comparison
+    if (http_cond_get_hdr(req, "If-Match", value, sizeof(value))) {
+        if (!http_etag_list_match(value, etag, false)) {
+            return HTTP_COND_PRECONDITION_FAILED;
+        }
+    } else if (last_modified && http_cond_get_hdr(req, "If-Unmodified-Since", value, sizeof(value)) &&
+               http_date_parse(value, &date) == ESP_OK) {
+        // 2. If-Unmodified-Since, only without If-Match
+        if (last_modified > date) {
+            return HTTP_COND_PRECONDITION_FAILED;
+        }
+    }
+
+    const bool safe = req->method == HTTP_GET || req->method == HTTP_HEAD;
+
+    // 3. If-None-Match, weak comparison
+    if (http_cond_get_hdr(req, "If-None-Match", value, sizeof(value))) {
+        if (http_etag_list_match(value, etag, true)) {
+            return safe ? HTTP_COND_NOT_MODIFIED : HTTP_COND_PRECONDITION_FAILED;
+        }
+        return HTTP_COND_NONE;
+    }
+
+    // 4. If-Modified-Since, only without If-None-Match
+    if (safe && last_modified && http_cond_get_hdr(req, "If-Modified-Since", value, sizeof(value)) &&
+        http_date_parse(value, &date) == ESP_OK) {
+        if (last_modified <= date) {
+            return HTTP_COND_NOT_MODIFIED;
+        }
+    }
+
+    return HTTP_COND_NONE;
+}
+
+// Parses a decimal position, rejecting empty input and overflow
+static bool http_range_pos(const char **p, size_t *out) {
+    const char *s = *p;
+    size_t v = 0;
+
+    if (*s < '0' || *s > '9') {
+        return false;
+    }
+
+    for (; *s >= '0' && *s <= '9'; s++) {
+        if (v > (SIZE_MAX - 9) / 10) {
+            return false;
+        }
+        v = v * 10 + (*s - '0');
+    }
+
+    *p = s;
+    *out = v;
+    return true;
+}
+
+http_range_result_t http_range_parse(const char *value, size_t size, size_t *start, size_t *len) {
+    if (unlikely(!value || !start || !len)) {
+        return HTTP_RANGE_NONE;
+    }
+
+    if (strncmp(value, "bytes=", 6) != 0 || strchr(value, ',')) {
+        return HTTP_RANGE_NONE;
+    }
+
+    const char *p = value + 6;
+    while (http_cond_is_ows(*p)) {
+        p++;
+    }
+
+    size_t first, last;
+    if (*p == '-') {
+        // suffix-range: the last N bytes
+        p++;
+        if (!http_range_pos(&p, &last)) {
+            return HTTP_RANGE_NONE;
+        }
+        if (last == 0 || size == 0) {
+            return HTTP_RANGE_UNSATISFIABLE;
+        }
+        first = last >= size ? 0 : size - last;
+        last = size - 1;
+    } else {
+        if (!http_range_pos(&p, &first) || *p++ != '-') {
+            return HTTP_RANGE_NONE;
+        }
+        if (*p >= '0' && *p <= '9') {
+            if (!http_range_pos(&p, &last) || last < first) {
+                return HTTP_RANGE_NONE;
+            }
+        } else {
+            last = SIZE_MAX;
+        }
+        if (first >= size) {
+            return HTTP_RANGE_UNSATISFIABLE;
+        }
+        if (last >= size) {
+            last = size - 1;
+        }
+    }
+
+    while (http_cond_is_ows(*p)) {
+        p++;
+    }
+    if (*p) {
+        return HTTP_RANGE_NONE;
+    }
+
+    *start = first;
+    *len = last - first + 1;
+    return HTTP_RANGE_PARTIAL;
+}
+
+// If-Range holds either a strong entity tag or the exact Last-Modified date
+static bool http_cond_if_range(const char *value, const char *etag, time_t last_modified) {
+    if (value[0] == '"' || (value[0] == 'W' && value[1] == '/')) {
+        return etag && http_etag_list_match(value, etag, false) && !strchr(value, ',');
+    }
+
+    time_t date;
+    return last_modified && http_date_parse(value, &date) == ESP_OK && date == last_modified;
+}
+
+http_range_result_t http_cond_range(httpd_req_t *req, const char *etag, time_t last_modified, size_t size,
+                                    size_t *start, size_t *len) {
+    char value[HTTP_COND_HDR_MAX];
+
+    if (req->method != HTTP_GET && req->method != HTTP_HEAD) {
+        return HTTP_RANGE_NONE;
+    }
+
+    if (!http_cond_get_hdr(req, "Range", value, sizeof(value))) {
+        return HTTP_RANGE_NONE;
+    }
+
+    // Range is a hint: when the validator does not match, the client gets the whole new representation
+    const size_t if_range_len = httpd_req_get_hdr_value_len(req, "If-Range");
+    if (if_range_len) {
+        char if_range[HTTP_COND_HDR_MAX];
+        if (!http_cond_get_hdr(req, "If-Range", if_range, sizeof(if_range)) ||
+            !http_cond_if_range(if_range, etag, last_modified)) {
+            return HTTP_RANGE_NONE;
+        }
+    }
+
+    return http_range_parse(value, size, start, len);
+}
+
+esp_err_t http_cond_send(httpd_req_t *req, http_cond_result_t cond) {
+    if (cond != HTTP_COND_PRECONDITION_FAILED) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    httpd_resp_set_status(req, "412 Precondition Failed");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+#endif /* HTTP_COND_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HTTP_COND_H_ */
@@ -0,0 +1,233 @@
+/**
+ * @file http_stream.h
+ * @brief Chunked response writer with optional on-the-fly gzip
+ *
+ * Buffers a response body of unknown length in a fixed chunk buffer and
+ * sends it with httpd_resp_send_chunk() whenever the buffer fills up. The
+ * decision whether to compress is taken before the first byte goes out:
+ * if the client accepts gzip and the body outgrows the threshold, the
+ * headers announce gzip and everything passes through the encoder. A body
+ * that ends within the first chunk is sent in one piece with a
+ * Content-Length instead.
+ *
+ * Example usage:
+ * @code
+ *     http_stream_begin(&stream, req, accepts_gzip ? &gz : NULL, threshold);
+ *     http_stream_write(&stream, data, len);
+ *     http_stream_end(&stream);
+ * @endcode
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _HTTP_STREAM_H_
+#define _HTTP_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "gzip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Size of the chunk buffer.
+ */
+#ifndef HTTP_STREAM_CHUNK_LEN
+#define HTTP_STREAM_CHUNK_LEN 1024
+#endif
+
+/**
+ * @brief Stream state. Treat as opaque apart from the statistics.
+ */
+typedef struct {
+    httpd_req_t *req;
+    gzip_t *gz;
+    size_t threshold;
+    bool started;
+    bool compressed;
+    esp_err_t err;
+    size_t len;
+    size_t raw_bytes;  /*!< body bytes written by the handler */
+    size_t wire_bytes; /*!< body bytes sent, after compression */
+    int64_t gzip_us;   /*!< time spent in the encoder */
+    uint8_t buf[HTTP_STREAM_CHUNK_LEN];
+} http_stream_t;
+
+/**
+ * @brief Starts a response body. Status, type and headers must be set before.
+ *
+ * @param s Stream state.
+ * @param req Request.
+ * @param gz Encoder to use when the body outgrows the threshold, NULL to never compress.
+ * @param threshold Body size above which the body is compressed, at most HTTP_STREAM_CHUNK_LEN.
+ * @return ESP_OK on success,
+ *         ESP_ERR_INVALID_ARG if s or req is NULL or the threshold is too large.
+ */
+esp_err_t http_stream_begin(http_stream_t *s, httpd_req_t *req, gzip_t *gz, size_t threshold);
+
+/**
+ * @brief Appends body data.
+ *
+ * @param s Stream state.
+ * @param data Data.
+ * @param len Size of the data.
+ * @return ESP_OK on success, or the first send error.
+ */
+esp_err_t http_stream_write(http_stream_t *s, const void *data, size_t len);
+
+/**
+ * @brief Flushes the remaining data and terminates the response.
+ *
+ * @param s Stream state.
+ * @return ESP_OK on success, or the first send error.
+ */
+esp_err_t http_stream_end(http_stream_t *s);
+
+#ifdef HTTP_STREAM_IMPLEMENTATION
+
+#include <string.h>
+
+#include "esp_timer.h"
+
+static esp_err_t http_stream_send_chunk(void *ctx, const uint8_t *buf, size_t len) {
+    http_stream_t *s = ctx;
+    s->wire_bytes += len;
+    return httpd_resp_send_chunk(s->req, (const char *)buf, len);
+}
+
+static void http_stream_gzip(http_stream_t *s, const uint8_t *data, size_t len, bool finish) {
+    const int64_t start = esp_timer_get_time();
+
+    if (len) {
+        s->err = gzip_write(s->gz, data, len);
+    }
+    if (finish && s->err == ESP_OK) {
+        s->err = gzip_finish(s->gz);
+    }
+
+    s->gzip_us += esp_timer_get_time() - start;
+}
+
+// Commits to plain or compressed output with the first chunk
+static void http_stream_start(http_stream_t *s) {
+    s->started = true;
+
+    if (s->gz && s->len > s->threshold) {
+        s->compressed = true;
+        httpd_resp_set_hdr(s->req, "Content-Encoding", "gzip");
+
+        const int64_t start = esp_timer_get_time();
+        s->err = gzip_begin(s->gz, http_stream_send_chunk, s);
+        s->gzip_us += esp_timer_get_time() - start;
+        if (s->err == ESP_OK) {
+            http_stream_gzip(s, s->buf, s->len, false);
+        }
+    } else {
+        s->err = http_stream_send_chunk(s, s->buf, s->len);
+    }
+
+    s->len = 0;
+}
+
+esp_err_t http_stream_begin(http_stream_t *s, httpd_req_t *req, gzip_t *gz, size_t threshold) {
+    if (unlikely(!s || !req || threshold > HTTP_STREAM_CHUNK_LEN)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s->req = req;
+    s->gz = gz;
+    s->threshold = threshold;
+    s->started = false;
+    s->compressed = false;
+    s->err = ESP_OK;
+    s->len = 0;
+    s->raw_bytes = 0;
+    s->wire_bytes = 0;
+    s->gzip_us = 0;
+
+    if (gz) {
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t http_stream_write(http_stream_t *s, const void *data, size_t len) {
+    const uint8_t *p = data;
+    s->raw_bytes += len;
+
+    if (s->compressed) {
+        http_stream_gzip(s, p, len, false);
+        return s->err;
+    }
+
+    while (len && s->err == ESP_OK) {
+        if (s->len == sizeof(s->buf)) {
+            if (!s->started) {
+                http_stream_start(s);
+                if (s->compressed) {
+                    http_stream_gzip(s, p, len, false);
+                    return s->err;
+                }
+            } else {
+                s->err = http_stream_send_chunk(s, s->buf, s->len);
+                s->len = 0;
+            }
+            continue;
+        }
+
+        size_t n = sizeof(s->buf) - s->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s->buf + s->len, p, n);
+        s->len += n;
+        p += n;
+        len -= n;
+    }
+
+    return s->err;
+}
+
+esp_err_t http_stream_end(http_stream_t *s) {
+    if (s->err != ESP_OK) {
+        return s->err;
+    }
+
+    if (!s->started) {
+        if (!(s->gz && s->len > s->threshold)) {
+            // Small enough for a single send with Content-Length
+            s->started = true;
+            s->wire_bytes = s->len;
+            return httpd_resp_send(s->req, (const char *)s->buf, s->len);
+        }
+        http_stream_start(s);
+    }
+
+    if (s->compressed) {
+        http_stream_gzip(s, NULL, 0, true);
+    } else if (s->len && s->err == ESP_OK) {
+        s->err = http_stream_send_chunk(s, s->buf, s->len);
+        s->len = 0;
+    }
+
+    if (s->err != ESP_OK) {
+        return s->err;
+    }
+
+    return httpd_resp_send_chunk(s->req, NULL, 0);
+}
+
+#endif /* HTTP_STREAM_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HTTP_STREAM_H_ */
@@ -0,0 +1,281 @@
+/**
+ * @file json.h
+ * @brief Zero-allocation streaming JSON writer
+ *
+ * Serializes values straight into a write callback, typically an
+ * http_stream_t whose chunk buffer is flushed with httpd_resp_send_chunk()
+ * whenever it fills up, so no document is assembled in memory and the RAM
+ * needed does not depend on the response size. Separators are tracked per
+ * nesting level, the caller only emits keys and values in order.
+ *
+ * Errors are sticky: once a write fails every further call is a no-op
+ * returning the same error.
+ *
+ * Example usage:
+ * @code
+ *     json_writer_t w;
+ *     json_writer_init(&w, write_fn, ctx);
+ *     json_obj_begin(&w);
+ *     json_key(&w, "led");
+ *     json_bool(&w, true);
+ *     json_obj_end(&w);
+ *     if (w.err != ESP_OK) { ... }
+ * @endcode
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _JSON_H_
+#define _JSON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Deepest nesting of objects and arrays.
+ */
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH 8
+#endif
+
+/**
+ * @brief Output callback of the writer.
+ *
+ * @return ESP_OK to continue, any other value stops the writer.
+ */
+typedef esp_err_t (*json_write_fn_t)(void *ctx, const void *buf, size_t len);
+
+/**
+ * @brief Writer state. Treat as opaque apart from err.
+ */
+typedef struct {
+    json_write_fn_t write;
+    void *ctx;
+    esp_err_t err; /*!< first error */
+    uint8_t depth;
+    bool after_key;
+    bool has_items[JSON_MAX_DEPTH + 1];
+} json_writer_t;
+
+void json_writer_init(json_writer_t *w, json_write_fn_t write, void *ctx);
+
+esp_err_t json_obj_begin(json_writer_t *w);
+esp_err_t json_obj_end(json_writer_t *w);
+esp_err_t json_arr_begin(json_writer_t *w);
+esp_err_t json_arr_end(json_writer_t *w);
+
+/**
+ * @brief Writes an object key, the next call writes its value.
+ */
+esp_err_t json_key(json_writer_t *w, const char *key);
+
+esp_err_t json_str(json_writer_t *w, const char *s);
+esp_err_t json_str_n(json_writer_t *w, const char *s, size_t len);
+
+/**
+ * @brief Writes a string in pieces: json_str_begin(), any number of json_str_append(), json_str_end().
+ */
+esp_err_t json_str_begin(json_writer_t *w);
+esp_err_t json_str_append(json_writer_t *w, const char *s, size_t len);
+esp_err_t json_str_end(json_writer_t *w);
+
+esp_err_t json_int(json_writer_t *w, int64_t value);
+esp_err_t json_uint(json_writer_t *w, uint64_t value);
+
+/**
+ * @brief Writes a number with up to precision significant digits, null for NaN and infinities.
+ */
+esp_err_t json_double(json_writer_t *w, double value, int precision);
+
+esp_err_t json_bool(json_writer_t *w, bool value);
+esp_err_t json_null(json_writer_t *w);
+
+#ifdef JSON_IMPLEMENTATION
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static esp_err_t json_write(json_writer_t *w, const void *buf, size_t len) {
+    if (w->err == ESP_OK && len) {
+        w->err = w->write(w->ctx, buf, len);
+    }
+    return w->err;
+}
+
+// Comma before every item but the first of its container, none between a key and its value
+static esp_err_t json_separate(json_writer_t *w) {
+    if (w->after_key) {
+        w->after_key = false;
+        return w->err;
+    }
+    if (w->has_items[w->depth]) {
+        json_write(w, ",", 1);
+    }
+    w->has_items[w->depth] = true;
+    return w->err;
+}
+
+static esp_err_t json_open(json_writer_t *w, char c) {
+    json_separate(w);
+    if (w->err == ESP_OK && w->depth >= JSON_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_STATE;
+    }
+    if (json_write(w, &c, 1) == ESP_OK) {
+        w->has_items[++w->depth] = false;
+    }
+    return w->err;
+}
+
+static esp_err_t json_close(json_writer_t *w, char c) {
+    if (w->err == ESP_OK && w->depth == 0) {
+        w->err = ESP_ERR_INVALID_STATE;
+    }
+    if (json_write(w, &c, 1) == ESP_OK) {
+        w->depth--;
+    }
+    return w->err;
+}
+
+void json_writer_init(json_writer_t *w, json_write_fn_t write, void *ctx) {
+    w->write = write;
+    w->ctx = ctx;
+    w->err = write ? ESP_OK : ESP_ERR_INVALID_ARG;
+    w->depth = 0;
+    w->after_key = false;
+    w->has_items[0] = false;
+}
+
+esp_err_t json_obj_begin(json_writer_t *w) {
+    return json_open(w, '{');
+}
+
+esp_err_t json_obj_end(json_writer_t *w) {
+    return json_close(w, '}');
+}
+
+esp_err_t json_arr_begin(json_writer_t *w) {
+    return json_open(w, '[');
+}
+
+esp_err_t json_arr_end(json_writer_t *w) {
+    return json_close(w, ']');
+}
+
+esp_err_t json_str_begin(json_writer_t *w) {
+    json_separate(w);
+    return json_write(w, "\"", 1);
+}
+
+// Runs of plain characters are written as is, everything else escaped. "<" is escaped too, so the
+// output can be embedded in a <script> element.
+esp_err_t json_str_append(json_writer_t *w, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+
+    for (size_t i = 0; i < len && w->err == ESP_OK; i++) {
+        const unsigned char c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\' && c != '<') {
+            continue;
+        }
+
+        json_write(w, s + run, i - run);
+        run = i + 1;
+
+        char esc[6] = {'\\', 0};
+        size_t esc_len = 2;
+        switch (c) {
+        case '"':
+        case '\\':
+            esc[1] = c;
+            break;
+        case '\n':
+            esc[1] = 'n';
+            break;
+        case '\r':
+            esc[1] = 'r';
+            break;
+        case '\t':
+            esc[1] = 't';
+            break;
+        default:
+            memcpy(esc + 1, "u00", 3);
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xf];
+            esc_len = 6;
+            break;
+        }
+        json_write(w, esc, esc_len);
+    }
+
+    return json_write(w, s + run, len - run);
+}
+
+esp_err_t json_str_end(json_writer_t *w) {
+    return json_write(w, "\"", 1);
+}
+
+esp_err_t json_str_n(json_writer_t *w, const char *s, size_t len) {
+    json_str_begin(w);
+    json_str_append(w, s, len);
+    return json_str_end(w);
+}
+
+esp_err_t json_str(json_writer_t *w, const char *s) {
+    return s ? json_str_n(w, s, strlen(s)) : json_null(w);
+}
+
+esp_err_t json_key(json_writer_t *w, const char *key) {
+    json_str(w, key);
+    json_write(w, ":", 1);
+    w->after_key = true;
+    return w->err;
+}
+
+esp_err_t json_int(json_writer_t *w, int64_t value) {
+    char buf[24];
+    json_separate(w);
+    return json_write(w, buf, snprintf(buf, sizeof(buf), "%" PRId64, value));
+}
+
+esp_err_t json_uint(json_writer_t *w, uint64_t value) {
+    char buf[24];
+    json_separate(w);
+    return json_write(w, buf, snprintf(buf, sizeof(buf), "%" PRIu64, value));
+}
+
+esp_err_t json_double(json_writer_t *w, double value, int precision) {
+    if (!isfinite(value)) {
+        return json_null(w);
+    }
+
+    char buf[32];
+    json_separate(w);
+    return json_write(w, buf, snprintf(buf, sizeof(buf), "%.*g", precision, value));
+}
+
+esp_err_t json_bool(json_writer_t *w, bool value) {
+    json_separate(w);
+    return value ? json_write(w, "true", 4) : json_write(w, "false", 5);
+}
+
+esp_err_t json_null(json_writer_t *w) {
+    json_separate(w);
+    return json_write(w, "null", 4);
+}
+
+#endif /* JSON_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _JSON_H_ */
@@ -0,0 +1,45 @@
+/**
+ * @file mac_equal.h
+ * @brief Constant-time comparison of message authentication codes
+ *
+ * Every byte is compared whatever the outcome, so the time a check takes
+ * does not tell an attacker how many leading bytes of a forged MAC were
+ * right. Used by udp_cmd.h and http_auth.h.
+ *
+ * Example usage:
+ * @code
+ *     if (!mac_equal(computed, received, sizeof(computed))) {
+ *         return ESP_ERR_INVALID_CRC;
+ *     }
+ * @endcode
+ *
+ * @version 0.0.1
+ */
+
+#ifndef _MAC_EQUAL_H_
+#define _MAC_EQUAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Compares two MACs of len bytes in time that depends on len only.
+ */
+static inline bool mac_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MAC_EQUAL_H_ */
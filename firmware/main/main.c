@@ -1,3 +1,6 @@
+#include <errno.h>
+#include <math.h>
+
 #include "driver/gpio.h"
 #include "err.h"
 #include "esp_app_desc.h"
@@ -5,17 +8,34 @@
 #include "esp_event.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
-#include "esp_mac.h"
-#include "esp_wifi.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "mdns.h"
+#include "nvs.h"
 #include "nvs_flash.h"
+#include "web_assets.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_mac.h"
+#include "esp_wifi.h"
+#endif
+
+#if CONFIG_HTTPD_NET_OPENETH
+#include "esp_eth.h"
+#endif
+
+#if CONFIG_HTTPD_ASSET_READ_BENCH
+#include "esp_flash.h"
+#include "spi_flash_mmap.h"
+#endif
 
 #define LED_PIN GPIO_NUM_8
 #define LED_BLINK_INTERVAL pdMS_TO_TICKS(512)
 
-#define WAIT_STA_GOT_IP_MAX pdMS_TO_TICKS(10000) // TODO: make configurable
+#define WAIT_GOT_IP_MAX pdMS_TO_TICKS(10000) // TODO: make configurable
 
 #define GPIO_OUTPUT_PIN_SEL ((1ULL << LED_PIN))
 
@@ -24,16 +44,222 @@ static const char *TAG = "httpd_poc";
 #define CLOSER_IMPLEMENTATION
 #include "closer.h"
 
+#define HTTP_COND_IMPLEMENTATION
+#include "http_cond.h"
+
+#define HTTP_ACCEPT_IMPLEMENTATION
+#include "http_accept.h"
+
+#define RESP_HEAD_IMPLEMENTATION
+#include "resp_head.h"
+
+#define APP_ETAG_IMPLEMENTATION
+#include "app_etag.h"
+
+// Identity fallback and OTA deltas both inflate
+#if CONFIG_HTTPD_IDENTITY_FALLBACK || CONFIG_HTTPD_OTA
+#define GUNZIP_IMPLEMENTATION
+#include "gunzip.h"
+#endif
+
+#define GZIP_IMPLEMENTATION
+#include "gzip.h"
+
+#define HTTP_STREAM_CHUNK_LEN CONFIG_HTTPD_STREAM_CHUNK_LEN
+#define HTTP_STREAM_IMPLEMENTATION
+#include "http_stream.h"
+
+#define HIST_IMPLEMENTATION
+#include "hist.h"
+
+#define CBOR_IMPLEMENTATION
+#include "cbor.h"
+
+#define JSON_IMPLEMENTATION
+#include "json.h"
+
+#if CONFIG_HTTPD_SCHED
+#include <sys/time.h>
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#include "esp_netif_sntp.h"
+#endif
+
+#define CMD_SCHED_IMPLEMENTATION
+#include "cmd_sched.h"
+#endif
+
+// Requests that change the device are signed, see http_auth.h
+#if CONFIG_HTTPD_CONFIG_WRITE || CONFIG_HTTPD_OTA
+#define HTTP_AUTH_IMPLEMENTATION
+#include "http_auth.h"
+#include "mbedtls/sha256.h"
+#endif
+
+#if CONFIG_HTTPD_OTA
+#include "esp_ota_ops.h"
+
+#define OTA_STREAM_BUF_LEN CONFIG_HTTPD_OTA_BUF_LEN
+#define OTA_STREAM_IMPLEMENTATION
+#include "ota_stream.h"
+
+#define OTA_DELTA_IMPLEMENTATION
+#include "ota_delta.h"
+#endif
+
+#if CONFIG_HTTPD_RECORD
+#include <sys/socket.h>
+#endif
+
+#if CONFIG_HTTPD_UDP_CMD
+#include "lwip/sockets.h"
+
+#define UDP_CMD_IMPLEMENTATION
+#include "udp_cmd.h"
+#endif
+
 static closer_handle_t s_closer = NULL;
 #define DEFER(fn) CLOSER_DEFER(s_closer, (void *)fn)
 
-static esp_netif_t *s_sta_netif = NULL;
-static httpd_handle_t s_server = NULL;
-
+#if !CONFIG_IDF_TARGET_LINUX
+static esp_netif_t *s_netif = NULL; // the interface the server is reached through
 static TaskHandle_t xTaskToNotify = NULL;
+#endif
+
+static httpd_handle_t s_server = NULL;
 
-#define ETAG_LEN 24
-static char s_etag[ETAG_LEN];
+static char s_etag[APP_ETAG_LEN];
+
+#if CONFIG_HTTPD_STREAM_GZIP
+_Static_assert(CONFIG_HTTPD_STREAM_GZIP_THRESHOLD <= CONFIG_HTTPD_STREAM_CHUNK_LEN,
+               "gzip threshold must fit in the first chunk");
+#endif
+
+// Dynamic response bodies share one stream, all handlers run on the httpd task
+static http_stream_t s_stream;
+#if CONFIG_HTTPD_STREAM_GZIP
+static gzip_t s_gzip;
+#endif
+
+// Latencies reported by the web UI, see web/src/rum.js
+typedef enum {
+    RUM_TTFB,     // navigation request start to first response byte
+    RUM_LOAD,     // navigation start to the end of the load event
+    RUM_RESOURCE, // subresource fetches
+    RUM_API,      // API round trips
+    RUM_MAX,
+} rum_metric_t;
+
+static const char *const rum_names[RUM_MAX] = {"ttfb", "load", "resource", "api"};
+
+typedef struct {
+    uint32_t gzip_responses;
+    uint64_t gzip_raw_bytes;
+    uint64_t gzip_wire_bytes;
+    int64_t gzip_us;
+    uint32_t rum_reports;
+    hist_t rum[RUM_MAX]; // microseconds
+} metrics_t;
+
+static metrics_t s_metrics = {0};
+
+static bool s_led_on = false;
+
+#define NVS_NAMESPACE "httpd"
+
+// Runtime configuration, loaded from NVS once at boot over the Kconfig defaults. Every field is stored under
+// its own key, which is also its name in /api/config.
+typedef struct {
+    char wifi_ssid[33];
+    char wifi_password[65];
+    char mdns_name[33];
+    uint16_t http_port;
+    uint16_t max_sockets;
+    uint16_t recv_timeout; // seconds
+    uint16_t send_timeout; // seconds
+    uint32_t stack_size;
+    uint16_t task_priority;
+    bool keep_alive;
+    bool lru_purge;
+} app_config_t;
+
+static app_config_t s_config = {
+    .wifi_ssid = CONFIG_HTTPD_WIFI_SSID,
+    .wifi_password = CONFIG_HTTPD_WIFI_PASSWORD,
+    .mdns_name = CONFIG_HTTPD_MDNS_NAME,
+    .http_port = CONFIG_HTTPD_HTTP_PORT,
+    .max_sockets = 4,
+    .recv_timeout = 10,
+    .send_timeout = 10,
+    .stack_size = 6144,
+    .task_priority = tskIDLE_PRIORITY + 3,
+    .keep_alive = true,
+    .lru_purge = true,
+};
+
+typedef enum {
+    CFG_STR,
+    CFG_U16,
+    CFG_U32,
+    CFG_BOOL,
+} cfg_type_t;
+
+// What a change takes effect with
+typedef enum {
+    CFG_APPLY_SERVER = 1 << 0, // restart of s_server only
+    CFG_APPLY_MDNS = 1 << 1,   // new hostname
+    CFG_APPLY_REBOOT = 1 << 2, // next boot, WiFi is not dropped under the client
+} cfg_apply_t;
+
+typedef struct {
+    const char *key; // NVS keys are at most 15 characters
+    cfg_type_t type;
+    size_t offset;
+    size_t size;
+    uint32_t min;
+    uint32_t max;
+    uint8_t apply;
+    bool secret;         // never reported
+    const char *charset; // of strings, NULL for any
+} cfg_field_t;
+
+#define CFG_HOSTNAME_CHARS "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-"
+
+#define CFG_FIELD(name, t, lo, hi, a, s, chars)                                                                        \
+    {.key = #name,                                                                                                     \
+     .type = t,                                                                                                        \
+     .offset = offsetof(app_config_t, name),                                                                           \
+     .size = sizeof(((app_config_t *)0)->name),                                                                        \
+     .min = lo,                                                                                                        \
+     .max = hi,                                                                                                        \
+     .apply = a,                                                                                                       \
+     .secret = s,                                                                                                      \
+     .charset = chars}
+
+static const cfg_field_t cfg_fields[] = {
+    CFG_FIELD(wifi_ssid, CFG_STR, 1, 32, CFG_APPLY_REBOOT, false, NULL),
+    CFG_FIELD(wifi_password, CFG_STR, 0, 64, CFG_APPLY_REBOOT, true, NULL),
+    CFG_FIELD(mdns_name, CFG_STR, 1, 32, CFG_APPLY_MDNS, false, CFG_HOSTNAME_CHARS),
+    CFG_FIELD(http_port, CFG_U16, 1, 65535, CFG_APPLY_SERVER | CFG_APPLY_MDNS, false, NULL),
+    CFG_FIELD(max_sockets, CFG_U16, 1, CONFIG_LWIP_MAX_SOCKETS - 3, CFG_APPLY_SERVER, false, NULL),
+    CFG_FIELD(recv_timeout, CFG_U16, 1, 300, CFG_APPLY_SERVER, false, NULL),
+    CFG_FIELD(send_timeout, CFG_U16, 1, 300, CFG_APPLY_SERVER, false, NULL),
+    CFG_FIELD(stack_size, CFG_U32, 4096, 32768, CFG_APPLY_SERVER, false, NULL),
+    CFG_FIELD(task_priority, CFG_U16, 1, configMAX_PRIORITIES - 1, CFG_APPLY_SERVER, false, NULL),
+    CFG_FIELD(keep_alive, CFG_BOOL, 0, 1, CFG_APPLY_SERVER, false, NULL),
+    CFG_FIELD(lru_purge, CFG_BOOL, 0, 1, CFG_APPLY_SERVER, false, NULL),
+};
+
+#define CFG_FIELDS_COUNT (sizeof(cfg_fields) / sizeof(cfg_fields[0]))
+
+static bool s_config_reboot_pending = false;
+#if CONFIG_HTTPD_CONFIG_WRITE
+static TaskHandle_t s_server_restart_task = NULL;
+#endif
+
+static time_t s_last_modified = 0;
+static char s_last_modified_str[HTTP_DATE_LEN];
 
 static esp_err_t gpio_init() {
     gpio_config_t io_conf = {};
@@ -45,8 +271,109 @@ static esp_err_t gpio_init() {
     return gpio_config(&io_conf);
 }
 
+#if CONFIG_HTTPD_LED_PERSIST
+#define LED_STORE_KEY "led"
+
+// The LED state survives resets. Changes only wake the store task, which commits at most once per interval,
+// so toggling neither wears the flash nor stalls a request on nvs_commit().
+static nvs_handle_t s_led_nvs = 0;
+static TaskHandle_t s_led_store_task = NULL;
+static SemaphoreHandle_t s_led_store_lock = NULL;
+static StaticSemaphore_t s_led_store_lock_buf;
+static int s_led_stored = -1; // state in flash, -1 if none
+
+static esp_err_t led_store_commit() {
+    const bool on = s_led_on;
+    if (s_led_stored == on) {
+        return ESP_OK;
+    }
+
+    ESP_RETURN_ON_ERROR(nvs_set_u8(s_led_nvs, LED_STORE_KEY, on), TAG, "nvs_set_u8 failed");
+    ESP_RETURN_ON_ERROR(nvs_commit(s_led_nvs), TAG, "nvs_commit failed");
+    s_led_stored = on;
+    return ESP_OK;
+}
+
+// Wakes on the first change and sleeps out the interval, every change within it goes into one commit
+static void led_store_task(void *arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_HTTPD_LED_PERSIST_INTERVAL_MS));
+
+        xSemaphoreTake(s_led_store_lock, portMAX_DELAY);
+        led_store_commit();
+        xSemaphoreGive(s_led_store_lock);
+    }
+}
+
+// esp_restart(), e.g. after an update, must not lose a pending change
+static void led_store_flush() {
+    xSemaphoreTake(s_led_store_lock, portMAX_DELAY);
+    led_store_commit();
+    xSemaphoreGive(s_led_store_lock);
+}
+
+static void led_store_stop() {
+    esp_unregister_shutdown_handler(led_store_flush);
+
+    // Holding the lock, the task is never deleted halfway through a commit
+    xSemaphoreTake(s_led_store_lock, portMAX_DELAY);
+    vTaskDelete(s_led_store_task);
+    s_led_store_task = NULL;
+    led_store_commit();
+    xSemaphoreGive(s_led_store_lock);
+
+    nvs_close(s_led_nvs);
+}
+#endif // CONFIG_HTTPD_LED_PERSIST
+
+// The one path to the LED for every transport, the LED is active low
+static esp_err_t led_set(bool on) {
+    ESP_RETURN_ON_ERROR(gpio_set_level(LED_PIN, on ? 0 : 1), TAG, "gpio_set_level failed");
+    s_led_on = on;
+
+#if CONFIG_HTTPD_LED_PERSIST
+    if (s_led_store_task) {
+        xTaskNotifyGive(s_led_store_task);
+    }
+#endif
+
+    return ESP_OK;
+}
+
+#if CONFIG_HTTPD_LED_PERSIST
+// Runs before WiFi, so the LED is back in its last state right after reset
+static esp_err_t led_store_start() {
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &s_led_nvs), TAG, "nvs_open failed");
+
+    uint8_t on = 0;
+    esp_err_t err = nvs_get_u8(s_led_nvs, LED_STORE_KEY, &on);
+    if (unlikely(err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)) {
+        nvs_close(s_led_nvs);
+        return err;
+    }
+    s_led_stored = err == ESP_OK ? on : -1;
+
+    err = led_set(on);
+    if (unlikely(err != ESP_OK)) {
+        nvs_close(s_led_nvs);
+        return err;
+    }
+    ESP_LOGI(TAG, "LED restored: %s", on ? "on" : "off");
+
+    s_led_store_lock = xSemaphoreCreateMutexStatic(&s_led_store_lock_buf);
+    if (xTaskCreate(led_store_task, "led_store", 2560, NULL, tskIDLE_PRIORITY + 1, &s_led_store_task) != pdPASS) {
+        nvs_close(s_led_nvs);
+        return ESP_ERR_NO_MEM;
+    }
+    DEFER(led_store_stop);
+
+    return esp_register_shutdown_handler(led_store_flush);
+}
+#endif // CONFIG_HTTPD_LED_PERSIST
+
 static esp_err_t api_led_set_level(httpd_req_t *req, uint32_t level) {
-    esp_err_t err = gpio_set_level(LED_PIN, level);
+    esp_err_t err = led_set(level == 0);
 
     if (unlikely(err != ESP_OK)) {
         return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
@@ -63,40 +390,58 @@ static esp_err_t api_led_post_off_handler(httpd_req_t *req) {
     return api_led_set_level(req, 1);
 }
 
+#if CONFIG_IDF_TARGET_LINUX
+// The host is on the network already, the server listens on all of its interfaces
+static esp_err_t wifi_init() {
+    return ESP_OK;
+}
+
+static esp_err_t wifi_connect() {
+    ESP_LOGI(TAG, "host build, serving on port %u", s_config.http_port);
+    return ESP_OK;
+}
+#else
+static esp_err_t netif_init() {
+    ESP_RETURN_ON_ERROR(esp_netif_init(), TAG, "esp_netif_init failed");
+    DEFER(esp_netif_deinit);
+
+    ESP_RETURN_ON_ERROR(esp_event_loop_create_default(), TAG, "esp_event_loop_create_default failed");
+    DEFER(esp_event_loop_delete_default);
+
+    return ESP_OK;
+}
+
+#if CONFIG_HTTPD_NET_WIFI
 static esp_err_t delete_default_wifi_driver_and_handlers() {
-    if (unlikely(s_sta_netif == NULL)) {
+    if (unlikely(s_netif == NULL)) {
         return ESP_OK;
     }
 
-    return esp_wifi_clear_default_wifi_driver_and_handlers(s_sta_netif);
+    return esp_wifi_clear_default_wifi_driver_and_handlers(s_netif);
 }
 
 static void sta_netif_destroy() {
-    if (unlikely(s_sta_netif == NULL)) {
+    if (unlikely(s_netif == NULL)) {
         return;
     }
 
-    esp_netif_destroy(s_sta_netif);
-    s_sta_netif = NULL;
+    esp_netif_destroy(s_netif);
+    s_netif = NULL;
 }
 
 static esp_err_t wifi_init() {
     ESP_LOGI(TAG, "wifi_init");
 
-    ESP_RETURN_ON_ERROR(esp_netif_init(), TAG, "esp_netif_init failed");
-    DEFER(esp_netif_deinit);
-
-    ESP_RETURN_ON_ERROR(esp_event_loop_create_default(), TAG, "esp_event_loop_create_default failed");
-    DEFER(esp_event_loop_delete_default);
+    ESP_RETURN_ON_ERROR(netif_init(), TAG, "netif_init failed");
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_RETURN_ON_ERROR(esp_wifi_init(&cfg), TAG, "esp_wifi_init failed");
     DEFER(esp_wifi_deinit);
 
     esp_netif_inherent_config_t esp_netif_config = ESP_NETIF_INHERENT_DEFAULT_WIFI_STA();
-    s_sta_netif = esp_netif_create_wifi(WIFI_IF_STA, &esp_netif_config);
+    s_netif = esp_netif_create_wifi(WIFI_IF_STA, &esp_netif_config);
 
-    if (unlikely(s_sta_netif == NULL)) {
+    if (unlikely(s_netif == NULL)) {
         ESP_LOGE(TAG, "esp_netif_create_wifi failed");
         return ESP_FAIL;
     }
@@ -117,6 +462,8 @@ static esp_err_t wifi_init() {
 
     return ESP_OK;
 }
+#endif // CONFIG_HTTPD_NET_WIFI
+#endif // CONFIG_IDF_TARGET_LINUX
 
 static esp_err_t nvs_init() {
     esp_err_t ret = nvs_flash_init();
@@ -128,9 +475,95 @@ static esp_err_t nvs_init() {
     return ret;
 }
 
-static void handler_on_sta_got_ip(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+static esp_err_t cfg_load_field(nvs_handle_t nvs, const cfg_field_t *f, app_config_t *c) {
+    uint8_t *p = (uint8_t *)c + f->offset;
+
+    switch (f->type) {
+    case CFG_STR: {
+        size_t len = f->size;
+        return nvs_get_str(nvs, f->key, (char *)p, &len);
+    }
+    case CFG_U16:
+        return nvs_get_u16(nvs, f->key, (uint16_t *)p);
+    case CFG_U32:
+        return nvs_get_u32(nvs, f->key, (uint32_t *)p);
+    case CFG_BOOL: {
+        uint8_t v;
+        esp_err_t err = nvs_get_u8(nvs, f->key, &v);
+        if (err == ESP_OK) {
+            *(bool *)p = v;
+        }
+        return err;
+    }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+#if CONFIG_HTTPD_CONFIG_WRITE
+static esp_err_t cfg_store_field(nvs_handle_t nvs, const cfg_field_t *f, const app_config_t *c) {
+    const uint8_t *p = (const uint8_t *)c + f->offset;
+
+    switch (f->type) {
+    case CFG_STR:
+        return nvs_set_str(nvs, f->key, (const char *)p);
+    case CFG_U16:
+        return nvs_set_u16(nvs, f->key, *(const uint16_t *)p);
+    case CFG_U32:
+        return nvs_set_u32(nvs, f->key, *(const uint32_t *)p);
+    case CFG_BOOL:
+        return nvs_set_u8(nvs, f->key, *(const bool *)p);
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+#endif // CONFIG_HTTPD_CONFIG_WRITE
+
+// Keys missing from NVS keep their Kconfig defaults, a field that fails to load is reset to its default
+static esp_err_t cfg_load() {
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "nvs_open failed");
+
+    const app_config_t defaults = s_config;
+    for (size_t i = 0; i < CFG_FIELDS_COUNT; i++) {
+        const cfg_field_t *f = &cfg_fields[i];
+        esp_err_t err = cfg_load_field(nvs, f, &s_config);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "config %s not loaded: %s", f->key, esp_err_to_name(err));
+            memcpy((uint8_t *)&s_config + f->offset, (const uint8_t *)&defaults + f->offset, f->size);
+        }
+    }
+
+    nvs_close(nvs);
+    return ESP_OK;
+}
+
+#if CONFIG_HTTPD_CONFIG_WRITE
+// Stores the fields of next that differ from prev in one commit, apply collects what they take effect with
+static esp_err_t cfg_save(const app_config_t *next, const app_config_t *prev, uint8_t *apply) {
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "nvs_open failed");
+
+    esp_err_t err = ESP_OK;
+    *apply = 0;
+    for (size_t i = 0; i < CFG_FIELDS_COUNT && err == ESP_OK; i++) {
+        const cfg_field_t *f = &cfg_fields[i];
+        if (memcmp((const uint8_t *)next + f->offset, (const uint8_t *)prev + f->offset, f->size) != 0) {
+            err = cfg_store_field(nvs, f, next);
+            *apply |= f->apply;
+        }
+    }
+    if (err == ESP_OK && *apply) {
+        err = nvs_commit(nvs);
+    }
+
+    nvs_close(nvs);
+    return err;
+}
+#endif // CONFIG_HTTPD_CONFIG_WRITE
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void handler_on_got_ip(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-    if (event->esp_netif != s_sta_netif) {
+    if (event->esp_netif != s_netif) {
         ESP_LOGW(TAG, "Got IP event for unknown netif");
         return;
     }
@@ -151,24 +584,14 @@ static void handler_on_sta_got_ip(void *arg, esp_event_base_t event_base, int32_
     }
 }
 
-static esp_err_t wifi_connect() {
-    wifi_config_t wifi_config = {
-        .sta =
-            {
-                .ssid = CONFIG_HTTPD_WIFI_SSID,
-                .password = CONFIG_HTTPD_WIFI_PASSWORD,
-            },
-    };
-
-    ESP_LOGI(TAG, "Connecting to %s...", wifi_config.sta.ssid);
-    ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_STA, &wifi_config), TAG, "esp_wifi_set_config failed");
-
+// Starts the interface with start() and waits until it got an address
+static esp_err_t netif_wait_ip(int32_t event_id, esp_err_t (*start)(void)) {
     __atomic_store_n(&xTaskToNotify, xTaskGetCurrentTaskHandle(), __ATOMIC_SEQ_CST);
 
-    ESP_RETURN_ON_ERROR(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &handler_on_sta_got_ip, NULL), TAG,
+    ESP_RETURN_ON_ERROR(esp_event_handler_register(IP_EVENT, event_id, &handler_on_got_ip, NULL), TAG,
                         "esp_event_handler_register failed");
 
-    esp_err_t err = esp_wifi_connect();
+    esp_err_t err = start();
 
     if (err != ESP_OK) {
         goto cleanup;
@@ -176,7 +599,7 @@ static esp_err_t wifi_connect() {
 
     ESP_LOGI(TAG, "Waiting for IP address...");
 
-    if (xTaskNotifyWait(pdFALSE, ULONG_MAX, NULL, WAIT_STA_GOT_IP_MAX) != pdPASS) {
+    if (xTaskNotifyWait(pdFALSE, ULONG_MAX, NULL, WAIT_GOT_IP_MAX) != pdPASS) {
         err = ESP_ERR_TIMEOUT;
         ESP_LOGW(TAG, "No ip received within the timeout period");
 
@@ -187,32 +610,92 @@ static esp_err_t wifi_connect() {
 
 cleanup:
 
-    esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, &handler_on_sta_got_ip); // TODO: спорно
+    esp_event_handler_unregister(IP_EVENT, event_id, &handler_on_got_ip); // TODO: спорно
     __atomic_store_n(&xTaskToNotify, NULL, __ATOMIC_SEQ_CST);
 
     return err;
 }
 
-static esp_err_t make_etag(char *etag, size_t etag_len) {
-    if (unlikely(!etag || etag_len < 20)) {
-        return ESP_ERR_INVALID_ARG;
+#if CONFIG_HTTPD_NET_WIFI
+static esp_err_t wifi_connect() {
+    wifi_config_t wifi_config = {0};
+    // Not terminated when they fill the whole array
+    memcpy(wifi_config.sta.ssid, s_config.wifi_ssid, strlen(s_config.wifi_ssid));
+    memcpy(wifi_config.sta.password, s_config.wifi_password, strlen(s_config.wifi_password));
+
+    ESP_LOGI(TAG, "Connecting to %s...", s_config.wifi_ssid);
+    ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_STA, &wifi_config), TAG, "esp_wifi_set_config failed");
+
+    return netif_wait_ip(IP_EVENT_STA_GOT_IP, esp_wifi_connect);
+}
+#endif // CONFIG_HTTPD_NET_WIFI
+
+#if CONFIG_HTTPD_NET_OPENETH
+static esp_eth_handle_t s_eth_handle = NULL;
+
+static void eth_netif_destroy() {
+    esp_netif_destroy(s_netif);
+    s_netif = NULL;
+}
+
+static void eth_driver_uninstall() {
+    esp_eth_driver_uninstall(s_eth_handle);
+    s_eth_handle = NULL;
+}
+
+// The open_eth MAC of Espressif QEMU, with the PHY it emulates. Lets the image reach the network in the emulator,
+// where there is no WiFi.
+static esp_err_t eth_init() {
+    ESP_LOGI(TAG, "eth_init");
+
+    ESP_RETURN_ON_ERROR(netif_init(), TAG, "netif_init failed");
+
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    phy_config.phy_addr = 1;
+    phy_config.reset_gpio_num = -1;
+    phy_config.autonego_timeout_ms = 100;
+
+    esp_eth_mac_t *mac = esp_eth_mac_new_openeth(&mac_config);
+    esp_eth_phy_t *phy = esp_eth_phy_new_dp83848(&phy_config);
+    if (unlikely(mac == NULL || phy == NULL)) {
+        ESP_LOGE(TAG, "open_eth mac or phy creation failed");
+        return ESP_FAIL;
     }
 
-    const esp_app_desc_t *desc = esp_app_get_description();
-    if (unlikely(!desc)) {
+    esp_eth_config_t config = ETH_DEFAULT_CONFIG(mac, phy);
+    ESP_RETURN_ON_ERROR(esp_eth_driver_install(&config, &s_eth_handle), TAG, "esp_eth_driver_install failed");
+    DEFER(eth_driver_uninstall);
+
+    esp_netif_config_t netif_config = ESP_NETIF_DEFAULT_ETH();
+    s_netif = esp_netif_new(&netif_config);
+    if (unlikely(s_netif == NULL)) {
+        ESP_LOGE(TAG, "esp_netif_new failed");
         return ESP_FAIL;
     }
+    DEFER(eth_netif_destroy);
 
-    int written =
-        snprintf(etag, etag_len, "\"%02x%02x%02x%02x%02x%02x%02x%02x\"", desc->app_elf_sha256[0],
-                 desc->app_elf_sha256[1], desc->app_elf_sha256[2], desc->app_elf_sha256[3], desc->app_elf_sha256[4],
-                 desc->app_elf_sha256[5], desc->app_elf_sha256[6], desc->app_elf_sha256[7]);
+    return esp_netif_attach(s_netif, esp_eth_new_netif_glue(s_eth_handle));
+}
 
-    if (unlikely((written < 0 || (size_t)written >= etag_len))) {
-        return ESP_ERR_INVALID_SIZE;
+static esp_err_t eth_start() {
+    return esp_eth_start(s_eth_handle);
+}
+
+static esp_err_t eth_connect() {
+    return netif_wait_ip(IP_EVENT_ETH_GOT_IP, eth_start);
+}
+#endif // CONFIG_HTTPD_NET_OPENETH
+#endif // !CONFIG_IDF_TARGET_LINUX
+
+// Last-Modified of the embedded assets is the time of the web build, recorded in UTC by compress.mjs
+static esp_err_t make_last_modified(time_t *out, char *buf, size_t len) {
+    if (unlikely(!out || !buf)) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    return ESP_OK;
+    *out = (time_t)web_assets_last_modified;
+    return *out ? http_date_format(*out, buf, len) : ESP_OK;
 }
 
 //  Handler to redirect incoming GET request for /index.html to /
@@ -223,111 +706,2738 @@ static esp_err_t index_html_get_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-static esp_err_t root_get_handler(httpd_req_t *req) {
+static esp_err_t resp_send_raw(httpd_req_t *req, const void *data, size_t len) {
+    for (size_t sent = 0; sent < len;) {
+        int ret = httpd_send(req, (const char *)data + sent, len - sent);
+        if (unlikely(ret < 0)) {
+            return ESP_FAIL;
+        }
+        sent += ret;
+    }
+
+    return ESP_OK;
+}
 
-    httpd_resp_set_hdr(req, "ETag", s_etag);
+static esp_err_t resp_raw_write(void *ctx, const uint8_t *buf, size_t len) {
+    return resp_send_raw((httpd_req_t *)ctx, buf, len);
+}
 
-    // Проверяем If-None-Match
-    char if_none_match[ETAG_LEN];
-    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK) {
-        if (strncmp(if_none_match, s_etag, ETAG_LEN - 1) == 0) {
-            httpd_resp_set_status(req, "304 Not Modified");
-            return httpd_resp_send(req, NULL, 0);
-        }
+// esp_http_server always sends a body with Content-Length set to its size, so HEAD is written raw.
+// Bodies sent in pieces of a known total size follow the same head with resp_send_raw().
+static esp_err_t resp_send_head(httpd_req_t *req, const char *status, const char *type, size_t content_len,
+                                const resp_hdrs_t *hdrs) {
+    char buf[RESP_HEAD_MAX];
+    const int len = resp_head_format(buf, sizeof(buf), status, type, content_len, hdrs);
+    if (unlikely(len < 0)) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response headers too long");
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    httpd_resp_set_type(req, "text/html; charset=utf-8");
-    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, must-revalidate");
+    return resp_send_raw(req, buf, len);
+}
+
+// An error sent through esp_http_server would carry the headers that did get set, e.g. a Content-Encoding,
+// so the 500 is written raw
+static esp_err_t resp_hdrs_fail(httpd_req_t *req, esp_err_t err) {
+    static const resp_hdrs_t none = {0};
+
+    ESP_LOGE(TAG, "setting response headers failed: %s", esp_err_to_name(err));
+    resp_send_head(req, "500 Internal Server Error", "text/plain", 0, &none);
+    return err;
+}
 
-    // "no-cache, must-revalidate" - for dynamic content
-    // "public, max-age=300, s-maxage=86400, stale-while-revalidate=300, stale-if-error=3600" - for static files
-    // behind "public, max-age=31536000, immutable" - for versioned static files
+static esp_err_t resp_send(httpd_req_t *req, const char *status, const char *type, const resp_hdrs_t *hdrs,
+                           const uint8_t *body, size_t len) {
+    if (req->method == HTTP_HEAD) {
+        return resp_send_head(req, status, type, len, hdrs);
+    }
 
-    extern const unsigned char index_html_start[] asm("_binary_index_html_gz_start");
-    extern const unsigned char index_html_end[] asm("_binary_index_html_gz_end");
-    const size_t index_html_size = (index_html_end - index_html_start);
+    esp_err_t err = resp_hdrs_apply(req, hdrs);
+    if (unlikely(err != ESP_OK)) {
+        return resp_hdrs_fail(req, err);
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, type);
 
-    return httpd_resp_send(req, (const char *)index_html_start, index_html_size);
+    return httpd_resp_send(req, (const char *)body, len);
 }
 
-static esp_err_t stop_webserver() {
-    ESP_LOGI(TAG, "stopping webserver");
-    ESP_RETURN_ON_ERROR(httpd_stop(s_server), TAG, "httpd_stop failed");
-    s_server = NULL;
+static esp_err_t resp_chunk_write(void *ctx, const uint8_t *buf, size_t len) {
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, (const char *)buf, len);
+}
+
+#define STATE_JSON_MAX 160
+
+// Live device state, spliced into pages and served by /api/state
+static const char *state_version() {
+    const esp_app_desc_t *desc = esp_app_get_description();
+    return desc ? desc->version : "";
+}
+
+// The writer escapes "<", so the output is safe inside a <script> element
+static void state_write_json(json_writer_t *w) {
+    json_obj_begin(w);
+    json_key(w, "led");
+    json_bool(w, s_led_on);
+    json_key(w, "name");
+    json_str(w, s_config.mdns_name);
+    json_key(w, "version");
+    json_str(w, state_version());
+    json_obj_end(w);
+}
+
+#if CONFIG_HTTPD_STATE_INJECT
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} resp_buf_t;
+
+static esp_err_t resp_buf_write(void *ctx, const void *data, size_t len) {
+    resp_buf_t *b = ctx;
+
+    if (unlikely(len > b->cap - b->len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(b->buf + b->len, data, len);
+    b->len += len;
     return ESP_OK;
 }
 
-static esp_err_t start_webserver() {
-    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+// The spliced state goes into Content-Length, so it is rendered before the headers
+static int state_json(char *buf, size_t len) {
+    resp_buf_t b = {.buf = buf, .len = 0, .cap = len};
+    json_writer_t w;
+    json_writer_init(&w, resp_buf_write, &b);
+    state_write_json(&w);
+    return w.err == ESP_OK ? (int)b.len : -1;
+}
+
+// Every state is a representation of its own, the body ETag is extended with a checksum of the state
+static void state_etag(char *buf, size_t len, const char *etag, const char *state, size_t state_len) {
+    snprintf(buf, len, "%.*s-%08" PRIx32 "\"", (int)strlen(etag) - 1, etag,
+             esp_rom_crc32_le(0, (const uint8_t *)state, state_len));
+}
 
-    config.server_port = CONFIG_HTTPD_HTTP_PORT;
+// Prefix member, stored member with the state, suffix member: one gzip stream, sent from flash as is
+static esp_err_t static_send_injected(httpd_req_t *req, const web_asset_t *asset, const web_asset_body_t *body,
+                                      const char *state, size_t state_len, const resp_hdrs_t *hdrs) {
+    const size_t size = body->end - body->start;
 
-    config.lru_purge_enable = true;
-    config.max_open_sockets = 4;
+    ESP_RETURN_ON_ERROR(resp_send_head(req, HTTPD_200, asset->type, size + GZIP_STORED_OVERHEAD + state_len, hdrs),
+                        TAG, "sending headers failed");
+    if (req->method == HTTP_HEAD) {
+        return ESP_OK;
+    }
 
-    config.recv_wait_timeout = 10;
-    config.send_wait_timeout = 10;
+    ESP_RETURN_ON_ERROR(resp_send_raw(req, body->start, body->inject), TAG, "sending prefix failed");
+    ESP_RETURN_ON_ERROR(gzip_stored(state, state_len, resp_raw_write, req), TAG, "sending state failed");
+    return resp_send_raw(req, body->start + body->inject, size - body->inject);
+}
+#endif // CONFIG_HTTPD_STATE_INJECT
+
+#if CONFIG_HTTPD_IDENTITY_FALLBACK
+// Decodes a gzip body on the fly for clients that do not accept gzip, ranges are not offered for it.
+// A state is written between the members of a body split for injection.
+static esp_err_t static_send_inflated(httpd_req_t *req, const web_asset_t *asset, const web_asset_body_t *body,
+                                      const char *state, size_t state_len, const resp_hdrs_t *hdrs) {
+    if (req->method == HTTP_HEAD) {
+        return resp_send_head(req, HTTPD_200, asset->type, asset->size + state_len, hdrs);
+    }
 
-    config.keep_alive_enable = true;
+    esp_err_t err = resp_hdrs_apply(req, hdrs);
+    if (unlikely(err != ESP_OK)) {
+        return resp_hdrs_fail(req, err);
+    }
+    httpd_resp_set_type(req, asset->type);
 
-    config.stack_size = 6144;
-    config.max_uri_handlers = 8;
+    const size_t size = body->end - body->start;
+    const size_t split = body->inject ? body->inject : size;
 
-    config.task_priority = tskIDLE_PRIORITY + 3;
+    // Once the first chunk is out an error can only cut the response short, httpd then closes the socket
+    err = gunzip_stream(body->start, split, resp_chunk_write, req);
+    if (err == ESP_OK && state_len) {
+        err = httpd_resp_send_chunk(req, state, state_len);
+    }
+    if (err == ESP_OK && split < size) {
+        err = gunzip_stream(body->start + split, size - split, resp_chunk_write, req);
+    }
+    if (unlikely(err != ESP_OK)) {
+        ESP_LOGE(TAG, "inflating %s failed: %s", asset->uri, esp_err_to_name(err));
+        return err;
+    }
 
-    ESP_LOGI(TAG, "starting server on port: '%d'", config.server_port);
-    ESP_RETURN_ON_ERROR(httpd_start(&s_server, &config), TAG, "httpd_start failed");
-    DEFER(stop_webserver);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif // CONFIG_HTTPD_IDENTITY_FALLBACK
+
+// Available-Dictionary is a structured field byte sequence of a SHA-256, ":" + 44 base64 chars + ":"
+#define AVAILABLE_DICTIONARY_LEN 48
+
+// Picks the stored body the client prefers; ties go to the smaller one, bodies are listed smallest first.
+// A delta qualifies only when the client holds the dictionary it was encoded against.
+static const web_asset_body_t *static_select_body(httpd_req_t *req, const web_asset_t *asset, bool *inflate) {
+    char accept[HTTP_ACCEPT_HDR_MAX];
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept));
+    const bool has_accept = err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC;
+
+    char dictionary[AVAILABLE_DICTIONARY_LEN] = "";
+    if (asset->has_deltas &&
+        httpd_req_get_hdr_value_str(req, "Available-Dictionary", dictionary, sizeof(dictionary)) != ESP_OK) {
+        dictionary[0] = '\0';
+    }
 
-    static const httpd_uri_t root_uri = {.uri = "/", .method = HTTP_GET, .handler = root_get_handler};
-    ESP_RETURN_ON_ERROR(httpd_register_uri_handler(s_server, &root_uri), TAG, "httpd_register_uri_handler failed");
+    const web_asset_body_t *fallback = NULL;
 
-    static const httpd_uri_t index_html_uri = {
-        .uri = "/index.html", .method = HTTP_GET, .handler = index_html_get_handler};
-    ESP_RETURN_ON_ERROR(httpd_register_uri_handler(s_server, &index_html_uri), TAG,
-                        "httpd_register_uri_handler failed");
+    const web_asset_body_t *best = NULL;
+    const web_asset_body_t *identity = NULL;
+#if CONFIG_HTTPD_IDENTITY_FALLBACK
+    const web_asset_body_t *gzip = NULL;
+#endif
+    int best_q = 0;
 
-    static const httpd_uri_t api_led_post_on = {
-        .uri = "/api/led/on", .method = HTTP_POST, .handler = api_led_post_on_handler};
-    ESP_RETURN_ON_ERROR(httpd_register_uri_handler(s_server, &api_led_post_on), TAG,
-                        "httpd_register_uri_handler failed");
+    for (size_t i = 0; i < asset->bodies_count; i++) {
+        const web_asset_body_t *body = &asset->bodies[i];
+        if (body->dictionary) {
+            if (!dictionary[0] || strcmp(body->dictionary, dictionary) != 0) {
+                continue;
+            }
+        } else if (!fallback) {
+            fallback = body;
+        }
 
-    static const httpd_uri_t api_led_post_off = {
-        .uri = "/api/led/off", .method = HTTP_POST, .handler = api_led_post_off_handler};
-    ESP_RETURN_ON_ERROR(httpd_register_uri_handler(s_server, &api_led_post_off), TAG,
-                        "httpd_register_uri_handler failed");
+        if (!body->coding) {
+            identity = body;
+            continue;
+        }
+#if CONFIG_HTTPD_IDENTITY_FALLBACK
+        if (strcmp(body->coding, "gzip") == 0) {
+            gzip = body;
+        }
+#endif
 
-    return ESP_OK;
+        const int q = has_accept ? http_accept_q(accept, body->coding) : -1;
+        if (q > best_q) {
+            best = body;
+            best_q = q;
+        }
+    }
+
+    *inflate = false;
+    if (best) {
+        return best;
+    }
+    if (identity) {
+        return identity;
+    }
+#if CONFIG_HTTPD_IDENTITY_FALLBACK
+    if (gzip) {
+        *inflate = true;
+        return gzip;
+    }
+#endif
+
+    // Nothing the client can decode and nothing to decode with, the smallest body is still the best guess
+    return fallback ? fallback : &asset->bodies[0];
 }
 
-static esp_err_t mdns_start() {
-    ESP_RETURN_ON_ERROR(mdns_init(), TAG, "mdns_init failed");
-    DEFER(mdns_free);
+// Serves an embedded asset for GET and HEAD, with preconditions and a single byte range, straight from flash
+static esp_err_t static_get_handler(httpd_req_t *req) {
+    const web_asset_t *asset = req->user_ctx;
+
+    bool inflate;
+    const web_asset_body_t *body = static_select_body(req, asset, &inflate);
+    const char *etag = inflate ? asset->etag : body->etag;
+    const size_t size = body->end - body->start;
+
+    size_t state_len = 0;
+#if CONFIG_HTTPD_STATE_INJECT
+    const char *state = NULL;
+    char state_buf[STATE_JSON_MAX];
+    char state_etag_buf[APP_ETAG_LEN + 16];
+    if (body->inject) {
+        const int len = state_json(state_buf, sizeof(state_buf));
+        if (likely(len > 0 && (size_t)len < sizeof(state_buf))) {
+            state = state_buf;
+            state_len = len;
+            state_etag(state_etag_buf, sizeof(state_etag_buf), etag, state, state_len);
+            etag = state_etag_buf;
+        }
+    }
+#endif
+
+    resp_hdrs_t hdrs = {0};
+    resp_hdrs_add(&hdrs, "Cache-Control", asset->cache_control);
+    resp_hdrs_add(&hdrs, "ETag", etag);
+    // The web build time says nothing about a spliced state
+    if (s_last_modified && !state_len) {
+        resp_hdrs_add(&hdrs, "Last-Modified", s_last_modified_str);
+    }
+    if (asset->has_deltas) {
+        resp_hdrs_add(&hdrs, "Vary", "Accept-Encoding, Available-Dictionary");
+    } else if (asset->bodies_count > 1 || body->coding) {
+        resp_hdrs_add(&hdrs, "Vary", "Accept-Encoding");
+    }
+    // A spliced page differs from the release deltas are built against, it would never match as a dictionary
+    if (asset->use_as_dictionary && !state_len) {
+        resp_hdrs_add(&hdrs, "Use-As-Dictionary", asset->use_as_dictionary);
+    }
+    if (asset->sw_allowed) {
+        resp_hdrs_add(&hdrs, "Service-Worker-Allowed", asset->sw_allowed);
+    }
 
-    ESP_RETURN_ON_ERROR(mdns_hostname_set(CONFIG_HTTPD_MDNS_NAME), TAG, "mdns_hostname_set failed");
-    ESP_LOGI(TAG, "mdns hostname set to: [%s]", CONFIG_HTTPD_MDNS_NAME);
+    // Only the state-aware ETag validates a spliced page, a date would keep a stale LED state cached
+    http_cond_result_t cond = http_cond_evaluate(req, etag, state_len ? 0 : s_last_modified);
+    if (cond == HTTP_COND_NOT_MODIFIED) {
+        return resp_send_head(req, "304 Not Modified", NULL, RESP_HEAD_NO_LENGTH, &hdrs);
+    }
+    if (cond != HTTP_COND_NONE) {
+        esp_err_t err = resp_hdrs_apply(req, &hdrs);
+        if (unlikely(err != ESP_OK)) {
+            return resp_hdrs_fail(req, err);
+        }
+        return http_cond_send(req, cond);
+    }
 
-    ESP_RETURN_ON_ERROR(mdns_instance_name_set("ESP32 with mDNS"), TAG,
-                        "mdns_instance_name_set failed"); // TODO: make configurable
-    ESP_RETURN_ON_ERROR(mdns_service_add(NULL, "_http", "_tcp", CONFIG_HTTPD_HTTP_PORT, NULL, 0), TAG,
-                        "mdns_service_add failed");
+#if CONFIG_HTTPD_IDENTITY_FALLBACK
+    if (inflate) {
+#if CONFIG_HTTPD_STATE_INJECT
+        return static_send_inflated(req, asset, body, state, state_len, &hdrs);
+#else
+        return static_send_inflated(req, asset, body, NULL, 0, &hdrs);
+#endif
+    }
+#endif
 
-    return ESP_OK;
+    if (body->coding) {
+        resp_hdrs_add(&hdrs, "Content-Encoding", body->coding);
+    }
+#if CONFIG_HTTPD_STATE_INJECT
+    if (state_len) {
+        return static_send_injected(req, asset, body, state, state_len, &hdrs);
+    }
+#endif
+    resp_hdrs_add(&hdrs, "Accept-Ranges", "bytes");
+
+    size_t start = 0, len = size;
+    char content_range[48];
+
+    switch (http_cond_range(req, etag, s_last_modified, size, &start, &len)) {
+    case HTTP_RANGE_PARTIAL:
+        snprintf(content_range, sizeof(content_range), "bytes %zu-%zu/%zu", start, start + len - 1, size);
+        resp_hdrs_add(&hdrs, "Content-Range", content_range);
+        return resp_send(req, "206 Partial Content", asset->type, &hdrs, body->start + start, len);
+    case HTTP_RANGE_UNSATISFIABLE:
+        snprintf(content_range, sizeof(content_range), "bytes */%zu", size);
+        resp_hdrs_add(&hdrs, "Content-Range", content_range);
+        return resp_send(req, "416 Range Not Satisfiable", asset->type, &hdrs, NULL, 0);
+    default:
+        return resp_send(req, HTTPD_200, asset->type, &hdrs, body->start, size);
+    }
 }
 
-static esp_err_t app_logic() {
-    ESP_RETURN_ON_ERROR(make_etag(s_etag, sizeof(s_etag)), TAG, "make_etag failed");
-    ESP_LOGI(TAG, "ETag: %s", s_etag);
+static http_stream_t *resp_stream_begin(httpd_req_t *req) {
+#if CONFIG_HTTPD_STREAM_GZIP
+    gzip_t *gz = http_accepts_encoding(req, "gzip") ? &s_gzip : NULL;
+    http_stream_begin(&s_stream, req, gz, CONFIG_HTTPD_STREAM_GZIP_THRESHOLD);
+#else
+    http_stream_begin(&s_stream, req, NULL, 0);
+#endif
+    return &s_stream;
+}
 
-    ESP_RETURN_ON_ERROR(gpio_init(), TAG, "GPIO init failed");
-    ESP_RETURN_ON_ERROR(gpio_set_level(LED_PIN, 1), TAG, "gpio_set_level failed"); // LED off
+static esp_err_t resp_stream_end(http_stream_t *stream) {
+    esp_err_t err = http_stream_end(stream);
 
-    ESP_RETURN_ON_ERROR(nvs_init(), TAG, "NVS init failed");
+    if (stream->compressed) {
+        s_metrics.gzip_responses++;
+        s_metrics.gzip_raw_bytes += stream->raw_bytes;
+        s_metrics.gzip_wire_bytes += stream->wire_bytes;
+        s_metrics.gzip_us += stream->gzip_us;
+    }
+
+    return err;
+}
+
+// Sink of the JSON and CBOR writers, the stream sends a chunk whenever its buffer fills up
+static esp_err_t resp_stream_write(void *ctx, const void *buf, size_t len) {
+    return http_stream_write(ctx, buf, len);
+}
+
+// JSON by default, CBOR for clients that ask for it
+static bool resp_wants_cbor(httpd_req_t *req) {
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    return http_prefers_type(req, "application/cbor", "application/json");
+}
+
+// API bodies that only change with the device state are tagged with the image ETag extended with a checksum of
+// that state. JSON and CBOR are representations of their own.
+static void api_etag(char *buf, size_t len, uint32_t crc, bool cbor) {
+    snprintf(buf, len, "%.*s-%08" PRIx32 "-%s\"", (int)strlen(s_etag) - 1, s_etag, crc, cbor ? "cbor" : "json");
+}
+
+// The answer to a request whose preconditions failed or hold a current copy, for a body api_etag() tagged
+static esp_err_t api_cond_send(httpd_req_t *req, http_cond_result_t cond, const char *etag) {
+    if (cond != HTTP_COND_NOT_MODIFIED) {
+        return http_cond_send(req, cond);
+    }
+
+    resp_hdrs_t hdrs = {0};
+    resp_hdrs_add(&hdrs, "Cache-Control", "no-cache");
+    resp_hdrs_add(&hdrs, "ETag", etag);
+    resp_hdrs_add(&hdrs, "Vary", "Accept");
+    return resp_send_head(req, "304 Not Modified", NULL, RESP_HEAD_NO_LENGTH, &hdrs);
+}
+
+static void api_metrics_cbor(http_stream_t *stream, const metrics_t *m, double ratio, double us_per_kb) {
+    cbor_writer_t w;
+    cbor_writer_init(&w, resp_stream_write, stream);
+
+    cbor_put_map(&w, 3);
+    cbor_put_text(&w, "uptime_us");
+    cbor_put_int(&w, esp_timer_get_time());
+
+    cbor_put_text(&w, "gzip");
+    cbor_put_map(&w, 6);
+    cbor_put_text(&w, "responses");
+    cbor_put_uint(&w, m->gzip_responses);
+    cbor_put_text(&w, "raw_bytes");
+    cbor_put_uint(&w, m->gzip_raw_bytes);
+    cbor_put_text(&w, "wire_bytes");
+    cbor_put_uint(&w, m->gzip_wire_bytes);
+    cbor_put_text(&w, "ratio");
+    cbor_put_double(&w, ratio);
+    cbor_put_text(&w, "cpu_us");
+    cbor_put_int(&w, m->gzip_us);
+    cbor_put_text(&w, "cpu_us_per_kb");
+    cbor_put_double(&w, us_per_kb);
+
+    cbor_put_text(&w, "rum");
+    cbor_put_map(&w, 1 + RUM_MAX);
+    cbor_put_text(&w, "reports");
+    cbor_put_uint(&w, m->rum_reports);
+    for (size_t i = 0; i < RUM_MAX; i++) {
+        const hist_t *h = &m->rum[i];
+        cbor_put_text(&w, rum_names[i]);
+        cbor_put_map(&w, 6);
+        cbor_put_text(&w, "count");
+        cbor_put_uint(&w, h->count);
+        cbor_put_text(&w, "mean_us");
+        cbor_put_uint(&w, h->count ? h->sum / h->count : 0);
+        cbor_put_text(&w, "p50_us");
+        cbor_put_uint(&w, hist_percentile(h, 500));
+        cbor_put_text(&w, "p90_us");
+        cbor_put_uint(&w, hist_percentile(h, 900));
+        cbor_put_text(&w, "p99_us");
+        cbor_put_uint(&w, hist_percentile(h, 990));
+        cbor_put_text(&w, "max_us");
+        cbor_put_uint(&w, h->max);
+    }
+}
+
+static void api_metrics_json(http_stream_t *stream, const metrics_t *m, double ratio, double us_per_kb) {
+    json_writer_t w;
+    json_writer_init(&w, resp_stream_write, stream);
+
+    json_obj_begin(&w);
+    json_key(&w, "uptime_us");
+    json_int(&w, esp_timer_get_time());
+
+    json_key(&w, "gzip");
+    json_obj_begin(&w);
+    json_key(&w, "responses");
+    json_uint(&w, m->gzip_responses);
+    json_key(&w, "raw_bytes");
+    json_uint(&w, m->gzip_raw_bytes);
+    json_key(&w, "wire_bytes");
+    json_uint(&w, m->gzip_wire_bytes);
+    json_key(&w, "ratio");
+    json_double(&w, ratio, 3);
+    json_key(&w, "cpu_us");
+    json_int(&w, m->gzip_us);
+    json_key(&w, "cpu_us_per_kb");
+    json_double(&w, us_per_kb, 4);
+    json_obj_end(&w);
+
+    json_key(&w, "rum");
+    json_obj_begin(&w);
+    json_key(&w, "reports");
+    json_uint(&w, m->rum_reports);
+    for (size_t i = 0; i < RUM_MAX; i++) {
+        const hist_t *h = &m->rum[i];
+        json_key(&w, rum_names[i]);
+        json_obj_begin(&w);
+        json_key(&w, "count");
+        json_uint(&w, h->count);
+        json_key(&w, "mean_us");
+        json_uint(&w, h->count ? h->sum / h->count : 0);
+        json_key(&w, "p50_us");
+        json_uint(&w, hist_percentile(h, 500));
+        json_key(&w, "p90_us");
+        json_uint(&w, hist_percentile(h, 900));
+        json_key(&w, "p99_us");
+        json_uint(&w, hist_percentile(h, 990));
+        json_key(&w, "max_us");
+        json_uint(&w, h->max);
+        json_obj_end(&w);
+    }
+    json_obj_end(&w);
+    json_obj_end(&w);
+}
+
+static esp_err_t api_metrics_get_handler(httpd_req_t *req) {
+    const metrics_t *m = &s_metrics;
+    const double ratio = m->gzip_raw_bytes ? (double)m->gzip_wire_bytes / m->gzip_raw_bytes : 0;
+    const double us_per_kb = m->gzip_raw_bytes ? m->gzip_us * 1024.0 / m->gzip_raw_bytes : 0;
+    const bool cbor = resp_wants_cbor(req);
+
+    httpd_resp_set_type(req, cbor ? "application/cbor" : "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    http_stream_t *stream = resp_stream_begin(req);
+    if (cbor) {
+        api_metrics_cbor(stream, m, ratio, us_per_kb);
+    } else {
+        api_metrics_json(stream, m, ratio, us_per_kb);
+    }
+    return resp_stream_end(stream);
+}
+
+// What /api/state shows besides the version, which the image ETag covers
+static uint32_t api_state_crc() {
+    const uint8_t led = s_led_on;
+    const uint32_t crc = esp_rom_crc32_le(0, &led, sizeof(led));
+    return esp_rom_crc32_le(crc, (const uint8_t *)s_config.mdns_name, strlen(s_config.mdns_name));
+}
+
+// A client that asks again gets a 304 until the LED or the name changes
+static esp_err_t api_state_get_handler(httpd_req_t *req) {
+    const bool cbor = resp_wants_cbor(req);
+
+    char etag[APP_ETAG_LEN + 16];
+    api_etag(etag, sizeof(etag), api_state_crc(), cbor);
+    const http_cond_result_t cond = http_cond_evaluate(req, etag, 0);
+    if (cond != HTTP_COND_NONE) {
+        return api_cond_send(req, cond, etag);
+    }
+
+    httpd_resp_set_type(req, cbor ? "application/cbor" : "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "ETag", etag);
+
+    http_stream_t *stream = resp_stream_begin(req);
+    if (cbor) {
+        cbor_writer_t w;
+        cbor_writer_init(&w, resp_stream_write, stream);
+        cbor_put_map(&w, 3);
+        cbor_put_text(&w, "led");
+        cbor_put_bool(&w, s_led_on);
+        cbor_put_text(&w, "name");
+        cbor_put_text(&w, s_config.mdns_name);
+        cbor_put_text(&w, "version");
+        cbor_put_text(&w, state_version());
+    } else {
+        json_writer_t w;
+        json_writer_init(&w, resp_stream_write, stream);
+        state_write_json(&w);
+    }
+    return resp_stream_end(stream);
+}
+
+#if CONFIG_HTTPD_LOG_RING
+#define LOG_RING_LINE_MAX 128
+
+// Tail of the log output of every task, kept for /api/logs. s_log_total counts every byte ever written, the
+// ring holds the last CONFIG_HTTPD_LOG_RING_LEN of them.
+static char s_log_ring[CONFIG_HTTPD_LOG_RING_LEN];
+static uint32_t s_log_total = 0;
+static portMUX_TYPE s_log_lock = portMUX_INITIALIZER_UNLOCKED;
+static vprintf_like_t s_log_vprintf = NULL;
+
+// Runs on the logging task, the line is formatted on its stack and copied in one short critical section
+static int log_ring_vprintf(const char *fmt, va_list args) {
+    char line[LOG_RING_LINE_MAX];
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(line, sizeof(line), fmt, copy);
+    va_end(copy);
+
+    if (len > 0) {
+        if ((size_t)len >= sizeof(line)) {
+            len = sizeof(line) - 1;
+            line[len - 1] = '\n';
+        }
+
+        taskENTER_CRITICAL(&s_log_lock);
+        for (int i = 0; i < len; i++) {
+            s_log_ring[(s_log_total + i) % CONFIG_HTTPD_LOG_RING_LEN] = line[i];
+        }
+        s_log_total += len;
+        taskEXIT_CRITICAL(&s_log_lock);
+    }
+
+    return s_log_vprintf(fmt, args);
+}
+
+static void log_ring_stop() {
+    esp_log_set_vprintf(s_log_vprintf);
+}
+
+static esp_err_t log_ring_start() {
+    s_log_vprintf = esp_log_set_vprintf(log_ring_vprintf);
+    DEFER(log_ring_stop);
+    return ESP_OK;
+}
+
+// Streams the ring as an array of lines without a copy of it: small pieces are taken under the lock, so
+// logging never waits for the network. Bytes overwritten while the response is sent are skipped up to the
+// next full line, as is the cut oldest line.
+static void api_logs_write(json_writer_t *w) {
+    char buf[LOG_RING_LINE_MAX];
+
+    taskENTER_CRITICAL(&s_log_lock);
+    const uint32_t end = s_log_total;
+    taskEXIT_CRITICAL(&s_log_lock);
+
+    uint32_t pos = end > CONFIG_HTTPD_LOG_RING_LEN ? end - CONFIG_HTTPD_LOG_RING_LEN : 0;
+    uint32_t lost = pos;
+    bool skip = pos > 0;
+    bool open = false;
+
+    json_obj_begin(w);
+    json_key(w, "lines");
+    json_arr_begin(w);
+
+    while (pos < end && w->err == ESP_OK) {
+        size_t n = end - pos < sizeof(buf) ? end - pos : sizeof(buf);
+        bool overrun = false;
+
+        taskENTER_CRITICAL(&s_log_lock);
+        if (s_log_total - pos > CONFIG_HTTPD_LOG_RING_LEN) {
+            overrun = true;
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                buf[i] = s_log_ring[(pos + i) % CONFIG_HTTPD_LOG_RING_LEN];
+            }
+        }
+        const uint32_t total = s_log_total;
+        taskEXIT_CRITICAL(&s_log_lock);
+
+        if (overrun) {
+            const uint32_t next = total - CONFIG_HTTPD_LOG_RING_LEN;
+            lost += next - pos;
+            pos = next;
+            if (open) {
+                json_str_end(w);
+                open = false;
+            }
+            skip = true;
+            continue;
+        }
+
+        for (size_t i = 0; i < n;) {
+            const char *nl = memchr(buf + i, '\n', n - i);
+            const size_t line_end = nl ? (size_t)(nl - buf) : n;
+
+            if (!skip) {
+                if (!open) {
+                    json_str_begin(w);
+                    open = true;
+                }
+                json_str_append(w, buf + i, line_end - i);
+            }
+            if (nl) {
+                if (open) {
+                    json_str_end(w);
+                    open = false;
+                }
+                skip = false;
+            }
+            i = line_end + (nl ? 1 : 0);
+        }
+        pos += n;
+    }
+
+    if (open) {
+        json_str_end(w);
+    }
+    json_arr_end(w);
+    json_key(w, "bytes");
+    json_uint(w, end);
+    json_key(w, "lost_bytes");
+    json_uint(w, lost);
+    json_obj_end(w);
+}
+
+static esp_err_t api_logs_get_handler(httpd_req_t *req) {
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    http_stream_t *stream = resp_stream_begin(req);
+    json_writer_t w;
+    json_writer_init(&w, resp_stream_write, stream);
+    api_logs_write(&w);
+    return resp_stream_end(stream);
+}
+#endif // CONFIG_HTTPD_LOG_RING
+
+#if CONFIG_HTTPD_TASK_STATS
+#define TASK_STATS_MAX 24
+
+static TaskStatus_t s_task_stats[TASK_STATS_MAX];
+
+static const char *task_state_name(eTaskState state) {
+    switch (state) {
+    case eRunning:
+        return "running";
+    case eReady:
+        return "ready";
+    case eBlocked:
+        return "blocked";
+    case eSuspended:
+        return "suspended";
+    case eDeleted:
+        return "deleted";
+    default:
+        return "invalid";
+    }
+}
+
+static esp_err_t api_tasks_get_handler(httpd_req_t *req) {
+    uint32_t runtime_total = 0;
+    const UBaseType_t count = uxTaskGetSystemState(s_task_stats, TASK_STATS_MAX, &runtime_total);
+
+    if (unlikely(count == 0)) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "too many tasks");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    http_stream_t *stream = resp_stream_begin(req);
+    json_writer_t w;
+    json_writer_init(&w, resp_stream_write, stream);
+
+    json_obj_begin(&w);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    json_key(&w, "runtime_total");
+    json_uint(&w, runtime_total);
+#endif
+    json_key(&w, "tasks");
+    json_arr_begin(&w);
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *t = &s_task_stats[i];
+        json_obj_begin(&w);
+        json_key(&w, "name");
+        json_str(&w, t->pcTaskName);
+        json_key(&w, "state");
+        json_str(&w, task_state_name(t->eCurrentState));
+        json_key(&w, "priority");
+        json_uint(&w, t->uxCurrentPriority);
+        json_key(&w, "stack_free_min");
+        json_uint(&w, t->usStackHighWaterMark);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        json_key(&w, "runtime");
+        json_uint(&w, t->ulRunTimeCounter);
+        json_key(&w, "cpu");
+        json_double(&w, runtime_total ? t->ulRunTimeCounter * 100.0 / runtime_total : 0, 3);
+#endif
+        json_obj_end(&w);
+    }
+    json_arr_end(&w);
+    json_obj_end(&w);
+
+    return resp_stream_end(stream);
+}
+#endif // CONFIG_HTTPD_TASK_STATS
+
+#if CONFIG_HTTPD_BENCH
+#define BENCH_BUF_LEN CONFIG_HTTPD_BENCH_BUF_LEN
+#define BENCH_CHUNK_HEAD 6 // "%04x\r\n"
+#define BENCH_DOWNLOAD_DEFAULT (1024 * 1024)
+
+_Static_assert(BENCH_BUF_LEN <= 0xffff, "chunk size must fit the head");
+
+// A whole chunk, framing included, so a full one goes out with a single send. Upload and echo receive into the data
+// part, the bytes sent are arbitrary anyway.
+static char s_bench_chunk[BENCH_CHUNK_HEAD + BENCH_BUF_LEN + 2];
+static char *const s_bench_data = s_bench_chunk + BENCH_CHUNK_HEAD;
+
+static void bench_chunk_init() {
+    char head[BENCH_CHUNK_HEAD + 1];
+    snprintf(head, sizeof(head), "%04x\r\n", BENCH_BUF_LEN);
+    memcpy(s_bench_chunk, head, BENCH_CHUNK_HEAD);
+    for (size_t i = 0; i < BENCH_BUF_LEN; i++) {
+        s_bench_data[i] = 'a' + i % 26;
+    }
+    memcpy(s_bench_data + BENCH_BUF_LEN, "\r\n", 2);
+}
+
+// Server-Timing durations are milliseconds
+static void bench_server_timing(char *buf, size_t len, const char *name, int64_t us) {
+    snprintf(buf, len, "%s;dur=%" PRId64 ".%03" PRId64, name, us / 1000, us % 1000);
+}
+
+// The send time is only known once the body is out, so the body is chunked and the timing goes into a trailer
+static esp_err_t bench_download_get_handler(httpd_req_t *req) {
+    const int64_t start = esp_timer_get_time();
+
+    // The default only applies without a query or without bytes in it. A cut off query or value is refused, it
+    // would silently measure another size
+    uint64_t bytes = BENCH_DOWNLOAD_DEFAULT;
+    char query[64];
+    char value[21];
+    esp_err_t err = httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (err == ESP_OK) {
+        err = httpd_query_key_value(query, "bytes", value, sizeof(value));
+    }
+    if (err == ESP_OK) {
+        char *end;
+        errno = 0;
+        bytes = strtoull(value, &end, 10);
+        if (value[0] < '0' || value[0] > '9' || *end || errno == ERANGE) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad bytes");
+        }
+    } else if (err != ESP_ERR_NOT_FOUND) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad query");
+    }
+
+    static const char head[] = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                               "Cache-Control: no-store\r\nTransfer-Encoding: chunked\r\nTrailer: Server-Timing\r\n\r\n";
+    if (unlikely(resp_send_raw(req, head, sizeof(head) - 1) != ESP_OK)) {
+        return ESP_FAIL;
+    }
+
+    uint64_t left = bytes;
+    for (; left >= BENCH_BUF_LEN; left -= BENCH_BUF_LEN) {
+        if (unlikely(resp_send_raw(req, s_bench_chunk, sizeof(s_bench_chunk)) != ESP_OK)) {
+            return ESP_FAIL;
+        }
+    }
+
+    char tail[96];
+    int len = 0;
+    if (left) {
+        len = snprintf(tail, sizeof(tail), "%x\r\n", (unsigned)left);
+        if (unlikely(resp_send_raw(req, tail, len) != ESP_OK || resp_send_raw(req, s_bench_data, left) != ESP_OK)) {
+            return ESP_FAIL;
+        }
+        len = snprintf(tail, sizeof(tail), "\r\n");
+    }
+
+    char timing[48];
+    bench_server_timing(timing, sizeof(timing), "send", esp_timer_get_time() - start);
+    len += snprintf(tail + len, sizeof(tail) - len, "0\r\nServer-Timing: %s\r\n\r\n", timing);
+    return resp_send_raw(req, tail, len);
+}
+
+static esp_err_t bench_upload_post_handler(httpd_req_t *req) {
+    const int64_t start = esp_timer_get_time();
+
+    for (size_t left = req->content_len; left;) {
+        int ret = httpd_req_recv(req, s_bench_data, left < BENCH_BUF_LEN ? left : BENCH_BUF_LEN);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (unlikely(ret <= 0)) {
+            return ESP_FAIL;
+        }
+        left -= ret;
+    }
+
+    char timing[48];
+    bench_server_timing(timing, sizeof(timing), "recv", esp_timer_get_time() - start);
+    httpd_resp_set_hdr(req, "Server-Timing", timing);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+// As little as a handler can do, the timing covers receiving the body and the handler itself
+static esp_err_t bench_echo_handler(httpd_req_t *req) {
+    const int64_t start = esp_timer_get_time();
+
+    if (unlikely(req->content_len > BENCH_BUF_LEN)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body too large");
+    }
+    for (size_t len = 0; len < req->content_len;) {
+        int ret = httpd_req_recv(req, s_bench_data + len, req->content_len - len);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (unlikely(ret <= 0)) {
+            return ESP_FAIL;
+        }
+        len += ret;
+    }
+
+    char timing[48];
+    bench_server_timing(timing, sizeof(timing), "app", esp_timer_get_time() - start);
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Server-Timing", timing);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, s_bench_data, req->content_len);
+}
+#endif // CONFIG_HTTPD_BENCH
+
+// Reads the whole body into buf, which must hold content_len + 1 bytes, and terminates it
+static esp_err_t req_recv_body(httpd_req_t *req, char *buf) {
+    size_t len = 0;
+    while (len < req->content_len) {
+        int ret = httpd_req_recv(req, buf + len, req->content_len - len);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (unlikely(ret <= 0)) {
+            return ESP_FAIL;
+        }
+        len += ret;
+    }
+    buf[len] = '\0';
+    return ESP_OK;
+}
+
+static bool req_is_cbor(httpd_req_t *req) {
+    char type[32];
+    return httpd_req_get_hdr_value_str(req, "Content-Type", type, sizeof(type)) == ESP_OK &&
+           strncasecmp(type, "application/cbor", strlen("application/cbor")) == 0;
+}
+
+#if CONFIG_HTTPD_CONFIG_WRITE || CONFIG_HTTPD_OTA
+#define HTTP_AUTH_SEQ_KEY "http_seq"
+
+static uint64_t s_http_auth_seq = 0; // last accepted sequence number, as persisted
+static bool s_http_auth_loaded = false;
+
+// Stored before the request takes effect, so it is refused after a reboot too
+static esp_err_t auth_seq_take(uint64_t seq) {
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "nvs_open failed");
+
+    esp_err_t err = ESP_OK;
+    if (!s_http_auth_loaded) {
+        err = nvs_get_u64(nvs, HTTP_AUTH_SEQ_KEY, &s_http_auth_seq);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            s_http_auth_seq = 0;
+            err = ESP_OK;
+        }
+        s_http_auth_loaded = err == ESP_OK;
+    }
+    if (err == ESP_OK && seq <= s_http_auth_seq) {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u64(nvs, HTTP_AUTH_SEQ_KEY, seq);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    if (err == ESP_OK) {
+        s_http_auth_seq = seq;
+    }
+
+    nvs_close(nvs);
+    return err;
+}
+
+// Checks the Authorization of req against its digest field and decodes the digest its body must match, see
+// http_auth.h. A request that passes uses up its sequence number, whether it takes effect or not.
+static esp_err_t req_authorize(httpd_req_t *req, const char *field, uint8_t digest[32]) {
+    static const uint8_t key[] = CONFIG_HTTPD_AUTH_KEY;
+    if (sizeof(key) <= 1) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    char value[HTTP_AUTH_VALUE_MAX];
+    http_auth_t auth;
+    if (httpd_req_get_hdr_value_str(req, "Authorization", value, sizeof(value)) != ESP_OK ||
+        http_auth_parse(value, &auth) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char field_value[HTTP_AUTH_DIGEST_FIELD_MAX];
+    if (httpd_req_get_hdr_value_str(req, field, field_value, sizeof(field_value)) != ESP_OK ||
+        http_auth_digest_decode(field_value, digest) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err =
+        http_auth_verify(&auth, http_method_str(req->method), req->uri, field_value, key, sizeof(key) - 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return auth_seq_take(auth.seq);
+}
+
+static esp_err_t req_auth_send_err(httpd_req_t *req, esp_err_t err) {
+    switch (err) {
+    case ESP_ERR_NOT_SUPPORTED:
+        return httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "No key configured");
+    case ESP_ERR_INVALID_ARG:
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad digest field");
+    case ESP_ERR_NOT_FOUND:
+    case ESP_ERR_INVALID_CRC:
+    case ESP_ERR_INVALID_STATE:
+        httpd_resp_set_hdr(req, "WWW-Authenticate", HTTP_AUTH_SCHEME);
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED,
+                                   err == ESP_ERR_INVALID_STATE ? "Sequence number used" : "Not authorized");
+    default:
+        ESP_LOGE(TAG, "authorization failed: %s", esp_err_to_name(err));
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+    }
+}
+#endif // CONFIG_HTTPD_CONFIG_WRITE || CONFIG_HTTPD_OTA
+
+#define RUM_REPORT_MAX 2048
+
+// Unknown metrics are skipped, so the page may report more than the device keeps
+static void rum_record(const char *name, size_t len, double ms) {
+    // NaN fails every comparison, strtod() and half or single float CBOR both produce it
+    if (!isfinite(ms) || ms < 0 || ms > UINT32_MAX / 1000.0) {
+        return;
+    }
+
+    for (size_t i = 0; i < RUM_MAX; i++) {
+        if (strlen(rum_names[i]) == len && strncmp(name, rum_names[i], len) == 0) {
+            hist_add(&s_metrics.rum[i], (uint32_t)(ms * 1000));
+            return;
+        }
+    }
+}
+
+// Text batch: one "<metric> <milliseconds>" sample per line, as navigator.sendBeacon() sends it
+static void rum_parse_text(char *body) {
+    char *save = NULL;
+    for (char *line = strtok_r(body, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        char *value = strchr(line, ' ');
+        if (!value) {
+            continue;
+        }
+
+        char *end;
+        const double ms = strtod(value + 1, &end);
+        if (end != value + 1) {
+            rum_record(line, value - line, ms);
+        }
+    }
+}
+
+// CBOR batch: a map of metric names to arrays of milliseconds
+static esp_err_t rum_parse_cbor(const uint8_t *body, size_t len) {
+    cbor_reader_t r;
+    cbor_reader_init(&r, body, len);
+
+    size_t metrics;
+    if (cbor_get_map(&r, &metrics) != ESP_OK) {
+        return r.err;
+    }
+
+    for (size_t i = 0; metrics == CBOR_INDEFINITE ? !cbor_at_break(&r) : i < metrics; i++) {
+        const char *name;
+        size_t name_len, samples;
+        if (cbor_get_text(&r, &name, &name_len) != ESP_OK || cbor_get_array(&r, &samples) != ESP_OK) {
+            return r.err;
+        }
+
+        for (size_t j = 0; samples == CBOR_INDEFINITE ? !cbor_at_break(&r) : j < samples; j++) {
+            double ms;
+            if (cbor_get_double(&r, &ms) != ESP_OK) {
+                return r.err;
+            }
+            rum_record(name, name_len, ms);
+        }
+    }
+
+    return r.err;
+}
+
+// Batches from the web UI, text or CBOR
+static esp_err_t api_rum_post_handler(httpd_req_t *req) {
+    static char body[RUM_REPORT_MAX + 1];
+
+    if (unlikely(req->content_len > RUM_REPORT_MAX)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Report too large");
+    }
+
+    const size_t len = req->content_len;
+    ESP_RETURN_ON_ERROR(req_recv_body(req, body), TAG, "receiving report failed");
+
+    if (req_is_cbor(req)) {
+        if (rum_parse_cbor((const uint8_t *)body, len) != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed report");
+        }
+    } else {
+        rum_parse_text(body);
+    }
+    s_metrics.rum_reports++;
+
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static uint32_t cfg_get_uint(const cfg_field_t *f, const app_config_t *c) {
+    const uint8_t *p = (const uint8_t *)c + f->offset;
+
+    switch (f->type) {
+    case CFG_U16:
+        return *(const uint16_t *)p;
+    case CFG_U32:
+        return *(const uint32_t *)p;
+    case CFG_BOOL:
+        return *(const bool *)p;
+    default:
+        return 0;
+    }
+}
+
+#if CONFIG_HTTPD_CONFIG_WRITE
+#define CONFIG_BODY_MAX 512
+
+static esp_err_t cfg_set_uint(const cfg_field_t *f, app_config_t *c, uint64_t v) {
+    uint8_t *p = (uint8_t *)c + f->offset;
+
+    if (f->type == CFG_STR || v < f->min || v > f->max) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    switch (f->type) {
+    case CFG_U16:
+        *(uint16_t *)p = v;
+        break;
+    case CFG_U32:
+        *(uint32_t *)p = v;
+        break;
+    default:
+        *(bool *)p = v;
+        break;
+    }
+    return ESP_OK;
+}
+
+// Form values arrive as text whatever the type of the field
+static esp_err_t cfg_set_text(const cfg_field_t *f, app_config_t *c, const char *v, size_t len) {
+    if (f->type == CFG_STR) {
+        if (len < f->min || len > f->max || memchr(v, '\0', len)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        char *p = (char *)c + f->offset;
+        memcpy(p, v, len);
+        p[len] = '\0';
+        return f->charset && strspn(p, f->charset) != len ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+
+    if (f->type == CFG_BOOL && (cbor_text_eq(v, len, "true") || cbor_text_eq(v, len, "false"))) {
+        return cfg_set_uint(f, c, v[0] == 't');
+    }
+
+    char buf[12];
+    if (len == 0 || len >= sizeof(buf)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(buf, v, len);
+    buf[len] = '\0';
+
+    char *end;
+    const unsigned long long n = strtoull(buf, &end, 10);
+    if (*end || buf[0] == '-') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return cfg_set_uint(f, c, n);
+}
+
+static const cfg_field_t *cfg_find(const char *key, size_t len) {
+    for (size_t i = 0; i < CFG_FIELDS_COUNT; i++) {
+        if (cbor_text_eq(key, len, cfg_fields[i].key)) {
+            return &cfg_fields[i];
+        }
+    }
+    return NULL;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Decodes "+" and %XX in place, returns the new length
+static size_t form_decode(char *s, size_t len) {
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        const int hi = s[i] == '%' && i + 2 < len ? hex_digit(s[i + 1]) : -1;
+        const int lo = hi >= 0 ? hex_digit(s[i + 2]) : -1;
+        if (lo >= 0) {
+            s[out++] = hi << 4 | lo;
+            i += 2;
+        } else {
+            s[out++] = s[i] == '+' ? ' ' : s[i];
+        }
+    }
+    return out;
+}
+
+// application/x-www-form-urlencoded: "http_port=8080&keep_alive=false"
+static esp_err_t cfg_parse_form(char *body, app_config_t *c) {
+    char *save = NULL;
+    for (char *pair = strtok_r(body, "&", &save); pair; pair = strtok_r(NULL, "&", &save)) {
+        char *value = strchr(pair, '=');
+        if (!value) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        *value++ = '\0';
+
+        const size_t key_len = form_decode(pair, strlen(pair));
+        const cfg_field_t *f = cfg_find(pair, key_len);
+        if (!f) {
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        esp_err_t err = cfg_set_text(f, c, value, form_decode(value, strlen(value)));
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+// CBOR: a map of field names to text, unsigned or bool values
+static esp_err_t cfg_parse_cbor(const uint8_t *body, size_t len, app_config_t *c) {
+    cbor_reader_t r;
+    cbor_reader_init(&r, body, len);
+
+    size_t fields;
+    if (cbor_get_map(&r, &fields) != ESP_OK) {
+        return r.err;
+    }
+
+    for (size_t i = 0; fields == CBOR_INDEFINITE ? !cbor_at_break(&r) : i < fields; i++) {
+        const char *key;
+        size_t key_len;
+        if (cbor_get_text(&r, &key, &key_len) != ESP_OK) {
+            return r.err;
+        }
+
+        const cfg_field_t *f = cfg_find(key, key_len);
+        if (!f) {
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        esp_err_t err;
+        if (f->type == CFG_STR) {
+            const char *v;
+            size_t v_len;
+            err = cbor_get_text(&r, &v, &v_len);
+            if (err == ESP_OK) {
+                err = cfg_set_text(f, c, v, v_len);
+            }
+        } else if (f->type == CFG_BOOL) {
+            bool v;
+            err = cbor_get_bool(&r, &v);
+            if (err == ESP_OK) {
+                err = cfg_set_uint(f, c, v);
+            }
+        } else {
+            uint64_t v;
+            err = cbor_get_uint(&r, &v);
+            if (err == ESP_OK) {
+                err = cfg_set_uint(f, c, v);
+            }
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    return r.err;
+}
+#endif // CONFIG_HTTPD_CONFIG_WRITE
+
+static void api_config_write_json(json_writer_t *w) {
+    json_obj_begin(w);
+    for (size_t i = 0; i < CFG_FIELDS_COUNT; i++) {
+        const cfg_field_t *f = &cfg_fields[i];
+        if (f->secret) {
+            continue;
+        }
+        json_key(w, f->key);
+        if (f->type == CFG_STR) {
+            json_str(w, (const char *)&s_config + f->offset);
+        } else if (f->type == CFG_BOOL) {
+            json_bool(w, cfg_get_uint(f, &s_config));
+        } else {
+            json_uint(w, cfg_get_uint(f, &s_config));
+        }
+    }
+    json_key(w, "reboot_pending");
+    json_bool(w, s_config_reboot_pending);
+    json_obj_end(w);
+}
+
+static void api_config_write_cbor(cbor_writer_t *w) {
+    size_t count = 1;
+    for (size_t i = 0; i < CFG_FIELDS_COUNT; i++) {
+        count += !cfg_fields[i].secret;
+    }
+
+    cbor_put_map(w, count);
+    for (size_t i = 0; i < CFG_FIELDS_COUNT; i++) {
+        const cfg_field_t *f = &cfg_fields[i];
+        if (f->secret) {
+            continue;
+        }
+        cbor_put_text(w, f->key);
+        if (f->type == CFG_STR) {
+            cbor_put_text(w, (const char *)&s_config + f->offset);
+        } else if (f->type == CFG_BOOL) {
+            cbor_put_bool(w, cfg_get_uint(f, &s_config));
+        } else {
+            cbor_put_uint(w, cfg_get_uint(f, &s_config));
+        }
+    }
+    cbor_put_text(w, "reboot_pending");
+    cbor_put_bool(w, s_config_reboot_pending);
+}
+
+// A checksum of the fields /api/config shows, the secret ones left out
+static uint32_t api_config_crc() {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&s_config_reboot_pending, sizeof(s_config_reboot_pending));
+    for (size_t i = 0; i < CFG_FIELDS_COUNT; i++) {
+        const cfg_field_t *f = &cfg_fields[i];
+        if (f->secret) {
+            continue;
+        }
+        const uint8_t *value = (const uint8_t *)&s_config + f->offset;
+        crc = esp_rom_crc32_le(crc, value, f->type == CFG_STR ? strlen((const char *)value) + 1 : f->size);
+    }
+    return crc;
+}
+
+// With an ETag the settings may be kept and revalidated, without they are not stored at all
+static esp_err_t api_config_send(httpd_req_t *req, bool cbor, const char *etag) {
+    httpd_resp_set_type(req, cbor ? "application/cbor" : "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", etag ? "no-cache" : "no-store");
+    if (etag) {
+        httpd_resp_set_hdr(req, "ETag", etag);
+    }
+
+    http_stream_t *stream = resp_stream_begin(req);
+    if (cbor) {
+        cbor_writer_t w;
+        cbor_writer_init(&w, resp_stream_write, stream);
+        api_config_write_cbor(&w);
+    } else {
+        json_writer_t w;
+        json_writer_init(&w, resp_stream_write, stream);
+        api_config_write_json(&w);
+    }
+    return resp_stream_end(stream);
+}
+
+// Settings change rarely, a client that polls them gets a 304 until one does
+static esp_err_t api_config_get_handler(httpd_req_t *req) {
+    const bool cbor = resp_wants_cbor(req);
+    char etag[APP_ETAG_LEN + 16];
+    api_etag(etag, sizeof(etag), api_config_crc(), cbor);
+
+    const http_cond_result_t cond = http_cond_evaluate(req, etag, 0);
+    if (cond != HTTP_COND_NONE) {
+        return api_cond_send(req, cond, etag);
+    }
+
+    return api_config_send(req, cbor, etag);
+}
+
+#if CONFIG_HTTPD_CONFIG_WRITE
+// Validates the whole change before anything is stored, then applies each field the cheapest way it allows. Only
+// signed requests get that far, the body must match their Content-Digest.
+static esp_err_t api_config_patch_handler(httpd_req_t *req) {
+    static char body[CONFIG_BODY_MAX + 1];
+    static app_config_t next;
+
+    if (unlikely(req->content_len > CONFIG_BODY_MAX)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Config too large");
+    }
+
+    uint8_t digest[32];
+    esp_err_t err = req_authorize(req, "Content-Digest", digest);
+    if (err != ESP_OK) {
+        return req_auth_send_err(req, err);
+    }
+    ESP_RETURN_ON_ERROR(req_recv_body(req, body), TAG, "receiving config failed");
+
+    uint8_t sha256[32];
+    if (mbedtls_sha256((const unsigned char *)body, req->content_len, sha256, 0) != 0 ||
+        memcmp(sha256, digest, sizeof(sha256)) != 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Digest mismatch");
+    }
+
+    next = s_config;
+    err = req_is_cbor(req) ? cfg_parse_cbor((const uint8_t *)body, req->content_len, &next)
+                                     : cfg_parse_form(body, &next);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown config field");
+    }
+    if (err != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid config value");
+    }
+
+    uint8_t apply;
+    err = cfg_save(&next, &s_config, &apply);
+    if (unlikely(err != ESP_OK)) {
+        ESP_LOGE(TAG, "config not stored: %s", esp_err_to_name(err));
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Config not stored");
+    }
+
+    // WiFi keeps running with the old credentials, the server task keeps its settings until restarted
+    const bool hostname_changed = strcmp(next.mdns_name, s_config.mdns_name) != 0;
+    s_config = next;
+    if (apply & CFG_APPLY_REBOOT) {
+        s_config_reboot_pending = true;
+    }
+    if (hostname_changed && mdns_hostname_set(s_config.mdns_name) != ESP_OK) {
+        ESP_LOGW(TAG, "mdns_hostname_set failed");
+    }
+
+    err = api_config_send(req, resp_wants_cbor(req), NULL);
+
+    // Not from this handler: httpd_stop() waits for the server task, which is the one running it
+    if (apply & CFG_APPLY_SERVER) {
+        xTaskNotifyGive(s_server_restart_task);
+    }
+
+    return err;
+}
+#endif // CONFIG_HTTPD_CONFIG_WRITE
+
+#if CONFIG_HTTPD_OTA
+#define OTA_REBOOT_DELAY_MS 500
+
+static ota_stream_t s_ota;
+static uint8_t s_ota_digest[32]; // expected SHA-256 of the image, from the signed Repr-Digest
+static esp_timer_handle_t s_ota_reboot_timer = NULL;
+
+// Above the httpd task, which fills the buffers: a full one is written as soon as it is handed over
+static UBaseType_t ota_writer_priority() {
+    return s_config.task_priority < configMAX_PRIORITIES - 1 ? s_config.task_priority + 1 : configMAX_PRIORITIES - 1;
+}
+
+// "Content-Range: bytes <first>-<last>/<total>", a request without one carries the whole image
+static esp_err_t ota_parse_range(httpd_req_t *req, size_t *first, size_t *total) {
+    char value[64];
+    if (httpd_req_get_hdr_value_str(req, "Content-Range", value, sizeof(value)) != ESP_OK) {
+        *first = 0;
+        *total = req->content_len;
+        return ESP_OK;
+    }
+
+    unsigned long a, b, t;
+    if (sscanf(value, "bytes %lu-%lu/%lu", &a, &b, &t) != 3 || b < a || b >= t || b - a + 1 != req->content_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *first = a;
+    *total = t;
+    return ESP_OK;
+}
+
+static void ota_write_hex(json_writer_t *w, const uint8_t *data, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    json_str_begin(w);
+    for (size_t i = 0; i < len; i++) {
+        const char byte[2] = {hex[data[i] >> 4], hex[data[i] & 0xf]};
+        json_str_append(w, byte, 2);
+    }
+    json_str_end(w);
+}
+
+// Session state for resuming clients, plus the throughput of the request that is answered, if any
+static esp_err_t ota_send_status(httpd_req_t *req, const char *state, size_t bytes, int64_t elapsed_us,
+                                 const uint8_t *sha256) {
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    http_stream_t *stream = resp_stream_begin(req);
+    json_writer_t w;
+    json_writer_init(&w, resp_stream_write, stream);
+
+    json_obj_begin(&w);
+    json_key(&w, "state");
+    json_str(&w, state);
+    json_key(&w, "running");
+    json_str(&w, state_version());
+    // Host tools pick the base of a delta update by this
+    json_key(&w, "elf_sha256");
+    ota_write_hex(&w, esp_app_get_description()->app_elf_sha256, 32);
+    if (s_ota.partition) {
+        json_key(&w, "partition");
+        json_str(&w, s_ota.partition->label);
+        json_key(&w, "offset");
+        json_uint(&w, s_ota.offset);
+        json_key(&w, "total");
+        json_uint(&w, s_ota.total);
+        json_key(&w, "digest");
+        ota_write_hex(&w, s_ota_digest, sizeof(s_ota_digest));
+    }
+    if (sha256) {
+        json_key(&w, "sha256");
+        ota_write_hex(&w, sha256, 32);
+    }
+    if (bytes) {
+        json_key(&w, "bytes");
+        json_uint(&w, bytes);
+        json_key(&w, "elapsed_us");
+        json_int(&w, elapsed_us);
+        json_key(&w, "kb_per_s");
+        json_double(&w, elapsed_us ? bytes * 1000000.0 / 1024 / elapsed_us : 0, 4);
+        // Both near zero: receiving and writing overlapped, WiFi set the pace
+        json_key(&w, "flash_us");
+        json_int(&w, s_ota.flash_us);
+        json_key(&w, "wait_us");
+        json_int(&w, s_ota.wait_us);
+    }
+    json_obj_end(&w);
+
+    return resp_stream_end(stream);
+}
+
+static esp_err_t api_ota_get_handler(httpd_req_t *req) {
+    return ota_send_status(req, s_ota.partition ? "receiving" : "idle", 0, 0, NULL);
+}
+
+// Signed like PUT, with the Content-Digest of the empty body, so nobody else can drop a session that is meant to
+// be resumed
+static esp_err_t api_ota_delete_handler(httpd_req_t *req) {
+    uint8_t digest[32];
+    esp_err_t err = req_authorize(req, "Content-Digest", digest);
+    if (err != ESP_OK) {
+        return req_auth_send_err(req, err);
+    }
+
+    uint8_t empty[32];
+    if (req->content_len != 0 || mbedtls_sha256((const unsigned char *)"", 0, empty, 0) != 0 ||
+        memcmp(empty, digest, sizeof(empty)) != 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Digest mismatch");
+    }
+
+    ota_stream_abort(&s_ota);
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static void ota_reboot(void *arg) {
+    esp_restart();
+}
+
+// The new image must pass the checks of esp_ota_end(), match the signed digest and be built from the same
+// project
+static esp_err_t ota_finish(httpd_req_t *req, size_t bytes, int64_t elapsed_us) {
+    uint8_t sha256[32];
+    const esp_partition_t *partition;
+    esp_err_t err = ota_stream_end(&s_ota, sha256, &partition);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "ota image rejected: %s", esp_err_to_name(err));
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid image");
+    }
+    if (memcmp(sha256, s_ota_digest, sizeof(sha256)) != 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Digest mismatch");
+    }
+
+    esp_app_desc_t desc;
+    const esp_app_desc_t *running = esp_app_get_description();
+    if (esp_ota_get_partition_description(partition, &desc) != ESP_OK ||
+        strncmp(desc.project_name, running->project_name, sizeof(desc.project_name)) != 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image of another project");
+    }
+
+    ESP_RETURN_ON_ERROR(esp_ota_set_boot_partition(partition), TAG, "esp_ota_set_boot_partition failed");
+    ESP_LOGI(TAG, "ota: %s %s written to %s, restarting", desc.project_name, desc.version, partition->label);
+
+    err = ota_send_status(req, "done", bytes, elapsed_us, sha256);
+    esp_timer_start_once(s_ota_reboot_timer, OTA_REBOOT_DELAY_MS * 1000);
+    return err;
+}
+
+// Receives straight into the buffer the writer task does not flush at the moment. Every piece is signed over
+// the Repr-Digest of the whole image (RFC 9530), which the image is checked against before it boots. A range
+// starting at 0 begins a new image, any other must continue the session where it stopped, see GET /api/ota.
+static esp_err_t api_ota_put_handler(httpd_req_t *req) {
+    size_t first, total;
+    if (ota_parse_range(req, &first, &total) != ESP_OK || req->content_len == 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad Content-Range");
+    }
+
+    uint8_t digest[32];
+    esp_err_t err = req_authorize(req, "Repr-Digest", digest);
+    if (err != ESP_OK) {
+        return req_auth_send_err(req, err);
+    }
+
+    if (first == 0) {
+        err = ota_stream_begin(&s_ota, total);
+        if (err == ESP_ERR_INVALID_SIZE) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image does not fit");
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "ota begin failed: %s", esp_err_to_name(err));
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+        }
+
+        memcpy(s_ota_digest, digest, sizeof(s_ota_digest));
+    } else if (!s_ota.partition || first != s_ota.offset || total != s_ota.total ||
+               memcmp(digest, s_ota_digest, sizeof(digest)) != 0) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return ota_send_status(req, s_ota.partition ? "receiving" : "idle", 0, 0, NULL);
+    }
+
+    const int64_t start = esp_timer_get_time();
+    const int64_t flash_us = s_ota.flash_us;
+    const int64_t wait_us = s_ota.wait_us;
+    size_t left = req->content_len;
+
+    while (left && err == ESP_OK) {
+        size_t room;
+        char *buf = (char *)ota_stream_buf(&s_ota, &room);
+        int ret = httpd_req_recv(req, buf, room < left ? room : left);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (ret <= 0) {
+            // Keep what arrived, the client resumes at the offset GET /api/ota reports
+            ota_stream_flush(&s_ota);
+            ESP_LOGW(TAG, "ota interrupted at %zu of %zu bytes", s_ota.offset, s_ota.total);
+            return ESP_FAIL;
+        }
+
+        err = ota_stream_commit(&s_ota, ret);
+        left -= ret;
+    }
+
+    if (err == ESP_OK && s_ota.offset < s_ota.total) {
+        err = ota_stream_flush(&s_ota);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ota write failed: %s", esp_err_to_name(err));
+        ota_stream_abort(&s_ota);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+    }
+
+    // Per request figures, the session counters keep growing
+    const int64_t elapsed_us = esp_timer_get_time() - start;
+    s_ota.flash_us -= flash_us;
+    s_ota.wait_us -= wait_us;
+    if (s_ota.offset == s_ota.total) {
+        return ota_finish(req, req->content_len, elapsed_us);
+    }
+
+    err = ota_send_status(req, "receiving", req->content_len, elapsed_us, NULL);
+    s_ota.flash_us += flash_us;
+    s_ota.wait_us += wait_us;
+    return err;
+}
+
+// The body is a raw deflate compressed patch against the running image, see ota_delta.h. Signed like PUT
+// /api/ota, over the Repr-Digest of the image the patch rebuilds: the base hash in the patch only selects the
+// image it applies to. Patches are small, a failed one is sent again instead of resumed.
+static esp_err_t api_ota_delta_put_handler(httpd_req_t *req) {
+    static ota_delta_t delta;
+    static char buf[1024];
+
+    if (req->content_len == 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty patch");
+    }
+
+    uint8_t digest[32];
+    esp_err_t err = req_authorize(req, "Repr-Digest", digest);
+    if (err != ESP_OK) {
+        return req_auth_send_err(req, err);
+    }
+
+    ota_delta_begin(&delta, &s_ota, esp_ota_get_running_partition(), esp_app_get_description()->app_elf_sha256);
+    gunzip_inflate_begin();
+
+    const int64_t start = esp_timer_get_time();
+    size_t left = req->content_len;
+
+    while (left && err == ESP_OK) {
+        int ret = httpd_req_recv(req, buf, left < sizeof(buf) ? left : sizeof(buf));
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (ret <= 0) {
+            ota_stream_abort(&s_ota);
+            return ESP_FAIL;
+        }
+
+        left -= ret;
+        err = gunzip_inflate_push((const uint8_t *)buf, ret, left == 0, ota_delta_feed, &delta);
+    }
+
+    if (err == ESP_OK && !ota_delta_complete(&delta)) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err != ESP_OK) {
+        ota_stream_abort(&s_ota);
+        ESP_LOGW(TAG, "ota patch rejected: %s", esp_err_to_name(err));
+        if (err == ESP_ERR_NOT_FOUND) {
+            httpd_resp_set_status(req, "409 Conflict");
+            return ota_send_status(req, "idle", 0, 0, NULL);
+        }
+        if (err == ESP_ERR_NOT_SUPPORTED) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No update partition");
+        }
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid patch");
+    }
+
+    // Checked by ota_finish(), whatever hash the patch carries
+    memcpy(s_ota_digest, digest, sizeof(s_ota_digest));
+    ESP_LOGI(TAG, "ota: %zu byte patch rebuilt a %zu byte image", req->content_len, delta.size);
+    return ota_finish(req, req->content_len, esp_timer_get_time() - start);
+}
+
+static esp_err_t ota_start() {
+    ESP_RETURN_ON_ERROR(ota_stream_init(&s_ota, ota_writer_priority()), TAG, "ota_stream_init failed");
+
+    const esp_timer_create_args_t args = {
+        .callback = ota_reboot,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ota_reboot",
+    };
+    return esp_timer_create(&args, &s_ota_reboot_timer);
+}
+#endif // CONFIG_HTTPD_OTA
+
+#if CONFIG_HTTPD_SCHED
+#define SCHED_BODY_MAX 1024
+#define SCHED_CLOCK_VALID 1600000000 // earlier wall clock seconds mean SNTP has not synced yet
+#define SCHED_HORIZON_US (366LL * 24 * 3600 * 1000000) // farthest due time, keeps at_us far from overflowing
+#define SCHED_MS_MAX 1e15                              // ms * 1000 stays well inside int64_t
+#define SCHED_LOCK_RETRY_US 1000
+
+typedef enum {
+    SCHED_LED_OFF,
+    SCHED_LED_ON,
+    SCHED_ACTION_MAX,
+} sched_action_t;
+
+static const char *const sched_action_names[SCHED_ACTION_MAX] = {"off", "on"};
+
+// Shared by the httpd task and the esp_timer task
+static cmd_sched_entry_t s_sched_entries[CONFIG_HTTPD_SCHED_CAPACITY];
+static cmd_sched_t s_sched;
+static SemaphoreHandle_t s_sched_lock = NULL;
+static StaticSemaphore_t s_sched_lock_buf;
+static esp_timer_handle_t s_sched_timer = NULL;
+static hist_t s_sched_late; // microseconds past the due time
+
+// A parsed request, checked as a whole before anything is scheduled
+typedef struct {
+    int64_t at_us[CONFIG_HTTPD_SCHED_CAPACITY];
+    uint8_t action[CONFIG_HTTPD_SCHED_CAPACITY];
+    size_t len;
+    int64_t now_us;  // esp_timer base of relative times
+    int64_t wall_us; // wall clock at now_us, 0 if not synced
+} sched_batch_t;
+
+// One timer for the whole schedule, always armed for the earliest entry. Call with the lock held.
+static void sched_arm() {
+    esp_timer_stop(s_sched_timer); // fails harmlessly when not running
+
+    const cmd_sched_entry_t *next = cmd_sched_peek(&s_sched);
+    if (next) {
+        const int64_t delay = next->at_us - esp_timer_get_time();
+        esp_timer_start_once(s_sched_timer, delay > 0 ? delay : 0);
+    }
+}
+
+// Runs on the shared esp_timer task, which must not block: with the lock taken by a handler it tries again shortly
+static void sched_timer_cb(void *arg) {
+    if (xSemaphoreTake(s_sched_lock, 0) != pdTRUE) {
+        esp_timer_start_once(s_sched_timer, SCHED_LOCK_RETRY_US); // already armed if the handler re-armed it
+        return;
+    }
+
+    const cmd_sched_entry_t *next;
+    cmd_sched_entry_t e;
+    while ((next = cmd_sched_peek(&s_sched)) && next->at_us <= esp_timer_get_time() && cmd_sched_pop(&s_sched, &e)) {
+        led_set(e.action == SCHED_LED_ON);
+        hist_add(&s_sched_late, esp_timer_get_time() - e.at_us);
+    }
+    sched_arm();
+
+    xSemaphoreGive(s_sched_lock);
+}
+
+static esp_err_t sched_add(sched_batch_t *batch, char kind, double ms, const char *action, size_t action_len) {
+    if (batch->len == CONFIG_HTTPD_SCHED_CAPACITY || !(ms >= 0 && ms < SCHED_MS_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t delay_us;
+    if (kind == '+') {
+        delay_us = (int64_t)(ms * 1000);
+    } else if (kind == '@') {
+        if (!batch->wall_us) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        // Mapped onto the monotonic clock once, later clock steps do not move the entry
+        delay_us = (int64_t)(ms * 1000) - batch->wall_us;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (delay_us > SCHED_HORIZON_US) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Times in the past run right away, and do not count as late
+    const int64_t at_us = batch->now_us + (delay_us > 0 ? delay_us : 0);
+
+    for (size_t i = 0; i < SCHED_ACTION_MAX; i++) {
+        if (strlen(sched_action_names[i]) == action_len && strncmp(action, sched_action_names[i], action_len) == 0) {
+            batch->at_us[batch->len] = at_us;
+            batch->action[batch->len++] = i;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_INVALID_ARG;
+}
+
+// Text: one "+<ms> <action>" (relative to the request) or "@<ms since the epoch> <action>" per line
+static esp_err_t sched_parse_text(char *body, sched_batch_t *batch) {
+    char *save = NULL;
+    for (char *line = strtok_r(body, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        char *end;
+        const double ms = strtod(line + 1, &end);
+        if (end == line + 1 || *end != ' ') {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        const char *action = end + 1;
+        const size_t action_len = strcspn(action, "\r");
+        esp_err_t err = sched_add(batch, line[0], ms, action, action_len);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    return ESP_OK;
+}
+
+// CBOR: an array of maps with "in" (ms from now) or "at" (ms since the epoch), and "action"
+static esp_err_t sched_parse_cbor(const uint8_t *body, size_t len, sched_batch_t *batch) {
+    cbor_reader_t r;
+    cbor_reader_init(&r, body, len);
+
+    size_t entries;
+    if (cbor_get_array(&r, &entries) != ESP_OK) {
+        return r.err;
+    }
+
+    for (size_t i = 0; entries == CBOR_INDEFINITE ? !cbor_at_break(&r) : i < entries; i++) {
+        size_t fields;
+        if (cbor_get_map(&r, &fields) != ESP_OK) {
+            return r.err;
+        }
+
+        char kind = 0;
+        double ms = -1;
+        const char *action = NULL;
+        size_t action_len = 0;
+        for (size_t j = 0; fields == CBOR_INDEFINITE ? !cbor_at_break(&r) : j < fields; j++) {
+            const char *key;
+            size_t key_len;
+            if (cbor_get_text(&r, &key, &key_len) != ESP_OK) {
+                return r.err;
+            }
+
+            if (cbor_text_eq(key, key_len, "in") || cbor_text_eq(key, key_len, "at")) {
+                kind = key[0] == 'i' ? '+' : '@';
+                cbor_get_double(&r, &ms);
+            } else if (cbor_text_eq(key, key_len, "action")) {
+                cbor_get_text(&r, &action, &action_len);
+            } else {
+                cbor_skip(&r);
+            }
+            if (r.err != ESP_OK) {
+                return r.err;
+            }
+        }
+
+        esp_err_t err = sched_add(batch, kind, ms, action ? action : "", action_len);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    return r.err;
+}
+
+static int sched_entry_cmp(const void *a, const void *b) {
+    const cmd_sched_entry_t *x = a, *y = b;
+    if (x->at_us != y->at_us) {
+        return x->at_us < y->at_us ? -1 : 1;
+    }
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+// Schedules all entries of the body or none of them, answers with their ids in order
+static esp_err_t api_schedule_post_handler(httpd_req_t *req) {
+    static char body[SCHED_BODY_MAX + 1];
+    static sched_batch_t batch;
+    static uint32_t ids[CONFIG_HTTPD_SCHED_CAPACITY];
+
+    if (unlikely(req->content_len > SCHED_BODY_MAX)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Schedule too large");
+    }
+    ESP_RETURN_ON_ERROR(req_recv_body(req, body), TAG, "receiving schedule failed");
+
+    // Relative times count from the end of the request, the same T for every entry
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    batch.len = 0;
+    batch.now_us = esp_timer_get_time();
+    batch.wall_us = tv.tv_sec >= SCHED_CLOCK_VALID ? tv.tv_sec * 1000000LL + tv.tv_usec : 0;
+
+    esp_err_t err = req_is_cbor(req) ? sched_parse_cbor((const uint8_t *)body, req->content_len, &batch)
+                                     : sched_parse_text(body, &batch);
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "Clock not synchronized", HTTPD_RESP_USE_STRLEN);
+    }
+    if (err != ESP_OK || batch.len == 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed schedule");
+    }
+
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    const bool fits = s_sched.cap - s_sched.len >= batch.len;
+    if (fits) {
+        for (size_t i = 0; i < batch.len; i++) {
+            ids[i] = cmd_sched_push(&s_sched, batch.at_us[i], batch.action[i]);
+        }
+        sched_arm();
+    }
+    xSemaphoreGive(s_sched_lock);
+
+    if (!fits) {
+        httpd_resp_set_status(req, "507 Insufficient Storage");
+        return httpd_resp_send(req, "Schedule full", HTTPD_RESP_USE_STRLEN);
+    }
+
+    const bool cbor = resp_wants_cbor(req);
+    httpd_resp_set_status(req, "201 Created");
+    httpd_resp_set_type(req, cbor ? "application/cbor" : "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    http_stream_t *stream = resp_stream_begin(req);
+    if (cbor) {
+        cbor_writer_t w;
+        cbor_writer_init(&w, resp_stream_write, stream);
+        cbor_put_map(&w, 1);
+        cbor_put_text(&w, "ids");
+        cbor_put_array(&w, batch.len);
+        for (size_t i = 0; i < batch.len; i++) {
+            cbor_put_uint(&w, ids[i]);
+        }
+    } else {
+        json_writer_t w;
+        json_writer_init(&w, resp_stream_write, stream);
+        json_obj_begin(&w);
+        json_key(&w, "ids");
+        json_arr_begin(&w);
+        for (size_t i = 0; i < batch.len; i++) {
+            json_uint(&w, ids[i]);
+        }
+        json_arr_end(&w);
+        json_obj_end(&w);
+    }
+    return resp_stream_end(stream);
+}
+
+// Pending entries in due order, with the time left until each, and how late past entries ran
+static esp_err_t api_schedule_get_handler(httpd_req_t *req) {
+    static cmd_sched_entry_t entries[CONFIG_HTTPD_SCHED_CAPACITY];
+
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    const size_t count = s_sched.len;
+    memcpy(entries, s_sched.entries, count * sizeof(entries[0]));
+    const hist_t late = s_sched_late;
+    xSemaphoreGive(s_sched_lock);
+
+    qsort(entries, count, sizeof(entries[0]), sched_entry_cmp);
+    const int64_t now = esp_timer_get_time();
+    const uint32_t late_p50 = hist_percentile(&late, 500);
+    const uint32_t late_p99 = hist_percentile(&late, 990);
+
+    const bool cbor = resp_wants_cbor(req);
+    httpd_resp_set_type(req, cbor ? "application/cbor" : "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    http_stream_t *stream = resp_stream_begin(req);
+    if (cbor) {
+        cbor_writer_t w;
+        cbor_writer_init(&w, resp_stream_write, stream);
+        cbor_put_map(&w, 2);
+        cbor_put_text(&w, "entries");
+        cbor_put_array(&w, count);
+        for (size_t i = 0; i < count; i++) {
+            cbor_put_map(&w, 3);
+            cbor_put_text(&w, "id");
+            cbor_put_uint(&w, entries[i].id);
+            cbor_put_text(&w, "action");
+            cbor_put_text(&w, sched_action_names[entries[i].action]);
+            cbor_put_text(&w, "in_us");
+            cbor_put_int(&w, entries[i].at_us - now);
+        }
+        cbor_put_text(&w, "late_us");
+        cbor_put_map(&w, 4);
+        cbor_put_text(&w, "count");
+        cbor_put_uint(&w, late.count);
+        cbor_put_text(&w, "p50");
+        cbor_put_uint(&w, late_p50);
+        cbor_put_text(&w, "p99");
+        cbor_put_uint(&w, late_p99);
+        cbor_put_text(&w, "max");
+        cbor_put_uint(&w, late.max);
+    } else {
+        json_writer_t w;
+        json_writer_init(&w, resp_stream_write, stream);
+        json_obj_begin(&w);
+        json_key(&w, "entries");
+        json_arr_begin(&w);
+        for (size_t i = 0; i < count; i++) {
+            json_obj_begin(&w);
+            json_key(&w, "id");
+            json_uint(&w, entries[i].id);
+            json_key(&w, "action");
+            json_str(&w, sched_action_names[entries[i].action]);
+            json_key(&w, "in_us");
+            json_int(&w, entries[i].at_us - now);
+            json_obj_end(&w);
+        }
+        json_arr_end(&w);
+        json_key(&w, "late_us");
+        json_obj_begin(&w);
+        json_key(&w, "count");
+        json_uint(&w, late.count);
+        json_key(&w, "p50");
+        json_uint(&w, late_p50);
+        json_key(&w, "p99");
+        json_uint(&w, late_p99);
+        json_key(&w, "max");
+        json_uint(&w, late.max);
+        json_obj_end(&w);
+        json_obj_end(&w);
+    }
+    return resp_stream_end(stream);
+}
+
+// ?id=<id> cancels one entry, no query clears the schedule
+static esp_err_t api_schedule_delete_handler(httpd_req_t *req) {
+    char query[32];
+    char value[12];
+    const bool one = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                     httpd_query_key_value(query, "id", value, sizeof(value)) == ESP_OK;
+
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    bool found = true;
+    if (one) {
+        found = cmd_sched_cancel(&s_sched, strtoul(value, NULL, 10));
+    } else {
+        s_sched.len = 0;
+    }
+    sched_arm();
+    xSemaphoreGive(s_sched_lock);
+
+    if (!found) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such entry");
+    }
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static void sched_stop() {
+    esp_timer_stop(s_sched_timer);
+    esp_timer_delete(s_sched_timer);
+    s_sched_timer = NULL;
+}
+
+static esp_err_t sched_start() {
+    cmd_sched_init(&s_sched, s_sched_entries, CONFIG_HTTPD_SCHED_CAPACITY);
+    s_sched_lock = xSemaphoreCreateMutexStatic(&s_sched_lock_buf);
+
+    const esp_timer_create_args_t args = {
+        .callback = sched_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sched",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&args, &s_sched_timer), TAG, "esp_timer_create failed");
+    DEFER(sched_stop);
+
+#if !CONFIG_IDF_TARGET_LINUX
+    // Absolute times need the wall clock, devices sharing a show sync it from the same servers. The host
+    // keeps its own.
+    if (sizeof(CONFIG_HTTPD_SNTP_SERVER) > 1) {
+        esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_HTTPD_SNTP_SERVER);
+        ESP_RETURN_ON_ERROR(esp_netif_sntp_init(&config), TAG, "esp_netif_sntp_init failed");
+        DEFER(esp_netif_sntp_deinit);
+    }
+#endif
+
+    return ESP_OK;
+}
+#endif // CONFIG_HTTPD_SCHED
+
+#if CONFIG_HTTPD_RECORD
+#define RECORD_URI_LEN 48
+
+enum {
+    RECORD_INM = 1 << 0,   // If-None-Match
+    RECORD_IMS = 1 << 1,   // If-Modified-Since
+    RECORD_RANGE = 1 << 2, // Range
+    RECORD_DICT = 1 << 3,  // Available-Dictionary
+    RECORD_CBOR = 1 << 4,  // prefers application/cbor
+};
+
+// Accept-Encoding reduced to the codings the server can answer with
+static const char *const record_codings[] = {"gzip", "br", "dcb", "dcz"};
+
+typedef struct {
+    int64_t at_us;            // handler start
+    uint32_t dur_us;          // handler time
+    uint32_t req_bytes;       // request body
+    uint32_t resp_bytes;      // response on the wire, head included
+    uint16_t conn;            // connection number, not the address
+    uint16_t status;
+    uint8_t method;
+    uint8_t flags;            // RECORD_*
+    uint8_t codings;          // bits of record_codings
+    char uri[RECORD_URI_LEN]; // path without the query
+} record_t;
+
+// Handlers run one at a time on the httpd task, the ring needs no lock
+static struct {
+    record_t ring[CONFIG_HTTPD_RECORD_LEN];
+    uint32_t total; // recorded since boot or the last clear
+    record_t *cur;  // request in progress, record_send() counts its response
+    uint16_t conns;
+    httpd_uri_t *uris; // the registered handlers, record_handler() runs in front of them
+    size_t uris_len;
+    size_t uris_cap;
+} s_rec;
+
+// What httpd sends by default, plus the count
+static int record_send(httpd_handle_t hd, int sockfd, const char *buf, size_t len, int flags) {
+    if (unlikely(!buf)) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+
+    const int ret = send(sockfd, buf, len, flags);
+    if (ret < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? HTTPD_SOCK_ERR_TIMEOUT
+                                                                         : HTTPD_SOCK_ERR_FAIL;
+    }
+
+    record_t *r = s_rec.cur;
+    if (r) {
+        // A response starts with its status line
+        if (!r->resp_bytes && ret >= 12 && memcmp(buf, "HTTP/1.", 7) == 0) {
+            r->status = atoi(buf + 9);
+        }
+        r->resp_bytes += ret;
+    }
+    return ret;
+}
+
+static void record_conn_free(void *ctx) {
+    // The context is the connection number itself
+}
+
+// Numbers connections in order of their first request, the replay opens one per number
+static uint16_t record_conn(httpd_req_t *req) {
+    if (!req->sess_ctx) {
+        if (++s_rec.conns == 0) {
+            s_rec.conns = 1;
+        }
+        req->sess_ctx = (void *)(uintptr_t)s_rec.conns;
+        req->free_ctx = record_conn_free;
+        httpd_sess_set_send_override(req->handle, httpd_req_to_sockfd(req), record_send);
+    }
+    return (uintptr_t)req->sess_ctx;
+}
+
+static esp_err_t record_handler(httpd_req_t *req) {
+    const httpd_uri_t *uri = req->user_ctx;
+    req->user_ctx = uri->user_ctx;
+
+    record_t *r = &s_rec.ring[s_rec.total % CONFIG_HTTPD_RECORD_LEN];
+    memset(r, 0, sizeof(*r));
+    r->at_us = esp_timer_get_time();
+    r->conn = record_conn(req);
+    r->method = req->method;
+    r->req_bytes = req->content_len;
+
+    const size_t len = strcspn(req->uri, "?");
+    memcpy(r->uri, req->uri, len < RECORD_URI_LEN - 1 ? len : RECORD_URI_LEN - 1);
+
+    r->flags = (httpd_req_get_hdr_value_len(req, "If-None-Match") ? RECORD_INM : 0) |
+               (httpd_req_get_hdr_value_len(req, "If-Modified-Since") ? RECORD_IMS : 0) |
+               (httpd_req_get_hdr_value_len(req, "Range") ? RECORD_RANGE : 0) |
+               (httpd_req_get_hdr_value_len(req, "Available-Dictionary") ? RECORD_DICT : 0) |
+               (http_prefers_type(req, "application/cbor", "application/json") ? RECORD_CBOR : 0);
+    for (size_t i = 0; i < sizeof(record_codings) / sizeof(record_codings[0]); i++) {
+        if (http_accepts_encoding(req, record_codings[i])) {
+            r->codings |= 1 << i;
+        }
+    }
+
+    s_rec.cur = r;
+    const esp_err_t err = uri->handler(req);
+    s_rec.cur = NULL;
+
+    r->dur_us = esp_timer_get_time() - r->at_us;
+    s_rec.total++;
+    return err;
+}
+
+static const char *record_method_name(uint8_t method) {
+    switch (method) {
+    case HTTP_GET:
+        return "GET";
+    case HTTP_HEAD:
+        return "HEAD";
+    case HTTP_POST:
+        return "POST";
+    case HTTP_PUT:
+        return "PUT";
+    case HTTP_PATCH:
+        return "PATCH";
+    case HTTP_DELETE:
+        return "DELETE";
+    default:
+        return "OTHER";
+    }
+}
+
+static void record_write(json_writer_t *w, const record_t *r) {
+    json_obj_begin(w);
+    json_key(w, "at_us");
+    json_int(w, r->at_us);
+    json_key(w, "conn");
+    json_uint(w, r->conn);
+    json_key(w, "method");
+    json_str(w, record_method_name(r->method));
+    json_key(w, "uri");
+    json_str(w, r->uri);
+    json_key(w, "status");
+    json_uint(w, r->status);
+    json_key(w, "req_bytes");
+    json_uint(w, r->req_bytes);
+    json_key(w, "resp_bytes");
+    json_uint(w, r->resp_bytes);
+    json_key(w, "dur_us");
+    json_uint(w, r->dur_us);
+    json_key(w, "inm");
+    json_bool(w, r->flags & RECORD_INM);
+    json_key(w, "ims");
+    json_bool(w, r->flags & RECORD_IMS);
+    json_key(w, "range");
+    json_bool(w, r->flags & RECORD_RANGE);
+    json_key(w, "dict");
+    json_bool(w, r->flags & RECORD_DICT);
+    json_key(w, "cbor");
+    json_bool(w, r->flags & RECORD_CBOR);
+    json_key(w, "ae");
+    json_arr_begin(w);
+    for (size_t i = 0; i < sizeof(record_codings) / sizeof(record_codings[0]); i++) {
+        if (r->codings & (1 << i)) {
+            json_str(w, record_codings[i]);
+        }
+    }
+    json_arr_end(w);
+    json_obj_end(w);
+}
+
+// Not recorded itself, exporting would otherwise show up in the next export
+static esp_err_t api_record_get_handler(httpd_req_t *req) {
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    const uint32_t total = s_rec.total;
+    const uint32_t count = total < CONFIG_HTTPD_RECORD_LEN ? total : CONFIG_HTTPD_RECORD_LEN;
+
+    http_stream_t *stream = resp_stream_begin(req);
+    json_writer_t w;
+    json_writer_init(&w, resp_stream_write, stream);
+
+    json_obj_begin(&w);
+    json_key(&w, "now_us");
+    json_int(&w, esp_timer_get_time());
+    json_key(&w, "recorded");
+    json_uint(&w, total);
+    json_key(&w, "dropped");
+    json_uint(&w, total - count);
+    json_key(&w, "entries");
+    json_arr_begin(&w);
+    for (uint32_t i = total - count; i < total; i++) {
+        record_write(&w, &s_rec.ring[i % CONFIG_HTTPD_RECORD_LEN]);
+    }
+    json_arr_end(&w);
+    json_obj_end(&w);
+
+    return resp_stream_end(stream);
+}
+
+static esp_err_t api_record_delete_handler(httpd_req_t *req) {
+    s_rec.total = 0;
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
+#endif // CONFIG_HTTPD_RECORD
+
+// Every handler is registered through here, so the recorder can run in front of it
+static esp_err_t server_register(const httpd_uri_t *uri) {
+#if CONFIG_HTTPD_RECORD
+    if (unlikely(s_rec.uris_len >= s_rec.uris_cap)) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    httpd_uri_t *orig = &s_rec.uris[s_rec.uris_len++];
+    *orig = *uri;
+
+    httpd_uri_t wrapped = *uri;
+    wrapped.handler = record_handler;
+    wrapped.user_ctx = orig;
+    return httpd_register_uri_handler(s_server, &wrapped);
+#else
+    return httpd_register_uri_handler(s_server, uri);
+#endif
+}
+
+static esp_err_t register_web_assets() {
+    for (size_t i = 0; i < web_assets_count; i++) {
+        const httpd_uri_t get_uri = {.uri = web_assets[i].uri,
+                                     .method = HTTP_GET,
+                                     .handler = static_get_handler,
+                                     .user_ctx = (void *)&web_assets[i]};
+        ESP_RETURN_ON_ERROR(server_register(&get_uri), TAG, "httpd_register_uri_handler failed");
+
+        const httpd_uri_t head_uri = {.uri = web_assets[i].uri,
+                                      .method = HTTP_HEAD,
+                                      .handler = static_get_handler,
+                                      .user_ctx = (void *)&web_assets[i]};
+        ESP_RETURN_ON_ERROR(server_register(&head_uri), TAG, "httpd_register_uri_handler failed");
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t stop_webserver() {
+    if (!s_server) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "stopping webserver");
+    ESP_RETURN_ON_ERROR(httpd_stop(s_server), TAG, "httpd_stop failed");
+    s_server = NULL;
+    return ESP_OK;
+}
+
+typedef struct {
+    httpd_uri_t uri;
+    bool recorded; // false for the endpoints of the recorder itself
+} api_route_t;
+
+static const api_route_t s_api_routes[] = {
+#define API_ROUTE(path, m, fn, rec) {.uri = {.uri = path, .method = m, .handler = fn}, .recorded = rec},
+#include "api_routes.h"
+#undef API_ROUTE
+};
+
+#define API_ROUTES_COUNT (sizeof(s_api_routes) / sizeof(s_api_routes[0]))
+
+// Starts s_server with the current s_config, restartable without touching WiFi or mDNS
+static esp_err_t server_start() {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+
+    config.server_port = s_config.http_port;
+
+    config.lru_purge_enable = s_config.lru_purge;
+    config.max_open_sockets = s_config.max_sockets;
+
+    config.recv_wait_timeout = s_config.recv_timeout;
+    config.send_wait_timeout = s_config.send_timeout;
+
+    config.keep_alive_enable = s_config.keep_alive;
+
+    config.stack_size = s_config.stack_size;
+    config.max_uri_handlers = web_assets_count * 2 + API_ROUTES_COUNT; // GET and HEAD per asset
+    config.max_resp_headers = RESP_HDRS_MAX; // a static asset sets up to 9, the default is 8
+
+    config.task_priority = s_config.task_priority;
+
+#if CONFIG_HTTPD_RECORD
+    // Sized once, max_uri_handlers stays the same across restarts
+    if (!s_rec.uris) {
+        s_rec.uris = calloc(config.max_uri_handlers, sizeof(httpd_uri_t));
+        if (unlikely(!s_rec.uris)) {
+            return ESP_ERR_NO_MEM;
+        }
+        s_rec.uris_cap = config.max_uri_handlers;
+    }
+    s_rec.uris_len = 0;
+#endif
+
+    ESP_LOGI(TAG, "starting server on port: '%d'", config.server_port);
+    ESP_RETURN_ON_ERROR(httpd_start(&s_server, &config), TAG, "httpd_start failed");
+
+    ESP_RETURN_ON_ERROR(register_web_assets(), TAG, "register_web_assets failed");
+
+#if CONFIG_HTTPD_BENCH
+    bench_chunk_init();
+#endif
+
+    for (size_t i = 0; i < API_ROUTES_COUNT; i++) {
+        const api_route_t *r = &s_api_routes[i];
+        ESP_RETURN_ON_ERROR(r->recorded ? server_register(&r->uri) : httpd_register_uri_handler(s_server, &r->uri),
+                            TAG, "httpd_register_uri_handler failed");
+    }
+
+    return ESP_OK;
+}
+
+#if CONFIG_HTTPD_CONFIG_WRITE
+#define SERVER_RESTART_DELAY_MS 100
+
+// Applies server settings changed over /api/config, once the response that changed them is out. Settings
+// the server does not start with are rolled back, in RAM and in NVS, so the device stays reachable.
+static void server_restart_task(void *arg) {
+    app_config_t running = s_config;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(SERVER_RESTART_DELAY_MS));
+
+        esp_err_t err = stop_webserver();
+        if (err == ESP_OK) {
+            err = server_start();
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "server restart failed: %s, rolling back", esp_err_to_name(err));
+            stop_webserver();
+
+            app_config_t next = s_config;
+            for (size_t i = 0; i < CFG_FIELDS_COUNT; i++) {
+                const cfg_field_t *f = &cfg_fields[i];
+                if (f->apply & CFG_APPLY_SERVER) {
+                    memcpy((uint8_t *)&next + f->offset, (const uint8_t *)&running + f->offset, f->size);
+                }
+            }
+            uint8_t apply;
+            if (cfg_save(&next, &s_config, &apply) != ESP_OK) {
+                ESP_LOGW(TAG, "config rollback not stored");
+            }
+            s_config = next;
+
+            if (server_start() != ESP_OK) {
+                ESP_LOGE(TAG, "server restart with the previous config failed");
+                continue;
+            }
+        }
+        running = s_config;
+#if CONFIG_HTTPD_OTA
+        vTaskPrioritySet(s_ota.writer, ota_writer_priority());
+#endif
+
+        if (mdns_service_port_set("_http", "_tcp", s_config.http_port) != ESP_OK) {
+            ESP_LOGW(TAG, "mdns_service_port_set failed");
+        }
+    }
+}
+
+static void server_restart_stop() {
+    vTaskDelete(s_server_restart_task);
+    s_server_restart_task = NULL;
+}
+#endif // CONFIG_HTTPD_CONFIG_WRITE
+
+static esp_err_t start_webserver() {
+#if CONFIG_HTTPD_CONFIG_WRITE
+    if (xTaskCreate(server_restart_task, "httpd_restart", 3072, NULL, tskIDLE_PRIORITY + 2, &s_server_restart_task) !=
+        pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    DEFER(server_restart_stop);
+#endif
+
+    DEFER(stop_webserver);
+    return server_start();
+}
+
+#if CONFIG_HTTPD_UDP_CMD
+#define UDP_CMD_TXT_VERSION "1"
+
+#define UDP_CMD_SEQ_KEY "udp_seq"
+
+static int s_udp_cmd_sock = -1;
+static nvs_handle_t s_udp_cmd_nvs = 0;
+static uint64_t s_udp_cmd_reserved; // persisted floor, every executed number is at or below it
+
+// Committed before the command runs, a reboot right after it still refuses a replay
+static esp_err_t udp_cmd_reserve(uint64_t seq) {
+    const uint64_t reserved =
+        seq > UINT64_MAX - CONFIG_HTTPD_UDP_CMD_SEQ_RESERVE ? UINT64_MAX : seq + CONFIG_HTTPD_UDP_CMD_SEQ_RESERVE;
+
+    ESP_RETURN_ON_ERROR(nvs_set_u64(s_udp_cmd_nvs, UDP_CMD_SEQ_KEY, reserved), TAG, "nvs_set_u64 failed");
+    ESP_RETURN_ON_ERROR(nvs_commit(s_udp_cmd_nvs), TAG, "nvs_commit failed");
+    s_udp_cmd_reserved = reserved;
+    return ESP_OK;
+}
+
+// Executes a fresh command, returns the ack status
+static uint8_t udp_cmd_execute(const udp_cmd_t *cmd) {
+    switch (cmd->command) {
+    case UDP_CMD_PING:
+        return UDP_CMD_STATUS_OK;
+    case UDP_CMD_LED_ON:
+    case UDP_CMD_LED_OFF:
+        return led_set(cmd->command == UDP_CMD_LED_ON) == ESP_OK ? UDP_CMD_STATUS_OK : UDP_CMD_STATUS_FAILED;
+    default:
+        return UDP_CMD_STATUS_UNKNOWN;
+    }
+}
+
+// Unauthenticated and stale packets are dropped without a reply, so the port cannot be used as a reflector
+static void udp_cmd_task(void *arg) {
+    static const uint8_t key[] = CONFIG_HTTPD_AUTH_KEY;
+    const size_t key_len = sizeof(key) - 1;
+    udp_cmd_window_t window;
+    udp_cmd_window_restore(&window, s_udp_cmd_reserved);
+    uint8_t buf[UDP_CMD_PACKET_LEN + 1]; // one spare byte, so longer datagrams do not pass as truncated
+
+    for (;;) {
+        struct sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        const int len = recvfrom(s_udp_cmd_sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            break; // socket closed
+        }
+
+        udp_cmd_t cmd;
+        esp_err_t err = udp_cmd_decode(buf, len, key, key_len, &cmd);
+        if (err != ESP_OK) {
+            ESP_LOGD(TAG, "udp cmd dropped: %s", esp_err_to_name(err));
+            continue;
+        }
+
+        // The window never gets past the floor, so a number above it is fresh. If the new floor cannot be
+        // stored, the packet is dropped without an ack and the controller resends it.
+        if (cmd.seq > s_udp_cmd_reserved && udp_cmd_reserve(cmd.seq) != ESP_OK) {
+            continue;
+        }
+
+        uint8_t status;
+        switch (udp_cmd_window_check(&window, cmd.seq)) {
+        case UDP_CMD_SEQ_FRESH:
+            status = udp_cmd_execute(&cmd);
+            break;
+        case UDP_CMD_SEQ_REPLAYED:
+            status = UDP_CMD_STATUS_DUPLICATE;
+            break;
+        default:
+            ESP_LOGD(TAG, "udp cmd dropped: stale sequence %" PRIu64, cmd.seq);
+            continue;
+        }
+
+#if CONFIG_HTTPD_UDP_CMD_ACK
+        if (cmd.flags & UDP_CMD_FLAG_ACK) {
+            const udp_cmd_t ack = {
+                .command = cmd.command | UDP_CMD_ACK_BIT, .flags = status, .arg = s_led_on, .seq = cmd.seq};
+            if (udp_cmd_encode(buf, &ack, key, key_len) == ESP_OK) {
+                sendto(s_udp_cmd_sock, buf, UDP_CMD_PACKET_LEN, 0, (struct sockaddr *)&from, from_len);
+            }
+        }
+#endif
+    }
+
+    vTaskDelete(NULL);
+}
+
+static void udp_cmd_stop() {
+    shutdown(s_udp_cmd_sock, SHUT_RDWR);
+    close(s_udp_cmd_sock);
+    s_udp_cmd_sock = -1;
+    nvs_close(s_udp_cmd_nvs);
+}
+
+static esp_err_t udp_cmd_start() {
+    if (sizeof(CONFIG_HTTPD_AUTH_KEY) <= 1) {
+        ESP_LOGW(TAG, "udp cmd disabled: no key configured");
+        return ESP_OK;
+    }
+
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &s_udp_cmd_nvs), TAG, "nvs_open failed");
+    esp_err_t err = nvs_get_u64(s_udp_cmd_nvs, UDP_CMD_SEQ_KEY, &s_udp_cmd_reserved);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        s_udp_cmd_reserved = 0;
+    } else if (unlikely(err != ESP_OK)) {
+        nvs_close(s_udp_cmd_nvs);
+        return err;
+    }
+
+    s_udp_cmd_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s_udp_cmd_sock < 0) {
+        nvs_close(s_udp_cmd_nvs);
+        return ESP_FAIL;
+    }
+
+    const struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_HTTPD_UDP_CMD_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(s_udp_cmd_sock, (const struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(s_udp_cmd_sock);
+        nvs_close(s_udp_cmd_nvs);
+        return ESP_FAIL;
+    }
+
+    // Above httpd, a command is never queued behind a page transfer
+    if (xTaskCreate(udp_cmd_task, "udp_cmd", 3072, NULL, tskIDLE_PRIORITY + 4, NULL) != pdPASS) {
+        close(s_udp_cmd_sock);
+        nvs_close(s_udp_cmd_nvs);
+        return ESP_ERR_NO_MEM;
+    }
+    DEFER(udp_cmd_stop);
+
+    ESP_LOGI(TAG, "udp cmd listening on port: '%d', sequence floor %" PRIu64, CONFIG_HTTPD_UDP_CMD_PORT,
+             s_udp_cmd_reserved);
+    return ESP_OK;
+}
+#endif // CONFIG_HTTPD_UDP_CMD
+
+static esp_err_t mdns_start() {
+    ESP_RETURN_ON_ERROR(mdns_init(), TAG, "mdns_init failed");
+    DEFER(mdns_free);
+
+    ESP_RETURN_ON_ERROR(mdns_hostname_set(s_config.mdns_name), TAG, "mdns_hostname_set failed");
+    ESP_LOGI(TAG, "mdns hostname set to: [%s]", s_config.mdns_name);
+
+    ESP_RETURN_ON_ERROR(mdns_instance_name_set("ESP32 with mDNS"), TAG,
+                        "mdns_instance_name_set failed"); // TODO: make configurable
+    ESP_RETURN_ON_ERROR(mdns_service_add(NULL, "_http", "_tcp", s_config.http_port, NULL, 0), TAG,
+                        "mdns_service_add failed");
+
+#if CONFIG_HTTPD_UDP_CMD
+    mdns_txt_item_t udp_cmd_txt[] = {{"v", UDP_CMD_TXT_VERSION}};
+    ESP_RETURN_ON_ERROR(mdns_service_add(NULL, "_ledctl", "_udp", CONFIG_HTTPD_UDP_CMD_PORT, udp_cmd_txt, 1), TAG,
+                        "mdns_service_add failed");
+#endif
+
+    return ESP_OK;
+}
+
+#if CONFIG_HTTPD_ASSET_READ_BENCH
+#define ASSET_READ_BENCH_WINDOW_US (CONFIG_HTTPD_ASSET_READ_BENCH_WINDOW_MS * 1000LL)
+#define ASSET_READ_BENCH_CHUNK 4096
+
+// Runs at idle priority, so it only measures what is left over by the WiFi stack and httpd. The assets are read
+// from their flash address past the cache, which would hold a small section after the first pass and measure
+// nothing but the CPU.
+static void asset_read_bench_task(void *arg) {
+    extern const uint8_t section_start[] asm("_web_assets_start");
+    extern const uint8_t section_end[] asm("_web_assets_end");
+    const size_t size = section_end - section_start;
+    static uint8_t buf[ASSET_READ_BENCH_CHUNK];
+
+    const size_t phys = spi_flash_cache2phys(section_start);
+    if (unlikely(phys == SPI_FLASH_CACHE2PHYS_FAIL)) {
+        ESP_LOGE(TAG, "asset read bench: section not mapped from flash");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    for (;;) {
+        uint64_t bytes = 0;
+        int64_t elapsed = 0;
+        const int64_t start = esp_timer_get_time();
+
+        do {
+            for (size_t offset = 0; offset < size; offset += ASSET_READ_BENCH_CHUNK) {
+                const size_t len = size - offset < ASSET_READ_BENCH_CHUNK ? size - offset : ASSET_READ_BENCH_CHUNK;
+                if (unlikely(esp_flash_read(NULL, buf, phys + offset, len) != ESP_OK)) {
+                    ESP_LOGE(TAG, "asset read bench: esp_flash_read failed");
+                    vTaskDelete(NULL);
+                    return;
+                }
+                bytes += len;
+            }
+            elapsed = esp_timer_get_time() - start;
+        } while (elapsed < ASSET_READ_BENCH_WINDOW_US);
+
+        ESP_LOGI(TAG, "asset read bench, uncached: %zu bytes section, %" PRIu64 " bytes in %" PRId64 " us, %.1f KB/s",
+                 size, bytes, elapsed, (bytes * 1000000.0 / elapsed) / 1024.0);
+    }
+}
+
+static esp_err_t asset_read_bench_start() {
+    if (xTaskCreate(asset_read_bench_task, "asset_bench", 2048, NULL, tskIDLE_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+#endif // CONFIG_HTTPD_ASSET_READ_BENCH
+
+static esp_err_t app_logic() {
+#if CONFIG_HTTPD_LOG_RING
+    ESP_RETURN_ON_ERROR(log_ring_start(), TAG, "log ring start failed");
+#endif
+
+    ESP_RETURN_ON_ERROR(make_etag(s_etag, sizeof(s_etag)), TAG, "make_etag failed");
+    ESP_LOGI(TAG, "ETag: %s", s_etag);
+
+    ESP_RETURN_ON_ERROR(make_last_modified(&s_last_modified, s_last_modified_str, sizeof(s_last_modified_str)), TAG,
+                        "make_last_modified failed");
+    ESP_LOGI(TAG, "Last-Modified: %s", s_last_modified ? s_last_modified_str : "unknown");
+
+    ESP_RETURN_ON_ERROR(gpio_init(), TAG, "GPIO init failed");
+    ESP_RETURN_ON_ERROR(nvs_init(), TAG, "NVS init failed");
+    ESP_RETURN_ON_ERROR(cfg_load(), TAG, "config load failed");
+#if CONFIG_HTTPD_LED_PERSIST
+    ESP_RETURN_ON_ERROR(led_store_start(), TAG, "LED state restore failed");
+#else
+    ESP_RETURN_ON_ERROR(gpio_set_level(LED_PIN, 1), TAG, "gpio_set_level failed"); // LED off
+#endif
+
+#if CONFIG_HTTPD_NET_OPENETH
+    ESP_RETURN_ON_ERROR(eth_init(), TAG, "Ethernet init failed");
+    ESP_RETURN_ON_ERROR(eth_connect(), TAG, "Ethernet connect failed");
+#else
     ESP_RETURN_ON_ERROR(wifi_init(), TAG, "WiFi init failed");
     ESP_RETURN_ON_ERROR(wifi_connect(), TAG, "WiFi connect failed");
+#endif
     ESP_RETURN_ON_ERROR(mdns_start(), TAG, "mDNS init failed");
+#if CONFIG_HTTPD_SCHED
+    ESP_RETURN_ON_ERROR(sched_start(), TAG, "scheduler start failed");
+#endif
+#if CONFIG_HTTPD_OTA
+    ESP_RETURN_ON_ERROR(ota_start(), TAG, "ota start failed");
+#endif
     ESP_RETURN_ON_ERROR(start_webserver(), TAG, "start webserver failed");
+#if CONFIG_HTTPD_UDP_CMD
+    ESP_RETURN_ON_ERROR(udp_cmd_start(), TAG, "udp cmd start failed");
+#endif
+
+#if CONFIG_HTTPD_ASSET_READ_BENCH
+    ESP_RETURN_ON_ERROR(asset_read_bench_start(), TAG, "asset read bench start failed");
+#endif
+
+#if CONFIG_HTTPD_OTA && CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    // Everything came up, keep this image instead of rolling back at the next reset
+    ESP_RETURN_ON_ERROR(esp_ota_mark_app_valid_cancel_rollback(), TAG, "esp_ota_mark_app_valid_cancel_rollback failed");
+#endif
 
     return ESP_OK;
 }
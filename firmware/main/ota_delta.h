@@ -0,0 +1,263 @@
+/**
+ * @file ota_delta.h
+ * @brief Streaming applier of bsdiff-style patches against the running image
+ *
+ * Rebuilds a new image from the one in the running partition plus a patch,
+ * writing it through an ota_stream_t, so only the differences have to
+ * travel over the air. The patch is consumed in pieces of any size as it
+ * arrives: old bytes are read from flash straight into the stream buffer
+ * and the differences added in place, RAM use does not depend on the size
+ * of the images or of the patch.
+ *
+ * Patch format, integers little endian, usually sent deflate-compressed:
+ *
+ * | size  | field                                             |
+ * |-------|---------------------------------------------------|
+ * | 4     | magic "OTAD"                                      |
+ * | 4     | version, OTA_DELTA_VERSION                        |
+ * | 32    | app_elf_sha256 of the image the patch applies to  |
+ * | 32    | SHA-256 of the new image                          |
+ * | 4     | size of the new image                             |
+ *
+ * followed by records until the new image is complete:
+ *
+ * | size  | field                                             |
+ * |-------|---------------------------------------------------|
+ * | 4     | diff length                                       |
+ * | 4     | extra length                                      |
+ * | 4     | seek, signed                                      |
+ * | diff  | bytes added to the old image at the old position  |
+ * | extra | bytes copied as they are                          |
+ *
+ * As in bsdiff, the old position advances with the diff bytes and then
+ * moves by seek. Differences of recompiled code are mostly zeros and small
+ * values, which is what makes the compressed patch small.
+ *
+ * Example usage:
+ * @code
+ *     static ota_delta_t delta;
+ *     ota_delta_begin(&delta, &ota, esp_ota_get_running_partition(), esp_app_get_description()->app_elf_sha256);
+ *     while (...) {
+ *         ota_delta_feed(&delta, buf, len);
+ *     }
+ *     if (ota_delta_complete(&delta) && ota_stream_end(&ota, sha256, &partition) == ESP_OK &&
+ *         memcmp(sha256, delta.sha256, 32) == 0) { ... }
+ * @endcode
+ *
+ * @version 0.0.2
+ */
+
+#ifndef _OTA_DELTA_H_
+#define _OTA_DELTA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "ota_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_DELTA_VERSION 1
+#define OTA_DELTA_HEADER_LEN 76
+#define OTA_DELTA_RECORD_LEN 12
+
+/**
+ * @brief Applier state. Read-only for the caller.
+ */
+typedef struct {
+    ota_stream_t *out;
+    const esp_partition_t *old;
+    const uint8_t *base; /*!< app_elf_sha256 the patch must be made for */
+    uint8_t sha256[32];  /*!< SHA-256 of the new image, valid once the header is in */
+    size_t size;         /*!< size of the new image, valid once the header is in */
+    size_t old_pos;
+    uint32_t diff_left;
+    uint32_t extra_left;
+    int32_t seek;
+    uint8_t state;
+    uint8_t pending[OTA_DELTA_HEADER_LEN]; /*!< header or record being assembled */
+    size_t pending_len;
+} ota_delta_t;
+
+/**
+ * @brief Prepares applying a patch to the image in old. The output session starts with the patch header.
+ */
+void ota_delta_begin(ota_delta_t *d, ota_stream_t *out, const esp_partition_t *old, const uint8_t base[32]);
+
+/**
+ * @brief Applies the next piece of the patch. Matches gunzip_write_fn_t, ctx is the ota_delta_t.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION for an unknown format, ESP_ERR_NOT_FOUND if the patch was made for
+ * another image, ESP_ERR_NOT_SUPPORTED without an update partition, ESP_ERR_INVALID_SIZE for records outside
+ * either image, or the error of the output stream.
+ */
+esp_err_t ota_delta_feed(void *ctx, const uint8_t *buf, size_t len);
+
+/**
+ * @brief Whether the new image is complete. The caller finishes the output with ota_stream_end().
+ */
+bool ota_delta_complete(const ota_delta_t *d);
+
+#ifdef OTA_DELTA_IMPLEMENTATION
+
+#include <string.h>
+
+enum {
+    OTA_DELTA_HEADER,
+    OTA_DELTA_RECORD,
+    OTA_DELTA_DIFF,
+    OTA_DELTA_EXTRA,
+    OTA_DELTA_DONE,
+};
+
+static inline uint32_t ota_delta_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void ota_delta_begin(ota_delta_t *d, ota_stream_t *out, const esp_partition_t *old, const uint8_t base[32]) {
+    memset(d, 0, sizeof(*d));
+    d->out = out;
+    d->old = old;
+    d->base = base;
+    d->state = OTA_DELTA_HEADER;
+}
+
+bool ota_delta_complete(const ota_delta_t *d) {
+    return d->state == OTA_DELTA_DONE;
+}
+
+static esp_err_t ota_delta_header(ota_delta_t *d) {
+    const uint8_t *p = d->pending;
+    if (memcmp(p, "OTAD", 4) != 0 || ota_delta_u32(p + 4) != OTA_DELTA_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (memcmp(p + 8, d->base, 32) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    memcpy(d->sha256, p + 40, 32);
+    d->size = ota_delta_u32(p + 72);
+    d->state = OTA_DELTA_RECORD;
+
+    // ESP_ERR_NOT_FOUND of the stream is a missing partition, not a patch for another image
+    const esp_err_t err = ota_stream_begin(d->out, d->size);
+    return err == ESP_ERR_NOT_FOUND ? ESP_ERR_NOT_SUPPORTED : err;
+}
+
+static esp_err_t ota_delta_record(ota_delta_t *d) {
+    const uint8_t *p = d->pending;
+    d->diff_left = ota_delta_u32(p);
+    d->extra_left = ota_delta_u32(p + 4);
+    d->seek = (int32_t)ota_delta_u32(p + 8);
+
+    // Checked up front, so the loops below cannot run past either image
+    const size_t left = d->out->total - d->out->offset;
+    if (d->diff_left > left || d->extra_left > left - d->diff_left || d->diff_left > d->old->size - d->old_pos) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    d->state = d->diff_left ? OTA_DELTA_DIFF : OTA_DELTA_EXTRA;
+    return ESP_OK;
+}
+
+// Old bytes are read into the free room of the output buffer, the differences added in place
+static esp_err_t ota_delta_diff(ota_delta_t *d, const uint8_t *buf, size_t len) {
+    while (len) {
+        size_t room;
+        uint8_t *out = ota_stream_buf(d->out, &room);
+        const size_t n = len < room ? len : room;
+
+        esp_err_t err = esp_partition_read(d->old, d->old_pos, out, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        for (size_t i = 0; i < n; i++) {
+            out[i] += buf[i];
+        }
+
+        err = ota_stream_commit(d->out, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        d->old_pos += n;
+        buf += n;
+        len -= n;
+    }
+
+    return ESP_OK;
+}
+
+// A seek out of the old image only fails if the next record reads there, ota_delta_record() checks that
+static void ota_delta_next(ota_delta_t *d) {
+    const int64_t pos = (int64_t)d->old_pos + d->seek;
+    d->old_pos = pos < 0 || pos > d->old->size ? d->old->size : (size_t)pos;
+    d->state = d->out->offset == d->out->total ? OTA_DELTA_DONE : OTA_DELTA_RECORD;
+}
+
+esp_err_t ota_delta_feed(void *ctx, const uint8_t *buf, size_t len) {
+    ota_delta_t *d = ctx;
+    esp_err_t err = ESP_OK;
+
+    while (len && err == ESP_OK) {
+        switch (d->state) {
+        case OTA_DELTA_HEADER:
+        case OTA_DELTA_RECORD: {
+            const size_t need = (d->state == OTA_DELTA_HEADER ? OTA_DELTA_HEADER_LEN : OTA_DELTA_RECORD_LEN) -
+                                d->pending_len;
+            const size_t n = len < need ? len : need;
+            memcpy(d->pending + d->pending_len, buf, n);
+            d->pending_len += n;
+            buf += n;
+            len -= n;
+
+            if (n == need) {
+                d->pending_len = 0;
+                err = d->state == OTA_DELTA_HEADER ? ota_delta_header(d) : ota_delta_record(d);
+            }
+            break;
+        }
+        case OTA_DELTA_DIFF: {
+            const size_t n = len < d->diff_left ? len : d->diff_left;
+            err = ota_delta_diff(d, buf, n);
+            d->diff_left -= n;
+            buf += n;
+            len -= n;
+
+            if (d->diff_left == 0) {
+                d->state = OTA_DELTA_EXTRA;
+            }
+            break;
+        }
+        case OTA_DELTA_EXTRA: {
+            const size_t n = len < d->extra_left ? len : d->extra_left;
+            err = ota_stream_write(d->out, buf, n);
+            d->extra_left -= n;
+            buf += n;
+            len -= n;
+            break;
+        }
+        default:
+            // Nothing may follow the last record
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        if (err == ESP_OK && d->state == OTA_DELTA_EXTRA && d->extra_left == 0) {
+            ota_delta_next(d);
+        }
+    }
+
+    return err;
+}
+
+#endif /* OTA_DELTA_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OTA_DELTA_H_ */
@@ -0,0 +1,342 @@
+/**
+ * @file ota_stream.h
+ * @brief Double-buffered streaming writer into the inactive OTA partition
+ *
+ * The producer (e.g. an HTTP handler) fills one buffer while a writer task
+ * flushes the other one with esp_ota_write(), so receiving never waits for
+ * a flash write that could overlap with it. Bytes are hashed with SHA-256
+ * as they are accepted, in order, and the session survives between calls:
+ * after ota_stream_flush() everything accepted so far is in flash and a
+ * later call may continue at ota_stream_t::offset, e.g. when a client
+ * resumes an upload after a disconnect.
+ *
+ * Example usage:
+ * @code
+ *     static ota_stream_t ota;
+ *     ota_stream_init(&ota, uxTaskPriorityGet(producer) + 1);
+ *     ota_stream_begin(&ota, image_len);
+ *     while (...) {
+ *         size_t room;
+ *         uint8_t *buf = ota_stream_buf(&ota, &room);
+ *         int n = recv(sock, buf, room, 0);
+ *         ota_stream_commit(&ota, n);
+ *     }
+ *     uint8_t sha256[32];
+ *     const esp_partition_t *partition;
+ *     if (ota_stream_end(&ota, sha256, &partition) == ESP_OK) {
+ *         esp_ota_set_boot_partition(partition);
+ *     }
+ * @endcode
+ *
+ * @version 0.0.2
+ */
+
+#ifndef _OTA_STREAM_H_
+#define _OTA_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_ota_ops.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Size of each of the two buffers, a multiple of the flash sector size works best.
+ */
+#ifndef OTA_STREAM_BUF_LEN
+#define OTA_STREAM_BUF_LEN 4096
+#endif
+
+#define OTA_STREAM_BUFS 2
+
+/**
+ * @brief Session state. Read-only for the caller.
+ */
+typedef struct {
+    const esp_partition_t *partition; /*!< target, NULL when no session is active */
+    esp_ota_handle_t handle;
+    size_t total;            /*!< announced image size */
+    size_t offset;           /*!< bytes accepted */
+    int64_t flash_us;        /*!< time the writer spent in esp_ota_write() */
+    int64_t wait_us;         /*!< time the producer waited for a free buffer */
+    volatile esp_err_t err;  /*!< first write error, sticky for the session */
+
+    mbedtls_sha256_context sha;
+    QueueHandle_t free;
+    QueueHandle_t full;
+    TaskHandle_t writer;
+    uint8_t *fill; /*!< buffer being filled, NULL if none taken */
+    size_t fill_len;
+} ota_stream_t;
+
+/**
+ * @brief Creates the writer task. Call once.
+ *
+ * @param priority Of the writer task. Above the producer, so a full buffer is written as soon as it is handed
+ * over; the task that calls this is usually not the producer.
+ */
+esp_err_t ota_stream_init(ota_stream_t *s, UBaseType_t priority);
+
+/**
+ * @brief Starts a session writing to the next update partition, aborting any active one.
+ *
+ * @param total Size of the whole image.
+ * @return ESP_ERR_NOT_FOUND without an update partition, ESP_ERR_INVALID_SIZE if the image does not fit.
+ */
+esp_err_t ota_stream_begin(ota_stream_t *s, size_t total);
+
+/**
+ * @brief Returns free room in the current buffer, waiting for the writer to release one if necessary.
+ *
+ * @param[out] len Room in bytes, never more than total - offset.
+ */
+uint8_t *ota_stream_buf(ota_stream_t *s, size_t *len);
+
+/**
+ * @brief Accepts len bytes placed into the buffer returned by ota_stream_buf().
+ */
+esp_err_t ota_stream_commit(ota_stream_t *s, size_t len);
+
+/**
+ * @brief Copies and accepts len bytes.
+ */
+esp_err_t ota_stream_write(ota_stream_t *s, const void *data, size_t len);
+
+/**
+ * @brief Hands over the partly filled buffer and waits until everything accepted is written.
+ */
+esp_err_t ota_stream_flush(ota_stream_t *s);
+
+/**
+ * @brief Finishes the session once offset reached total: flushes, validates the image and returns its SHA-256.
+ *
+ * @param[out] partition The partition holding the new image, for esp_ota_set_boot_partition().
+ */
+esp_err_t ota_stream_end(ota_stream_t *s, uint8_t sha256[32], const esp_partition_t **partition);
+
+/**
+ * @brief Drops the active session, if any.
+ */
+void ota_stream_abort(ota_stream_t *s);
+
+#ifdef OTA_STREAM_IMPLEMENTATION
+
+#include <string.h>
+
+#include "esp_timer.h"
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} ota_stream_chunk_t;
+
+static uint8_t ota_stream_bufs[OTA_STREAM_BUFS][OTA_STREAM_BUF_LEN];
+
+// Buffers only travel between the two queues, so at most one is written while the other one fills
+static void ota_stream_writer(void *arg) {
+    ota_stream_t *s = arg;
+
+    for (;;) {
+        ota_stream_chunk_t chunk;
+        xQueueReceive(s->full, &chunk, portMAX_DELAY);
+
+        if (s->err == ESP_OK) {
+            const int64_t start = esp_timer_get_time();
+            esp_err_t err = esp_ota_write(s->handle, chunk.buf, chunk.len);
+            s->flash_us += esp_timer_get_time() - start;
+            if (err != ESP_OK) {
+                s->err = err;
+            }
+        }
+
+        xQueueSend(s->free, &chunk.buf, portMAX_DELAY);
+    }
+}
+
+esp_err_t ota_stream_init(ota_stream_t *s, UBaseType_t priority) {
+    memset(s, 0, sizeof(*s));
+
+    s->free = xQueueCreate(OTA_STREAM_BUFS, sizeof(uint8_t *));
+    s->full = xQueueCreate(OTA_STREAM_BUFS, sizeof(ota_stream_chunk_t));
+    if (!s->free || !s->full) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < OTA_STREAM_BUFS; i++) {
+        uint8_t *buf = ota_stream_bufs[i];
+        xQueueSend(s->free, &buf, 0);
+    }
+
+    if (xTaskCreate(ota_stream_writer, "ota_writer", 3072, s, priority, &s->writer) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+static void ota_stream_handover(ota_stream_t *s) {
+    if (!s->fill) {
+        return;
+    }
+
+    if (s->fill_len) {
+        const ota_stream_chunk_t chunk = {.buf = s->fill, .len = s->fill_len};
+        xQueueSend(s->full, &chunk, portMAX_DELAY);
+    } else {
+        xQueueSend(s->free, &s->fill, portMAX_DELAY);
+    }
+    s->fill = NULL;
+    s->fill_len = 0;
+}
+
+// Every buffer back in the free queue means the writer is idle
+static void ota_stream_drain(ota_stream_t *s) {
+    ota_stream_handover(s);
+
+    uint8_t *bufs[OTA_STREAM_BUFS];
+    for (size_t i = 0; i < OTA_STREAM_BUFS; i++) {
+        xQueueReceive(s->free, &bufs[i], portMAX_DELAY);
+    }
+    for (size_t i = 0; i < OTA_STREAM_BUFS; i++) {
+        xQueueSend(s->free, &bufs[i], 0);
+    }
+}
+
+void ota_stream_abort(ota_stream_t *s) {
+    if (!s->partition) {
+        return;
+    }
+
+    ota_stream_drain(s);
+    esp_ota_abort(s->handle);
+    mbedtls_sha256_free(&s->sha);
+    s->partition = NULL;
+}
+
+esp_err_t ota_stream_begin(ota_stream_t *s, size_t total) {
+    ota_stream_abort(s);
+
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (!partition) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (total == 0 || total > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Sequential writes erase sector by sector on the way, erasing the whole slot up front takes seconds
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &s->handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    mbedtls_sha256_init(&s->sha);
+    mbedtls_sha256_starts(&s->sha, 0);
+    s->partition = partition;
+    s->total = total;
+    s->offset = 0;
+    s->flash_us = 0;
+    s->wait_us = 0;
+    s->err = ESP_OK;
+    return ESP_OK;
+}
+
+uint8_t *ota_stream_buf(ota_stream_t *s, size_t *len) {
+    if (s->fill && s->fill_len == OTA_STREAM_BUF_LEN) {
+        ota_stream_handover(s);
+    }
+    if (!s->fill) {
+        const int64_t start = esp_timer_get_time();
+        xQueueReceive(s->free, &s->fill, portMAX_DELAY);
+        s->wait_us += esp_timer_get_time() - start;
+    }
+
+    const size_t room = OTA_STREAM_BUF_LEN - s->fill_len;
+    const size_t left = s->total - s->offset;
+    *len = room < left ? room : left;
+    return s->fill + s->fill_len;
+}
+
+esp_err_t ota_stream_commit(ota_stream_t *s, size_t len) {
+    if (!s->partition || !s->fill || len > OTA_STREAM_BUF_LEN - s->fill_len || len > s->total - s->offset) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    mbedtls_sha256_update(&s->sha, s->fill + s->fill_len, len);
+    s->fill_len += len;
+    s->offset += len;
+
+    if (s->fill_len == OTA_STREAM_BUF_LEN) {
+        ota_stream_handover(s);
+    }
+    return s->err;
+}
+
+esp_err_t ota_stream_write(ota_stream_t *s, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    while (len) {
+        size_t room;
+        uint8_t *buf = ota_stream_buf(s, &room);
+        if (room == 0) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        const size_t n = len < room ? len : room;
+        memcpy(buf, p, n);
+        esp_err_t err = ota_stream_commit(s, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        p += n;
+        len -= n;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ota_stream_flush(ota_stream_t *s) {
+    if (!s->partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ota_stream_drain(s);
+    return s->err;
+}
+
+esp_err_t ota_stream_end(ota_stream_t *s, uint8_t sha256[32], const esp_partition_t **partition) {
+    if (!s->partition || s->offset != s->total) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = ota_stream_flush(s);
+    if (err != ESP_OK) {
+        ota_stream_abort(s);
+        return err;
+    }
+
+    mbedtls_sha256_finish(&s->sha, sha256);
+    mbedtls_sha256_free(&s->sha);
+
+    // Validates the image, the handle is released either way
+    *partition = s->partition;
+    s->partition = NULL;
+    return esp_ota_end(s->handle);
+}
+
+#endif /* OTA_STREAM_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OTA_STREAM_H_ */
@@ -0,0 +1,150 @@
+/**
+ * @file resp_head.h
+ * @brief Response head helpers shared by the static and dynamic handlers
+ *
+ * Headers are collected into a fixed array first, so the same set can be
+ * applied to an esp_http_server response or written into a raw head, e.g.
+ * for HEAD, where esp_http_server would send a body. Field and value
+ * strings are referenced, not copied, and must outlive the response.
+ *
+ * Example usage:
+ * @code
+ *     resp_hdrs_t hdrs = {0};
+ *     resp_hdrs_add(&hdrs, "ETag", etag);
+ *     char buf[RESP_HEAD_MAX];
+ *     int len = resp_head_format(buf, sizeof(buf), "200 OK", "text/html", size, &hdrs);
+ * @endcode
+ *
+ * @version 0.0.2
+ */
+
+#ifndef _RESP_HEAD_H_
+#define _RESP_HEAD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef RESP_HDRS_MAX
+#define RESP_HDRS_MAX 10
+#endif
+
+/**
+ * @brief Buffer size for resp_head_format().
+ */
+#ifndef RESP_HEAD_MAX
+#define RESP_HEAD_MAX 512
+#endif
+
+/**
+ * @brief content_len of a head without Content-Length, e.g. a 304, which must not announce a length other than
+ *        the one of the selected representation.
+ */
+#define RESP_HEAD_NO_LENGTH SIZE_MAX
+
+typedef struct {
+    size_t count;
+    bool dropped; /*!< a header did not fit, the set must not be sent */
+    struct {
+        const char *field;
+        const char *value;
+    } items[RESP_HDRS_MAX];
+} resp_hdrs_t;
+
+/**
+ * @brief Appends a header. Once RESP_HDRS_MAX are set it is dropped and the set is marked as incomplete.
+ */
+void resp_hdrs_add(resp_hdrs_t *hdrs, const char *field, const char *value);
+
+/**
+ * @brief Sets the collected headers on an esp_http_server response.
+ *
+ * The server takes at most max_resp_headers of httpd_config_t, which has
+ * to cover RESP_HDRS_MAX.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE for an incomplete set or the error of httpd_resp_set_hdr(). Headers set
+ *         before the failure stay on the response.
+ */
+esp_err_t resp_hdrs_apply(httpd_req_t *req, const resp_hdrs_t *hdrs);
+
+/**
+ * @brief Writes the status line, Content-Type, Content-Length, the collected headers and the empty line.
+ *
+ * @param type Content-Type, NULL to leave it out.
+ * @param content_len Content-Length, RESP_HEAD_NO_LENGTH to leave it out.
+ * @return Length of the head, or -1 if it does not fit into len or the header set is incomplete.
+ */
+int resp_head_format(char *buf, size_t len, const char *status, const char *type, size_t content_len,
+                     const resp_hdrs_t *hdrs);
+
+#ifdef RESP_HEAD_IMPLEMENTATION
+
+#include <stdio.h>
+
+#include "esp_log.h"
+
+void resp_hdrs_add(resp_hdrs_t *hdrs, const char *field, const char *value) {
+    if (unlikely(hdrs->count >= RESP_HDRS_MAX)) {
+        ESP_LOGE(TAG, "response header %s dropped", field);
+        hdrs->dropped = true;
+        return;
+    }
+
+    hdrs->items[hdrs->count].field = field;
+    hdrs->items[hdrs->count].value = value;
+    hdrs->count++;
+}
+
+esp_err_t resp_hdrs_apply(httpd_req_t *req, const resp_hdrs_t *hdrs) {
+    if (unlikely(hdrs->dropped)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (size_t i = 0; i < hdrs->count; i++) {
+        esp_err_t err = httpd_resp_set_hdr(req, hdrs->items[i].field, hdrs->items[i].value);
+        if (unlikely(err != ESP_OK)) {
+            return err;
+        }
+    }
+
+    return ESP_OK;
+}
+
+int resp_head_format(char *buf, size_t len, const char *status, const char *type, size_t content_len,
+                     const resp_hdrs_t *hdrs) {
+    if (unlikely(hdrs->dropped)) {
+        return -1;
+    }
+
+    int n = snprintf(buf, len, "HTTP/1.1 %s\r\n", status);
+
+    if (type && n > 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, "Content-Type: %s\r\n", type);
+    }
+    if (content_len != RESP_HEAD_NO_LENGTH && n > 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, "Content-Length: %zu\r\n", content_len);
+    }
+    for (size_t i = 0; i < hdrs->count && n > 0 && (size_t)n < len; i++) {
+        n += snprintf(buf + n, len - n, "%s: %s\r\n", hdrs->items[i].field, hdrs->items[i].value);
+    }
+    if (n > 0 && (size_t)n < len) {
+        n += snprintf(buf + n, len - n, "\r\n");
+    }
+
+    return n < 0 || (size_t)n >= len ? -1 : n;
+}
+
+#endif /* RESP_HEAD_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESP_HEAD_H_ */
@@ -0,0 +1,219 @@
+/**
+ * @file udp_cmd.h
+ * @brief Authenticated single-datagram command packets
+ *
+ * Every command is one fixed-size UDP datagram, so a controller needs
+ * neither a connection nor a parser:
+ *
+ * | offset | size | field                                              |
+ * |--------|------|----------------------------------------------------|
+ * | 0      | 1    | version, UDP_CMD_VERSION                           |
+ * | 1      | 1    | command, with UDP_CMD_ACK_BIT set in acks          |
+ * | 2      | 1    | flags in requests, status in acks                  |
+ * | 3      | 1    | argument, 0 in requests, LED state in acks         |
+ * | 4      | 8    | sequence number, big endian, never 0               |
+ * | 12     | 16   | HMAC-SHA256 of bytes 0..11, truncated              |
+ *
+ * Sequence numbers are checked against a sliding window of the last 64
+ * numbers, like the IPsec anti-replay window (RFC 4303). A repeated number
+ * is authenticated but not executed again, so a controller may resend a
+ * command whose ack got lost. The window does not survive a reboot by
+ * itself: the caller persists a floor above every executed number and
+ * restores the window from it with udp_cmd_window_restore(), so captured
+ * packets are refused after a restart too. Controllers should derive
+ * sequence numbers from the wall clock, e.g. microseconds since the epoch,
+ * so they stay ahead of the floor.
+ *
+ * Example usage:
+ * @code
+ *     udp_cmd_t cmd;
+ *     if (udp_cmd_decode(buf, len, key, key_len, &cmd) == ESP_OK &&
+ *         udp_cmd_window_check(&window, cmd.seq) == UDP_CMD_SEQ_FRESH) {
+ *         ...
+ *     }
+ * @endcode
+ *
+ * @version 0.0.3
+ */
+
+#ifndef _UDP_CMD_H_
+#define _UDP_CMD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UDP_CMD_VERSION 1
+#define UDP_CMD_MAC_LEN 16
+#define UDP_CMD_PACKET_LEN (12 + UDP_CMD_MAC_LEN)
+
+#define UDP_CMD_ACK_BIT 0x80
+
+/**
+ * @brief Commands.
+ */
+typedef enum {
+    UDP_CMD_PING = 0x00,
+    UDP_CMD_LED_ON = 0x01,
+    UDP_CMD_LED_OFF = 0x02,
+} udp_cmd_command_t;
+
+/**
+ * @brief Request flags.
+ */
+#define UDP_CMD_FLAG_ACK 0x01 /*!< reply with an ack */
+
+/**
+ * @brief Ack status.
+ */
+typedef enum {
+    UDP_CMD_STATUS_OK = 0,
+    UDP_CMD_STATUS_DUPLICATE = 1, /*!< already executed, not repeated */
+    UDP_CMD_STATUS_FAILED = 2,
+    UDP_CMD_STATUS_UNKNOWN = 3, /*!< unknown command */
+} udp_cmd_status_t;
+
+/**
+ * @brief Decoded packet.
+ */
+typedef struct {
+    uint8_t command;
+    uint8_t flags;
+    uint8_t arg;
+    uint64_t seq;
+} udp_cmd_t;
+
+/**
+ * @brief Anti-replay window. Zero it to start empty, which accepts every number once.
+ */
+typedef struct {
+    uint64_t top;    /*!< highest accepted sequence number */
+    uint64_t bitmap; /*!< bit n set: top - n was accepted */
+} udp_cmd_window_t;
+
+typedef enum {
+    UDP_CMD_SEQ_FRESH,    /*!< first time seen, recorded */
+    UDP_CMD_SEQ_REPLAYED, /*!< seen before, inside the window */
+    UDP_CMD_SEQ_STALE,    /*!< behind the window, unknown whether seen */
+} udp_cmd_seq_t;
+
+/**
+ * @brief Authenticates and decodes a packet.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE for a wrong length, ESP_ERR_INVALID_VERSION, ESP_ERR_INVALID_CRC for a
+ * wrong MAC, ESP_ERR_INVALID_ARG for sequence number 0.
+ */
+esp_err_t udp_cmd_decode(const uint8_t *buf, size_t len, const uint8_t *key, size_t key_len, udp_cmd_t *out);
+
+/**
+ * @brief Encodes and signs a packet into buf, which must hold UDP_CMD_PACKET_LEN bytes.
+ */
+esp_err_t udp_cmd_encode(uint8_t *buf, const udp_cmd_t *cmd, const uint8_t *key, size_t key_len);
+
+/**
+ * @brief Checks a sequence number against the window and records it if fresh.
+ */
+udp_cmd_seq_t udp_cmd_window_check(udp_cmd_window_t *w, uint64_t seq);
+
+/**
+ * @brief Starts the window at a persisted floor: every number up to it counts as seen.
+ */
+void udp_cmd_window_restore(udp_cmd_window_t *w, uint64_t floor);
+
+#ifdef UDP_CMD_IMPLEMENTATION
+
+#include "mac_equal.h"
+#include "mbedtls/md.h"
+
+static esp_err_t udp_cmd_mac(const uint8_t *buf, const uint8_t *key, size_t key_len, uint8_t *mac) {
+    uint8_t full[32];
+
+    if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, key_len, buf,
+                        UDP_CMD_PACKET_LEN - UDP_CMD_MAC_LEN, full) != 0) {
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < UDP_CMD_MAC_LEN; i++) {
+        mac[i] = full[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t udp_cmd_decode(const uint8_t *buf, size_t len, const uint8_t *key, size_t key_len, udp_cmd_t *out) {
+    if (len != UDP_CMD_PACKET_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (buf[0] != UDP_CMD_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    uint8_t mac[UDP_CMD_MAC_LEN];
+    esp_err_t err = udp_cmd_mac(buf, key, key_len, mac);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (!mac_equal(mac, buf + UDP_CMD_PACKET_LEN - UDP_CMD_MAC_LEN, UDP_CMD_MAC_LEN)) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    out->command = buf[1];
+    out->flags = buf[2];
+    out->arg = buf[3];
+    out->seq = 0;
+    for (size_t i = 0; i < 8; i++) {
+        out->seq = out->seq << 8 | buf[4 + i];
+    }
+
+    return out->seq ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t udp_cmd_encode(uint8_t *buf, const udp_cmd_t *cmd, const uint8_t *key, size_t key_len) {
+    buf[0] = UDP_CMD_VERSION;
+    buf[1] = cmd->command;
+    buf[2] = cmd->flags;
+    buf[3] = cmd->arg;
+    for (size_t i = 0; i < 8; i++) {
+        buf[4 + i] = cmd->seq >> (56 - 8 * i);
+    }
+    return udp_cmd_mac(buf, key, key_len, buf + UDP_CMD_PACKET_LEN - UDP_CMD_MAC_LEN);
+}
+
+udp_cmd_seq_t udp_cmd_window_check(udp_cmd_window_t *w, uint64_t seq) {
+    if (seq > w->top) {
+        const uint64_t shift = seq - w->top;
+        w->bitmap = shift < 64 ? w->bitmap << shift | 1 : 1;
+        w->top = seq;
+        return UDP_CMD_SEQ_FRESH;
+    }
+
+    const uint64_t age = w->top - seq;
+    if (age >= 64) {
+        return UDP_CMD_SEQ_STALE;
+    }
+
+    const uint64_t bit = (uint64_t)1 << age;
+    if (w->bitmap & bit) {
+        return UDP_CMD_SEQ_REPLAYED;
+    }
+    w->bitmap |= bit;
+    return UDP_CMD_SEQ_FRESH;
+}
+
+void udp_cmd_window_restore(udp_cmd_window_t *w, uint64_t floor) {
+    w->top = floor;
+    w->bitmap = floor ? UINT64_MAX : 0;
+}
+
+#endif /* UDP_CMD_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UDP_CMD_H_ */
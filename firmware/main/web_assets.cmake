@@ -0,0 +1,231 @@
+# Generates the embedded web assets from the manifest written by
+# web/scripts/compress.mjs:
+#   web_assets.S        - every encoded body in a dedicated .rodata.web_assets section
+#   web_assets.lf       - linker fragment placing that section
+#   web_assets_table.c  - the web_assets[] table described in web_assets.h
+#
+# Assets are emitted in manifest order, which lists the most frequently
+# requested ones first: they share the leading flash pages and stay warm in
+# the cache.
+
+set(WEB_DIST_DIR "${CMAKE_CURRENT_LIST_DIR}/../../web/dist")
+get_filename_component(WEB_ASSETS_MANIFEST "${WEB_DIST_DIR}/manifest.json" ABSOLUTE)
+
+set(WEB_ASSETS_SRC "${CMAKE_CURRENT_BINARY_DIR}/web_assets.S")
+set(WEB_ASSETS_LF "${CMAKE_CURRENT_BINARY_DIR}/web_assets.lf")
+set(WEB_ASSETS_TABLE "${CMAKE_CURRENT_BINARY_DIR}/web_assets_table.c")
+
+if(NOT EXISTS "${WEB_ASSETS_MANIFEST}")
+    message(FATAL_ERROR "web asset manifest ${WEB_ASSETS_MANIFEST} not found, run `make build-web` first")
+endif()
+
+# A new web build changes the manifest, which has to regenerate the sources
+set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS "${WEB_ASSETS_MANIFEST}")
+file(READ "${WEB_ASSETS_MANIFEST}" web_assets_json)
+
+if(CONFIG_HTTPD_ASSET_ALIGN)
+    set(web_assets_align ${CONFIG_HTTPD_ASSET_ALIGN})
+else()
+    set(web_assets_align 32)
+endif()
+
+if(CONFIG_HTTPD_ASSET_PAGE_ALIGN)
+    if(CONFIG_MMU_PAGE_SIZE)
+        math(EXPR web_assets_align "${CONFIG_MMU_PAGE_SIZE}")
+    else()
+        set(web_assets_align 65536)
+    endif()
+endif()
+
+set(web_assets_asm "/* Generated by web_assets.cmake, do not edit. */\n\n")
+string(APPEND web_assets_asm "    .section .rodata.web_assets, \"a\"\n")
+
+set(web_assets_decls "")
+set(web_assets_bodies "")
+set(web_assets_entries "")
+set(web_assets_files "")
+
+string(JSON web_assets_count LENGTH "${web_assets_json}" assets)
+if(web_assets_count EQUAL 0)
+    message(FATAL_ERROR "web asset manifest ${WEB_ASSETS_MANIFEST} lists no assets")
+endif()
+math(EXPR web_assets_last "${web_assets_count} - 1")
+
+# Absent from manifests written before it was recorded, the firmware then sends no Last-Modified
+string(JSON web_assets_last_modified ERROR_VARIABLE json_err GET "${web_assets_json}" lastModified)
+if(json_err)
+    set(web_assets_last_modified 0)
+endif()
+
+foreach(i RANGE ${web_assets_last})
+    string(JSON asset_uri GET "${web_assets_json}" assets ${i} uri)
+    string(JSON asset_file GET "${web_assets_json}" assets ${i} file)
+    string(JSON asset_type GET "${web_assets_json}" assets ${i} type)
+    string(JSON asset_cache GET "${web_assets_json}" assets ${i} cacheControl)
+    string(JSON asset_size GET "${web_assets_json}" assets ${i} size)
+    string(JSON asset_sha GET "${web_assets_json}" assets ${i} sha256)
+    string(SUBSTRING "${asset_sha}" 0 16 asset_hash)
+
+    # Optional members, absent from manifests written before dictionary support
+    string(JSON asset_dict ERROR_VARIABLE json_err GET "${web_assets_json}" assets ${i} useAsDictionary)
+    if(json_err)
+        set(asset_dict_c "NULL")
+    else()
+        string(REPLACE "\"" "\\\"" asset_dict "${asset_dict}")
+        set(asset_dict_c "\"${asset_dict}\"")
+    endif()
+    string(JSON asset_sw ERROR_VARIABLE json_err GET "${web_assets_json}" assets ${i} serviceWorkerAllowed)
+    if(json_err)
+        set(asset_sw_c "NULL")
+    else()
+        set(asset_sw_c "\"${asset_sw}\"")
+    endif()
+    set(asset_has_deltas "false")
+
+    string(MAKE_C_IDENTIFIER "${asset_file}" asset_var)
+
+    string(JSON bodies_total LENGTH "${web_assets_json}" assets ${i} encodings)
+    math(EXPR bodies_last "${bodies_total} - 1")
+
+    # A page with a state element has a plain gzip body and one split for injection, only one is embedded
+    set(asset_has_inject FALSE)
+    set(asset_has_gzip FALSE)
+    foreach(j RANGE ${bodies_last})
+        string(JSON body_coding GET "${web_assets_json}" assets ${i} encodings ${j} coding)
+        string(JSON body_inject ERROR_VARIABLE json_err GET "${web_assets_json}" assets ${i} encodings ${j} inject)
+        if(NOT json_err)
+            set(asset_has_inject TRUE)
+        elseif(body_coding STREQUAL "gzip")
+            set(asset_has_gzip TRUE)
+        endif()
+    endforeach()
+    set(bodies_count 0)
+
+    string(APPEND web_assets_bodies "\nstatic const web_asset_body_t ${asset_var}_bodies[] = {\n")
+
+    foreach(j RANGE ${bodies_last})
+        string(JSON body_coding GET "${web_assets_json}" assets ${i} encodings ${j} coding)
+        string(JSON body_file GET "${web_assets_json}" assets ${i} encodings ${j} file)
+        string(JSON body_inject ERROR_VARIABLE json_err GET "${web_assets_json}" assets ${i} encodings ${j} inject)
+        if(json_err)
+            set(body_inject 0)
+        endif()
+
+        if(CONFIG_HTTPD_STATE_INJECT AND asset_has_inject AND body_coding STREQUAL "gzip" AND NOT body_inject)
+            continue()
+        endif()
+        if(NOT CONFIG_HTTPD_STATE_INJECT AND asset_has_gzip AND body_inject)
+            continue()
+        endif()
+        math(EXPR bodies_count "${bodies_count} + 1")
+
+        get_filename_component(body_path "${WEB_DIST_DIR}/${body_file}" ABSOLUTE)
+        if(NOT EXISTS "${body_path}")
+            message(FATAL_ERROR "web asset ${body_path} not found, run `make build-web` first")
+        endif()
+
+        string(MAKE_C_IDENTIFIER "${body_file}" body_var)
+        string(APPEND web_assets_asm
+            "\n"
+            "    .balign ${web_assets_align}\n"
+            "    .global _binary_${body_var}_start\n"
+            "_binary_${body_var}_start:\n"
+            "    .incbin \"${body_path}\"\n"
+            "    .global _binary_${body_var}_end\n"
+            "_binary_${body_var}_end:\n")
+        list(APPEND web_assets_files "${body_path}")
+
+        string(APPEND web_assets_decls
+            "extern const uint8_t _binary_${body_var}_start[];\n"
+            "extern const uint8_t _binary_${body_var}_end[];\n")
+
+        # Strong validators have to differ per content coding, and for deltas per dictionary
+        if(body_coding STREQUAL "identity")
+            set(body_coding_c "NULL")
+            set(body_etag "\\\"${asset_hash}\\\"")
+        else()
+            set(body_coding_c "\"${body_coding}\"")
+            set(body_etag "\\\"${asset_hash}-${body_coding}\\\"")
+        endif()
+
+        string(JSON body_dict ERROR_VARIABLE json_err GET "${web_assets_json}" assets ${i} encodings ${j}
+               availableDictionary)
+        if(json_err)
+            set(body_dict_c "NULL")
+        else()
+            string(JSON body_dict_sha GET "${web_assets_json}" assets ${i} encodings ${j} dictionary)
+            string(SUBSTRING "${body_dict_sha}" 0 8 body_dict_hash)
+            set(body_dict_c "\"${body_dict}\"")
+            set(body_etag "\\\"${asset_hash}-${body_coding}-${body_dict_hash}\\\"")
+            set(asset_has_deltas "true")
+        endif()
+
+        # The split body is a different byte sequence of the same coding
+        if(body_inject)
+            set(body_etag "\\\"${asset_hash}-${body_coding}-inject\\\"")
+        endif()
+
+        string(APPEND web_assets_bodies
+            "    {\n"
+            "        .coding = ${body_coding_c},\n"
+            "        .etag = \"${body_etag}\",\n"
+            "        .dictionary = ${body_dict_c},\n"
+            "        .start = _binary_${body_var}_start,\n"
+            "        .end = _binary_${body_var}_end,\n"
+            "        .inject = ${body_inject},\n"
+            "    },\n")
+    endforeach()
+
+    string(APPEND web_assets_bodies "};\n")
+
+    string(APPEND web_assets_entries
+        "    {\n"
+        "        .uri = \"${asset_uri}\",\n"
+        "        .type = \"${asset_type}\",\n"
+        "        .cache_control = \"${asset_cache}\",\n"
+        "        .use_as_dictionary = ${asset_dict_c},\n"
+        "        .sw_allowed = ${asset_sw_c},\n"
+        "        .etag = \"\\\"${asset_hash}\\\"\",\n"
+        "        .size = ${asset_size},\n"
+        "        .bodies = ${asset_var}_bodies,\n"
+        "        .bodies_count = ${bodies_count},\n"
+        "        .has_deltas = ${asset_has_deltas},\n"
+        "    },\n")
+endforeach()
+
+file(CONFIGURE OUTPUT "${WEB_ASSETS_SRC}" CONTENT "${web_assets_asm}" @ONLY)
+
+file(CONFIGURE OUTPUT "${WEB_ASSETS_TABLE}" CONTENT "/* Generated by web_assets.cmake, do not edit. */
+
+#include \"web_assets.h\"
+
+${web_assets_decls}${web_assets_bodies}
+const web_asset_t web_assets[] = {
+${web_assets_entries}};
+
+const size_t web_assets_count = ${web_assets_count};
+
+const int64_t web_assets_last_modified = ${web_assets_last_modified};
+" @ONLY)
+
+# The section is padded on both ends so neither the first nor the last asset
+# shares a cache line (or, with page alignment, an MMU page) with other rodata.
+file(CONFIGURE OUTPUT "${WEB_ASSETS_LF}" CONTENT "# Generated by web_assets.cmake, do not edit.
+
+[sections:web_assets]
+entries:
+    .rodata.web_assets+
+
+[scheme:web_assets]
+entries:
+    web_assets -> flash_rodata
+
+[mapping:web_assets]
+archive: libmain.a
+entries:
+    web_assets (web_assets);
+        web_assets -> flash_rodata ALIGN(@web_assets_align@, pre, post) SURROUND(web_assets) KEEP()
+" @ONLY)
+
+# .incbin is resolved by the assembler, so the compiler dependency scan does not see it
+set_property(SOURCE "${WEB_ASSETS_SRC}" APPEND PROPERTY OBJECT_DEPENDS ${web_assets_files})
@@ -0,0 +1,75 @@
+/**
+ * @file web_assets.h
+ * @brief Table of the embedded web assets
+ *
+ * The table and the asset bytes are generated at configure time by
+ * web_assets.cmake from the manifest that web/scripts/compress.mjs writes
+ * next to the web build. Each asset carries every content coding that was
+ * worth embedding, smallest first, including dcb/dcz deltas against the
+ * previous release for clients that hold it as a compression dictionary.
+ * With CONFIG_HTTPD_STATE_INJECT the gzip body of a page with a state
+ * element is made of two members, split where the firmware splices in the
+ * live state; its other codings are served without the state.
+ *
+ * @version 0.0.5
+ */
+
+#ifndef _WEB_ASSETS_H_
+#define _WEB_ASSETS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief One stored representation of an asset.
+ */
+typedef struct {
+    const char *coding;     /*!< Content-Encoding token, NULL for identity */
+    const char *etag;       /*!< strong entity tag of this representation */
+    const char *dictionary; /*!< Available-Dictionary value the body was encoded against, NULL if none */
+    const uint8_t *start;   /*!< first byte in flash */
+    const uint8_t *end;     /*!< one past the last byte */
+    size_t inject;          /*!< offset of the gzip member boundary the live state goes at, 0 if none */
+} web_asset_body_t;
+
+/**
+ * @brief An embedded asset.
+ */
+typedef struct {
+    const char *uri;                /*!< path the asset is served at */
+    const char *type;               /*!< Content-Type */
+    const char *cache_control;      /*!< Cache-Control */
+    const char *use_as_dictionary;  /*!< Use-As-Dictionary, NULL if the asset is not offered as one */
+    const char *sw_allowed;         /*!< Service-Worker-Allowed scope of a service worker script, NULL if none */
+    const char *etag;               /*!< strong entity tag of the identity representation */
+    size_t size;                    /*!< size of the identity representation */
+    const web_asset_body_t *bodies; /*!< stored representations, smallest first */
+    size_t bodies_count;
+    bool has_deltas; /*!< some bodies depend on Available-Dictionary */
+} web_asset_t;
+
+/**
+ * @brief All embedded assets, most frequently requested first.
+ */
+extern const web_asset_t web_assets[];
+
+/**
+ * @brief Number of entries in web_assets.
+ */
+extern const size_t web_assets_count;
+
+/**
+ * @brief Time of the web build in seconds since the epoch, UTC, 0 if the manifest does not record it.
+ */
+extern const int64_t web_assets_last_modified;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WEB_ASSETS_H_ */
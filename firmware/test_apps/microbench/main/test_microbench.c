@@ -0,0 +1,288 @@
+// Cycle counts of the work the server does per request, measured with esp_cpu_get_cycle_count() on the device or
+// in QEMU. Every benchmark prints one line
+//
+//   MICROBENCH {"name": "make_etag", "samples": 512, "min": 812, "p50": 830, "p99": 1104, "max": 2210, "ns_p50": 5187}
+//
+// with cycles per call, the cost of an empty call subtracted. tools/microbench.mjs collects the lines from a log
+// and compares them with a baseline. Under QEMU the counter advances with instructions, not real cycles: compare
+// QEMU runs with QEMU runs.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "esp_cpu.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "unity.h"
+
+static const char *TAG = "microbench";
+
+#define CLOSER_IMPLEMENTATION
+#include "closer.h"
+
+#define HTTP_COND_IMPLEMENTATION
+#include "http_cond.h"
+
+#define RESP_HEAD_IMPLEMENTATION
+#include "resp_head.h"
+
+#define APP_ETAG_IMPLEMENTATION
+#include "app_etag.h"
+
+#define MICROBENCH_WARMUP 32
+#define MICROBENCH_SAMPLES 512
+
+#define LED_PIN GPIO_NUM_8
+
+typedef void (*bench_fn_t)(void *arg);
+
+static uint32_t s_samples[MICROBENCH_SAMPLES];
+static uint32_t s_overhead;
+
+static int cmp_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Called through a pointer, so the compiler cannot fold the measured work into the loop
+static void bench_measure(bench_fn_t fn, void *arg) {
+    for (int i = 0; i < MICROBENCH_WARMUP; i++) {
+        fn(arg);
+    }
+
+    for (int i = 0; i < MICROBENCH_SAMPLES; i++) {
+        const esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+        fn(arg);
+        const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        s_samples[i] = cycles > s_overhead ? cycles - s_overhead : 0;
+    }
+
+    qsort(s_samples, MICROBENCH_SAMPLES, sizeof(s_samples[0]), cmp_u32);
+}
+
+static void bench_empty(void *arg) {
+    __asm__ __volatile__("" ::: "memory");
+}
+
+static void bench_run(const char *name, bench_fn_t fn, void *arg) {
+    if (!s_overhead) {
+        bench_measure(bench_empty, NULL);
+        s_overhead = s_samples[0];
+    }
+
+    bench_measure(fn, arg);
+
+    const uint32_t p50 = s_samples[MICROBENCH_SAMPLES / 2];
+    printf("MICROBENCH {\"name\": \"%s\", \"samples\": %d, \"min\": %" PRIu32 ", \"p50\": %" PRIu32
+           ", \"p99\": %" PRIu32 ", \"max\": %" PRIu32 ", \"ns_p50\": %" PRIu32 "}\n",
+           name, MICROBENCH_SAMPLES, s_samples[0], p50, s_samples[MICROBENCH_SAMPLES * 99 / 100],
+           s_samples[MICROBENCH_SAMPLES - 1], p50 * 1000 / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+}
+
+static void bench_make_etag(void *arg) {
+    make_etag(arg, APP_ETAG_LEN);
+}
+
+TEST_CASE("make_etag", "[microbench]") {
+    char etag[APP_ETAG_LEN];
+    TEST_ASSERT_EQUAL(ESP_OK, make_etag(etag, sizeof(etag)));
+    TEST_ASSERT_EQUAL(18, strlen(etag));
+
+    bench_run("make_etag", bench_make_etag, etag);
+}
+
+typedef struct {
+    const char *list;
+    const char *etag;
+    bool match;
+} etag_case_t;
+
+static void bench_etag_match(void *arg) {
+    const etag_case_t *c = arg;
+    http_etag_list_match(c->list, c->etag, true);
+}
+
+TEST_CASE("If-None-Match", "[microbench]") {
+    // What browsers send back: the ETag of the representation they cached, which may be another encoding's
+    static const etag_case_t cases[] = {
+        {"\"0123456789abcdef\"", "\"0123456789abcdef\"", true},
+        {"W/\"0123456789abcdef\"", "\"0123456789abcdef\"", true},
+        {"\"fedcba9876543210\"", "\"0123456789abcdef\"", false},
+        {"\"00000000000000-gz\", \"00000000000000-br\", \"0123456789abcdef\"", "\"0123456789abcdef\"", true},
+        {"*", "\"0123456789abcdef\"", true},
+    };
+    static const char *names[] = {
+        "inm/single", "inm/weak", "inm/miss", "inm/list_last", "inm/star",
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        TEST_ASSERT_EQUAL(cases[i].match, http_etag_list_match(cases[i].list, cases[i].etag, true));
+        bench_run(names[i], bench_etag_match, (void *)&cases[i]);
+    }
+}
+
+// esp_http_server keeps its lookup internal. This is the same scan over the handlers in the order server_start()
+// registers them: the path compared with every uri, length first, then the method. The API part comes from the list
+// main.c registers, with the options of firmware/main/Kconfig.projbuild; the assets stand in for the generated
+// web_assets[] of a typical web build, GET and HEAD each.
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+} route_t;
+
+static const route_t s_routes[] = {
+    {"/", HTTP_GET},
+    {"/", HTTP_HEAD},
+    {"/assets/index-0123abcd.js", HTTP_GET},
+    {"/assets/index-0123abcd.js", HTTP_HEAD},
+    {"/assets/index-4567ef01.css", HTTP_GET},
+    {"/assets/index-4567ef01.css", HTTP_HEAD},
+    {"/sw.js", HTTP_GET},
+    {"/sw.js", HTTP_HEAD},
+#define API_ROUTE(uri, method, handler, recorded) {uri, method},
+#include "api_routes.h"
+#undef API_ROUTE
+};
+#define ROUTES_COUNT (sizeof(s_routes) / sizeof(s_routes[0]))
+
+typedef struct {
+    const char *path; // as received, the query is not part of the match
+    httpd_method_t method;
+    bool registered;
+    int found;
+} dispatch_case_t;
+
+static int route_find(const char *path, size_t len, httpd_method_t method) {
+    for (size_t i = 0; i < ROUTES_COUNT; i++) {
+        if (strlen(s_routes[i].uri) == len && strncmp(s_routes[i].uri, path, len) == 0 &&
+            s_routes[i].method == method) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void bench_dispatch(void *arg) {
+    dispatch_case_t *c = arg;
+    c->found = route_find(c->path, strcspn(c->path, "?"), c->method);
+}
+
+TEST_CASE("route dispatch", "[microbench]") {
+    // Routes every build registers, from the front of the table to the back, and one it has no handler for
+    static dispatch_case_t cases[] = {
+        {"/", HTTP_GET, true},
+        {"/assets/index-0123abcd.js", HTTP_GET, true},
+        {"/api/led/on", HTTP_POST, true},
+        {"/api/config?pretty", HTTP_GET, true},
+        {"/favicon.ico", HTTP_GET, false},
+    };
+    static const char *names[] = {
+        "dispatch/root", "dispatch/asset", "dispatch/led_on", "dispatch/config", "dispatch/miss",
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bench_run(names[i], bench_dispatch, &cases[i]);
+
+        if (!cases[i].registered) {
+            TEST_ASSERT_EQUAL(-1, cases[i].found);
+            continue;
+        }
+        const size_t len = strcspn(cases[i].path, "?");
+        TEST_ASSERT_GREATER_OR_EQUAL(0, cases[i].found);
+        TEST_ASSERT_EQUAL(len, strlen(s_routes[cases[i].found].uri));
+        TEST_ASSERT_EQUAL_STRING_LEN(cases[i].path, s_routes[cases[i].found].uri, len);
+        TEST_ASSERT_EQUAL(cases[i].method, s_routes[cases[i].found].method);
+    }
+}
+
+typedef struct {
+    char buf[RESP_HEAD_MAX];
+    int len;
+} head_case_t;
+
+// The headers static_get_handler() sets for a compressed asset, written raw as for HEAD
+static void bench_head(void *arg) {
+    head_case_t *c = arg;
+    resp_hdrs_t hdrs = {0};
+    resp_hdrs_add(&hdrs, "Cache-Control", "public, max-age=31536000, immutable");
+    resp_hdrs_add(&hdrs, "ETag", "\"0123456789abcdef\"");
+    resp_hdrs_add(&hdrs, "Last-Modified", "Sat, 17 Oct 2026 12:00:00 GMT");
+    resp_hdrs_add(&hdrs, "Vary", "Accept-Encoding");
+    resp_hdrs_add(&hdrs, "Content-Encoding", "br");
+    resp_hdrs_add(&hdrs, "Accept-Ranges", "bytes");
+    c->len = resp_head_format(c->buf, sizeof(c->buf), "200 OK", "text/javascript", 48213, &hdrs);
+}
+
+TEST_CASE("header emission", "[microbench]") {
+    static head_case_t head;
+    bench_run("resp_head", bench_head, &head);
+
+    TEST_ASSERT_GREATER_THAN(0, head.len);
+    TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.1 200 OK\r\n", head.buf, 17);
+    TEST_ASSERT_EQUAL_STRING("\r\n\r\n", head.buf + head.len - 4);
+}
+
+static int s_closed;
+
+static void closer_count(void) {
+    s_closed++;
+}
+
+static void bench_closer(void *arg) {
+    closer_handle_t h = arg;
+    closer_add(h, closer_count);
+    closer_close(h);
+}
+
+static void bench_closer4(void *arg) {
+    closer_handle_t h = arg;
+    for (int i = 0; i < 4; i++) {
+        closer_add(h, closer_count);
+    }
+    closer_close(h);
+}
+
+TEST_CASE("closer_add/closer_close", "[microbench]") {
+    closer_handle_t h;
+    TEST_ASSERT_EQUAL(ESP_OK, closer_create(&h));
+
+    s_closed = 0;
+    bench_run("closer/1", bench_closer, h);
+    TEST_ASSERT_EQUAL(MICROBENCH_WARMUP + MICROBENCH_SAMPLES, s_closed);
+
+    bench_run("closer/4", bench_closer4, h);
+    closer_destroy(h);
+}
+
+static void bench_gpio(void *arg) {
+    uint32_t *level = arg;
+    gpio_set_level(LED_PIN, *level);
+    *level ^= 1;
+}
+
+TEST_CASE("GPIO write", "[microbench]") {
+    const gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << LED_PIN,
+        .mode = GPIO_MODE_OUTPUT,
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, gpio_config(&io_conf));
+
+    uint32_t level = 0;
+    bench_run("gpio_set_level", bench_gpio, &level);
+    gpio_set_level(LED_PIN, 1); // LED off
+}
+
+void app_main(void) {
+    printf("MICROBENCH {\"cpu_mhz\": %d}\n", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    UNITY_END();
+
+    printf("MICROBENCH done\n");
+}
@@ -0,0 +1,42 @@
+#!/usr/bin/env node
+// Changes settings of a device over PATCH /api/config (CONFIG_HTTPD_CONFIG_WRITE), signed with the shared key.
+//
+//   HTTPD_AUTH_KEY=secret node tools/config-patch.mjs mydevice.local http_port=8080 keep_alive=false
+//   node tools/config-patch.mjs 192.168.1.50 mdns_name=kitchen --key secret
+//
+// Prints the settings the device answers with.
+
+import { parseArgs } from 'node:util';
+import { authorization, digestField } from './http-auth.mjs';
+
+const { values: opts, positionals } = parseArgs({
+  allowPositionals: true,
+  options: {
+    key: { type: 'string', default: process.env.HTTPD_AUTH_KEY ?? '' },
+  },
+});
+
+const [host, ...fields] = positionals;
+if (!host || fields.length === 0 || !opts.key || !fields.every((f) => f.includes('='))) {
+  console.error('usage: config-patch.mjs <host> <field=value>... --key <key>');
+  process.exit(2);
+}
+
+const body = new URLSearchParams(fields.map((f) => [f.slice(0, f.indexOf('=')), f.slice(f.indexOf('=') + 1)]));
+const digest = digestField(body.toString());
+
+const res = await fetch(`http://${host}/api/config`, {
+  method: 'PATCH',
+  headers: {
+    'Content-Type': 'application/x-www-form-urlencoded',
+    'Content-Digest': digest,
+    Authorization: authorization(opts.key, 'PATCH', '/api/config', digest),
+  },
+  body: body.toString(),
+});
+
+if (!res.ok) {
+  console.error(`PATCH /api/config: ${res.status} ${await res.text()}`);
+  process.exit(1);
+}
+console.log(JSON.stringify(await res.json(), null, 2));
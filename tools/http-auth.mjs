@@ -0,0 +1,28 @@
+// Signs requests to the endpoints that change the device, see firmware/main/http_auth.h for the scheme. Used by
+// config-patch.mjs, ota-upload.mjs and ota-delta.mjs; the key is the one of the UDP commands (CONFIG_HTTPD_AUTH_KEY).
+
+import { createHash, createHmac } from 'node:crypto';
+
+const MAC_LEN = 16;
+
+// Microseconds since the epoch, so sequence numbers keep growing across restarts of both ends, and never
+// twice the same one within a process
+let lastSeq = 0n;
+function nextSeq() {
+  const now = BigInt(Date.now()) * 1000n + BigInt(process.hrtime()[1] % 1000);
+  lastSeq = now > lastSeq ? now : lastSeq + 1n;
+  return lastSeq;
+}
+
+// RFC 9530 field value of a SHA-256
+export const digestField = (data) => `sha-256=:${createHash('sha256').update(data).digest('base64')}:`;
+
+// Headers for one request; the digest field has to be sent as well, the body must match it
+export function authorization(key, method, uri, digest) {
+  const seq = nextSeq();
+  const mac = createHmac('sha256', key)
+    .update(`${method} ${uri}\n${seq}\n${digest}`)
+    .digest()
+    .subarray(0, MAC_LEN);
+  return `HMAC-SHA256 ${seq}:${mac.toString('hex')}`;
+}
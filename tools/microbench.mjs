@@ -0,0 +1,90 @@
+#!/usr/bin/env node
+// Collects the MICROBENCH lines of a firmware/test_apps/microbench run into JSON and compares them with a baseline.
+//
+//   node tools/microbench.mjs firmware/test_apps/microbench/build/qemu.log --save microbench.json
+//   idf.py -C firmware/test_apps/microbench flash monitor | tee run.log
+//   node tools/microbench.mjs run.log --baseline microbench.json --tolerance 10
+//
+// Fails when a Unity test failed, the run did not finish, or a p50 grew more than --tolerance percent over the
+// baseline. Only compare runs of the same kind: QEMU counts instructions, the device counts cycles.
+
+import { readFile, writeFile } from 'node:fs/promises';
+import { parseArgs } from 'node:util';
+
+const { values: opts, positionals } = parseArgs({
+  allowPositionals: true,
+  options: {
+    baseline: { type: 'string' },
+    save: { type: 'string' },
+    tolerance: { type: 'string', default: '10' },
+  },
+});
+
+if (positionals.length > 1) {
+  console.error('usage: microbench.mjs [log] [--save results.json] [--baseline results.json] [--tolerance percent]');
+  process.exit(2);
+}
+
+async function readStdin() {
+  const chunks = [];
+  for await (const chunk of process.stdin) chunks.push(chunk);
+  return Buffer.concat(chunks).toString();
+}
+
+const log = positionals[0] ? await readFile(positionals[0], 'utf8') : await readStdin();
+
+const results = { cpu_mhz: null, benchmarks: [] };
+let done = false;
+let failures = null;
+
+for (const line of log.split(/\r?\n/)) {
+  const at = line.indexOf('MICROBENCH ');
+  if (at >= 0) {
+    const rest = line.slice(at + 'MICROBENCH '.length).trim();
+    if (rest === 'done') {
+      done = true;
+    } else if (rest.startsWith('{')) {
+      const entry = JSON.parse(rest);
+      if ('cpu_mhz' in entry) results.cpu_mhz = entry.cpu_mhz;
+      else results.benchmarks.push(entry);
+    }
+  }
+  // Unity summary: "12 Tests 0 Failures 0 Ignored"
+  const summary = line.match(/(\d+) Tests (\d+) Failures (\d+) Ignored/);
+  if (summary) failures = Number(summary[2]);
+}
+
+const json = JSON.stringify(results, null, 2);
+console.log(json);
+if (opts.save) await writeFile(opts.save, json + '\n');
+
+let failed = false;
+if (!done) {
+  console.error('run did not finish');
+  failed = true;
+}
+if (failures) {
+  console.error(`${failures} test(s) failed`);
+  failed = true;
+}
+
+if (opts.baseline) {
+  const baseline = JSON.parse(await readFile(opts.baseline, 'utf8'));
+  const tolerance = Number(opts.tolerance) / 100;
+  const current = new Map(results.benchmarks.map((b) => [b.name, b]));
+
+  for (const base of baseline.benchmarks) {
+    const now = current.get(base.name);
+    if (!now) {
+      console.error(`${base.name}: missing`);
+      failed = true;
+      continue;
+    }
+    const change = base.p50 ? (now.p50 - base.p50) / base.p50 : 0;
+    const verdict = change > tolerance ? 'REGRESSION' : 'ok';
+    console.error(`${base.name}: ${base.p50} -> ${now.p50} cycles (${(change * 100).toFixed(1)}%) ${verdict}`);
+    if (change > tolerance) failed = true;
+  }
+}
+
+process.exit(failed ? 1 : 0);
@@ -0,0 +1,358 @@
+#!/usr/bin/env node
+// Delta firmware updates, see firmware/main/ota_delta.h for the patch format.
+//
+//   node tools/ota-delta.mjs diff old.bin new.bin patch.bin
+//   HTTPD_AUTH_KEY=secret node tools/ota-delta.mjs push new.bin --base builds/ mydevice.local 192.168.1.51
+//
+// push asks every device for the app_elf_sha256 of its running image, looks the image up among the *.bin files
+// of --base, and sends each group of devices one patch against its image to PUT /api/ota/delta, signed with the
+// shared key (--key, see tools/http-auth.mjs) over the Repr-Digest of the new image. Devices whose image is not
+// found are listed, update them with ota-upload.mjs.
+
+import { createHash } from 'node:crypto';
+import { readdir, readFile, writeFile } from 'node:fs/promises';
+import { join } from 'node:path';
+import { parseArgs } from 'node:util';
+import { deflateRawSync, inflateRawSync } from 'node:zlib';
+import { authorization, digestField } from './http-auth.mjs';
+
+const MAGIC = 'OTAD';
+const VERSION = 1;
+const HEADER_LEN = 76;
+const RECORD_LEN = 12;
+
+// esp_image_header_t and the first esp_image_segment_header_t come before esp_app_desc_t
+const APP_DESC_OFFSET = 24 + 8;
+const APP_DESC_MAGIC = 0xabcd5432;
+const ELF_SHA256_OFFSET = APP_DESC_OFFSET + 144;
+
+function elfSha256(image) {
+  if (image.length < ELF_SHA256_OFFSET + 32 || image.readUInt32LE(APP_DESC_OFFSET) !== APP_DESC_MAGIC) {
+    throw new Error('not an application image');
+  }
+  return image.subarray(ELF_SHA256_OFFSET, ELF_SHA256_OFFSET + 32);
+}
+
+// Suffix array by Larsson-Sadakane qsufsort, as in bsdiff
+function split(I, V, start, len, h) {
+  if (len < 16) {
+    for (let k = start, j; k < start + len; k += j) {
+      j = 1;
+      let x = V[I[k] + h];
+      for (let i = 1; k + i < start + len; i++) {
+        if (V[I[k + i] + h] < x) {
+          x = V[I[k + i] + h];
+          j = 0;
+        }
+        if (V[I[k + i] + h] === x) {
+          [I[k + j], I[k + i]] = [I[k + i], I[k + j]];
+          j++;
+        }
+      }
+      for (let i = 0; i < j; i++) V[I[k + i]] = k + j - 1;
+      if (j === 1) I[k] = -1;
+    }
+    return;
+  }
+
+  const x = V[I[start + (len >> 1)] + h];
+  let jj = 0;
+  let kk = 0;
+  for (let i = start; i < start + len; i++) {
+    if (V[I[i] + h] < x) jj++;
+    if (V[I[i] + h] === x) kk++;
+  }
+  jj += start;
+  kk += jj;
+
+  let i = start;
+  let j = 0;
+  let k = 0;
+  while (i < jj) {
+    if (V[I[i] + h] < x) {
+      i++;
+    } else if (V[I[i] + h] === x) {
+      [I[i], I[jj + j]] = [I[jj + j], I[i]];
+      j++;
+    } else {
+      [I[i], I[kk + k]] = [I[kk + k], I[i]];
+      k++;
+    }
+  }
+  while (jj + j < kk) {
+    if (V[I[jj + j] + h] === x) {
+      j++;
+    } else {
+      [I[jj + j], I[kk + k]] = [I[kk + k], I[jj + j]];
+      k++;
+    }
+  }
+
+  if (jj > start) split(I, V, start, jj - start, h);
+  for (let n = 0; n < kk - jj; n++) V[I[jj + n]] = kk - 1;
+  if (jj === kk - 1) I[jj] = -1;
+  if (start + len > kk) split(I, V, kk, start + len - kk, h);
+}
+
+function qsufsort(old) {
+  const n = old.length;
+  const I = new Int32Array(n + 1);
+  const V = new Int32Array(n + 1);
+  const buckets = new Int32Array(256);
+
+  for (let i = 0; i < n; i++) buckets[old[i]]++;
+  for (let i = 1; i < 256; i++) buckets[i] += buckets[i - 1];
+  for (let i = 255; i > 0; i--) buckets[i] = buckets[i - 1];
+  buckets[0] = 0;
+
+  for (let i = 0; i < n; i++) I[++buckets[old[i]]] = i;
+  I[0] = n;
+  for (let i = 0; i < n; i++) V[i] = buckets[old[i]];
+  V[n] = 0;
+  for (let i = 1; i < 256; i++) if (buckets[i] === buckets[i - 1] + 1) I[buckets[i]] = -1;
+  I[0] = -1;
+
+  for (let h = 1; I[0] !== -(n + 1); h += h) {
+    let len = 0;
+    let i = 0;
+    while (i < n + 1) {
+      if (I[i] < 0) {
+        len -= I[i];
+        i -= I[i];
+      } else {
+        if (len) I[i - len] = -len;
+        len = V[I[i]] + 1 - i;
+        split(I, V, i, len, h);
+        i += len;
+        len = 0;
+      }
+    }
+    if (len) I[i - len] = -len;
+  }
+
+  for (let i = 0; i < n + 1; i++) I[V[i]] = i;
+  return I;
+}
+
+function matchLen(old, oldPos, next, nextPos) {
+  let i = 0;
+  while (oldPos + i < old.length && nextPos + i < next.length && old[oldPos + i] === next[nextPos + i]) i++;
+  return i;
+}
+
+// Longest match of next[scan..] in old, by binary search over the suffix array
+function search(I, old, next, scan) {
+  let st = 0;
+  let en = old.length;
+  while (en - st >= 2) {
+    const x = st + ((en - st) >> 1);
+    const n = Math.min(old.length - I[x], next.length - scan);
+    if (old.compare(next, scan, scan + n, I[x], I[x] + n) < 0) st = x;
+    else en = x;
+  }
+  const a = matchLen(old, I[st], next, scan);
+  const b = matchLen(old, I[en], next, scan);
+  return a > b ? { len: a, pos: I[st] } : { len: b, pos: I[en] };
+}
+
+// bsdiff: exact matches found by the suffix array are extended into approximate ones, whatever does not match
+// well enough becomes extra bytes
+function* records(old, next) {
+  const I = qsufsort(old);
+  let scan = 0;
+  let len = 0;
+  let pos = 0;
+  let lastScan = 0;
+  let lastPos = 0;
+  let lastOffset = 0;
+
+  while (scan < next.length) {
+    let oldScore = 0;
+    let scsc = (scan += len);
+    for (; scan < next.length; scan++) {
+      ({ len, pos } = search(I, old, next, scan));
+      for (; scsc < scan + len; scsc++) {
+        if (scsc + lastOffset < old.length && old[scsc + lastOffset] === next[scsc]) oldScore++;
+      }
+      if ((len === oldScore && len !== 0) || len > oldScore + 8) break;
+      if (scan + lastOffset < old.length && old[scan + lastOffset] === next[scan]) oldScore--;
+    }
+
+    if (len === oldScore && scan !== next.length) continue;
+
+    let s = 0;
+    let sf = 0;
+    let lenf = 0;
+    for (let i = 0; lastScan + i < scan && lastPos + i < old.length; ) {
+      if (old[lastPos + i] === next[lastScan + i]) s++;
+      i++;
+      if (s * 2 - i > sf * 2 - lenf) {
+        sf = s;
+        lenf = i;
+      }
+    }
+
+    let lenb = 0;
+    if (scan < next.length) {
+      let sb = 0;
+      s = 0;
+      for (let i = 1; scan >= lastScan + i && pos >= i; i++) {
+        if (old[pos - i] === next[scan - i]) s++;
+        if (s * 2 - i > sb * 2 - lenb) {
+          sb = s;
+          lenb = i;
+        }
+      }
+    }
+
+    if (lastScan + lenf > scan - lenb) {
+      const overlap = lastScan + lenf - (scan - lenb);
+      let ss = 0;
+      let lens = 0;
+      s = 0;
+      for (let i = 0; i < overlap; i++) {
+        if (next[lastScan + lenf - overlap + i] === old[lastPos + lenf - overlap + i]) s++;
+        if (next[scan - lenb + i] === old[pos - lenb + i]) s--;
+        if (s > ss) {
+          ss = s;
+          lens = i + 1;
+        }
+      }
+      lenf += lens - overlap;
+      lenb -= lens;
+    }
+
+    const diff = Buffer.alloc(lenf);
+    for (let i = 0; i < lenf; i++) diff[i] = next[lastScan + i] - old[lastPos + i];
+    const extra = next.subarray(lastScan + lenf, scan - lenb);
+    yield { diff, extra, seek: pos - lenb - (lastPos + lenf) };
+
+    lastScan = scan - lenb;
+    lastPos = pos - lenb;
+    lastOffset = pos - scan;
+  }
+}
+
+function diff(old, next) {
+  const header = Buffer.alloc(HEADER_LEN);
+  header.write(MAGIC, 0, 'latin1');
+  header.writeUInt32LE(VERSION, 4);
+  elfSha256(old).copy(header, 8);
+  createHash('sha256').update(next).digest().copy(header, 40);
+  header.writeUInt32LE(next.length, 72);
+
+  const parts = [header];
+  for (const { diff, extra, seek } of records(old, next)) {
+    const record = Buffer.alloc(RECORD_LEN);
+    record.writeUInt32LE(diff.length, 0);
+    record.writeUInt32LE(extra.length, 4);
+    record.writeInt32LE(seek, 8);
+    parts.push(record, diff, extra);
+  }
+
+  const patch = deflateRawSync(Buffer.concat(parts), { level: 9 });
+  if (!apply(old, patch).equals(next)) throw new Error('patch does not rebuild the new image');
+  return patch;
+}
+
+// Same steps as the device, to check every patch before it is sent
+function apply(old, patch) {
+  const raw = inflateRawSync(patch);
+  const size = raw.readUInt32LE(72);
+  const out = Buffer.alloc(size);
+  let at = HEADER_LEN;
+  let oldPos = 0;
+  let outPos = 0;
+
+  while (outPos < size) {
+    const diffLen = raw.readUInt32LE(at);
+    const extraLen = raw.readUInt32LE(at + 4);
+    const seek = raw.readInt32LE(at + 8);
+    at += RECORD_LEN;
+    for (let i = 0; i < diffLen; i++) out[outPos++] = old[oldPos++] + raw[at++];
+    raw.copy(out, outPos, at, at + extraLen);
+    outPos += extraLen;
+    at += extraLen;
+    oldPos += seek;
+  }
+  return out;
+}
+
+async function pushPatch(host, patch, digest, key) {
+  const res = await fetch(`http://${host}/api/ota/delta`, {
+    method: 'PUT',
+    headers: {
+      'Content-Type': 'application/octet-stream',
+      'Repr-Digest': digest,
+      Authorization: authorization(key, 'PUT', '/api/ota/delta', digest),
+    },
+    body: patch,
+  });
+  if (!res.ok) throw new Error(`PUT /api/ota/delta: ${res.status} ${await res.text()}`);
+  const st = await res.json();
+  console.log(`${host}: ${st.state}, ${st.elapsed_us / 1000} ms, flash ${st.flash_us} us, sha256 ${st.sha256}`);
+}
+
+async function push(file, baseDir, hosts, key) {
+  const next = await readFile(file);
+  const digest = digestField(next);
+  const bases = new Map();
+  for (const name of await readdir(baseDir)) {
+    if (!name.endsWith('.bin')) continue;
+    const image = await readFile(join(baseDir, name));
+    try {
+      bases.set(elfSha256(image).toString('hex'), image);
+    } catch {
+      // bootloader, partition table and the like
+    }
+  }
+
+  const groups = new Map();
+  const missing = [];
+  await Promise.all(
+    hosts.map(async (host) => {
+      const res = await fetch(`http://${host}/api/ota`);
+      const { elf_sha256: sha } = await res.json();
+      if (!bases.has(sha)) return missing.push(`${host} (${sha})`);
+      groups.set(sha, [...(groups.get(sha) ?? []), host]);
+    }),
+  );
+
+  let failed = 0;
+  for (const [sha, group] of groups) {
+    const patch = diff(bases.get(sha), next);
+    console.log(`base ${sha.slice(0, 16)}: ${patch.length} byte patch for ${next.length} bytes, ${group.length} device(s)`);
+    const results = await Promise.allSettled(group.map((host) => pushPatch(host, patch, digest, key)));
+    results.forEach((r, i) => {
+      if (r.status === 'rejected') {
+        failed++;
+        console.error(`${group[i]}: ${r.reason.message}`);
+      }
+    });
+  }
+
+  if (missing.length) console.error(`no base image for: ${missing.join(', ')}`);
+  return failed + missing.length;
+}
+
+const { values: opts, positionals } = parseArgs({
+  allowPositionals: true,
+  options: {
+    base: { type: 'string' },
+    key: { type: 'string', default: process.env.HTTPD_AUTH_KEY ?? '' },
+  },
+});
+const [command, ...args] = positionals;
+
+if (command === 'diff' && args.length === 3) {
+  const [old, next] = await Promise.all([readFile(args[0]), readFile(args[1])]);
+  const patch = diff(old, next);
+  await writeFile(args[2], patch);
+  console.log(`${patch.length} byte patch for ${next.length} bytes (${((patch.length / next.length) * 100).toFixed(1)}%)`);
+} else if (command === 'push' && args.length >= 2 && opts.base && opts.key) {
+  process.exit((await push(args[0], opts.base, args.slice(1), opts.key)) ? 1 : 0);
+} else {
+  console.error('usage: ota-delta.mjs diff <old.bin> <new.bin> <patch>');
+  console.error('       ota-delta.mjs push <new.bin> --base <dir> --key <key> <host>...');
+  process.exit(2);
+}
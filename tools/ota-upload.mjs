@@ -0,0 +1,132 @@
+#!/usr/bin/env node
+// Uploads a firmware image to PUT /api/ota of one or more devices in parallel.
+//
+//   HTTPD_AUTH_KEY=secret node tools/ota-upload.mjs firmware/build/httpd_poc.bin mydevice.local 192.168.1.51
+//   node tools/ota-upload.mjs firmware/build/httpd_poc.bin mydevice.local --key secret --piece 65536 --no-resume
+//   node tools/ota-upload.mjs --abort mydevice.local --key secret
+//
+// The image goes in Content-Range pieces with its SHA-256 in Repr-Digest, each piece signed with the shared key
+// (CONFIG_HTTPD_AUTH_KEY, see tools/http-auth.mjs). After a disconnect the device keeps what it received: the
+// upload continues at the offset GET /api/ota reports, if the session there is for the same image, and starts
+// over otherwise. --abort drops the session of each device instead, with a signed DELETE /api/ota.
+
+import { createHash } from 'node:crypto';
+import { readFile } from 'node:fs/promises';
+import { parseArgs } from 'node:util';
+import { authorization, digestField } from './http-auth.mjs';
+
+const { values: opts, positionals } = parseArgs({
+  allowPositionals: true,
+  options: {
+    key: { type: 'string', default: process.env.HTTPD_AUTH_KEY ?? '' },
+    piece: { type: 'string', default: String(256 * 1024) },
+    retries: { type: 'string', default: '5' },
+    'no-resume': { type: 'boolean', default: false },
+    abort: { type: 'boolean', default: false },
+  },
+});
+
+const [file, ...hosts] = opts.abort ? [null, ...positionals] : positionals;
+if ((!file && !opts.abort) || hosts.length === 0 || !opts.key) {
+  console.error('usage: ota-upload.mjs <image.bin> <host>... --key <key> [--piece bytes] [--retries n] [--no-resume]');
+  console.error('       ota-upload.mjs --abort <host>... --key <key>');
+  process.exit(2);
+}
+
+async function abort(host) {
+  const digest = digestField('');
+  const res = await fetch(`http://${host}/api/ota`, {
+    method: 'DELETE',
+    headers: { 'Content-Digest': digest, Authorization: authorization(opts.key, 'DELETE', '/api/ota', digest) },
+  });
+  if (!res.ok) throw new Error(`DELETE /api/ota: ${res.status} ${await res.text()}`);
+  console.log(`${host}: aborted`);
+}
+
+if (opts.abort) {
+  const results = await Promise.allSettled(hosts.map(abort));
+  results.forEach((r, i) => r.status === 'rejected' && console.error(`${hosts[i]}: ${r.reason.message}`));
+  process.exit(results.some((r) => r.status === 'rejected') ? 1 : 0);
+}
+
+const image = await readFile(file);
+const sha256 = createHash('sha256').update(image).digest();
+const digest = digestField(image);
+const piece = Number(opts.piece);
+const retries = Number(opts.retries);
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+async function status(base) {
+  const res = await fetch(`${base}/api/ota`);
+  if (!res.ok) throw new Error(`GET /api/ota: ${res.status}`);
+  return res.json();
+}
+
+// Where the device can continue with this image, 0 for a new session
+function resumeOffset(st) {
+  if (opts['no-resume'] || st.state !== 'receiving') return 0;
+  if (st.total !== image.length || st.digest !== sha256.toString('hex')) return 0;
+  return st.offset;
+}
+
+async function upload(host) {
+  const base = `http://${host}`;
+  const start = performance.now();
+  let offset = resumeOffset(await status(base));
+  let failures = 0;
+  let last;
+
+  if (offset) console.log(`${host}: resuming at ${offset} of ${image.length}`);
+
+  while (offset < image.length) {
+    const end = Math.min(offset + piece, image.length);
+    try {
+      const res = await fetch(`${base}/api/ota`, {
+        method: 'PUT',
+        headers: {
+          'Content-Type': 'application/octet-stream',
+          'Content-Range': `bytes ${offset}-${end - 1}/${image.length}`,
+          'Repr-Digest': digest,
+          Authorization: authorization(opts.key, 'PUT', '/api/ota', digest),
+        },
+        body: image.subarray(offset, end),
+      });
+
+      if (res.status === 409) {
+        // Someone else's session, or a reboot dropped ours
+        const st = await res.json();
+        offset = resumeOffset(st);
+        continue;
+      }
+      if (!res.ok) throw new Error(`PUT /api/ota: ${res.status} ${await res.text()}`);
+
+      last = await res.json();
+      offset = end;
+      failures = 0;
+      process.stdout.write(
+        `${host}: ${end}/${image.length} ${last.kb_per_s?.toFixed(1)} KB/s (flash ${last.flash_us} us, wait ${last.wait_us} us)\n`,
+      );
+    } catch (err) {
+      if (++failures > retries) throw err;
+      console.error(`${host}: ${err.message}, retrying`);
+      await sleep(500 * failures);
+      offset = resumeOffset(await status(base).catch(() => ({})));
+    }
+  }
+
+  const seconds = (performance.now() - start) / 1000;
+  console.log(
+    `${host}: ${last.state}, ${(image.length / 1024 / seconds).toFixed(1)} KB/s overall, sha256 ${last.sha256}`,
+  );
+}
+
+const results = await Promise.allSettled(hosts.map(upload));
+let failed = 0;
+results.forEach((r, i) => {
+  if (r.status === 'rejected') {
+    failed++;
+    console.error(`${hosts[i]}: ${r.reason.message}`);
+  }
+});
+process.exit(failed ? 1 : 0);
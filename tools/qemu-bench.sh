@@ -0,0 +1,46 @@
+#!/bin/sh
+# Boots a QEMU build of the firmware, forwards its HTTP port to the host and runs a benchmark against it.
+#
+#   tools/qemu-bench.sh firmware/build-qemu 8081 [command...]
+#
+# The command finds the server at $BENCH_URL. Without one a few requests are timed with curl. The image has to be
+# built with HTTPD_NET_OPENETH, see `make build-qemu`; GUEST_PORT is its HTTPD_HTTP_PORT.
+set -eu
+
+build=$1
+port=$2
+shift 2
+log=$build/qemu.log
+
+# Own process group, so stopping it takes QEMU down along with idf.py
+setsid idf.py -C "$(dirname "$0")/../firmware" -B "$build" qemu \
+    --qemu-extra-args "-nic user,model=open_eth,hostfwd=tcp:127.0.0.1:$port-:${GUEST_PORT:-80}" >"$log" 2>&1 &
+qemu=$!
+trap 'kill -- -$qemu 2>/dev/null || true' EXIT INT TERM
+
+export BENCH_URL="http://127.0.0.1:$port"
+
+# Boot, DHCP from the QEMU user network and the server start take a while in the emulator
+tries=0
+until curl -sf -o /dev/null "$BENCH_URL/api/metrics"; do
+    if ! kill -0 $qemu 2>/dev/null; then
+        cat "$log"
+        echo "qemu exited" >&2
+        exit 1
+    fi
+    tries=$((tries + 1))
+    if [ $tries -ge 120 ]; then
+        tail -n 50 "$log"
+        echo "no response from $BENCH_URL" >&2
+        exit 1
+    fi
+    sleep 1
+done
+
+if [ $# -gt 0 ]; then
+    "$@"
+else
+    for path in / /index.html /api/metrics; do
+        curl -s -o /dev/null -w "$path %{http_code} %{size_download} B %{time_total} s\n" "$BENCH_URL$path"
+    done
+fi
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Runs the microbenchmark test app in Espressif QEMU and prints its results as JSON.
+#
+#   tools/qemu-microbench.sh firmware/test_apps/microbench/build [--baseline results.json] [--tolerance percent]
+#
+# The app has to be built, see `make build-microbench`. Arguments after the build directory go to
+# tools/microbench.mjs.
+set -eu
+
+build=$1
+shift
+log=$build/qemu.log
+tools=$(dirname "$0")
+
+# Own process group, so stopping it takes QEMU down along with idf.py
+setsid idf.py -C "$tools/../firmware/test_apps/microbench" -B "$build" qemu >"$log" 2>&1 &
+qemu=$!
+trap 'kill -- -$qemu 2>/dev/null || true' EXIT INT TERM
+
+# The app idles once the suite is through
+tries=0
+until grep -q 'MICROBENCH done' "$log"; do
+    if ! kill -0 $qemu 2>/dev/null; then
+        cat "$log"
+        echo "qemu exited" >&2
+        exit 1
+    fi
+    tries=$((tries + 1))
+    if [ $tries -ge 300 ]; then
+        tail -n 50 "$log"
+        echo "no results after $tries s" >&2
+        exit 1
+    fi
+    sleep 1
+done
+
+node "$tools/microbench.mjs" "$log" "$@"
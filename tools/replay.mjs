@@ -0,0 +1,184 @@
+#!/usr/bin/env node
+// Replays a capture of GET /api/record (CONFIG_HTTPD_RECORD) against a server: the linux build, the QEMU image or
+// another device.
+//
+//   curl -s http://192.168.4.1/api/record > capture.json
+//   node tools/replay.mjs capture.json http://localhost:8080 --speed 10
+//   make bench-qemu BENCH="node tools/replay.mjs capture.json --speed 0"
+//
+// Every recorded connection gets its own keep-alive socket and replays its requests in order, each one started at
+// its recorded offset divided by --speed: 1 keeps the original inter-arrival times, 0 sends as fast as the server
+// answers. The target defaults to $BENCH_URL.
+//
+// The capture holds no header values or bodies, so requests are rebuilt from the flags: Accept-Encoding from the
+// recorded codings, If-None-Match and If-Modified-Since from a GET of the same uri before the run, a fixed
+// "Range: bytes=0-1023" and a filler body of the recorded size. Requests that change the device (PUT, PATCH,
+// DELETE and /api/ota) are skipped unless --all is given. Prints JSON with latency percentiles, status codes that
+// differ from the recording and how late requests started against the schedule.
+
+import http from 'node:http';
+import { readFile } from 'node:fs/promises';
+import { parseArgs } from 'node:util';
+
+const { values: opts, positionals } = parseArgs({
+  allowPositionals: true,
+  options: {
+    speed: { type: 'string', default: '1' },
+    timeout: { type: 'string', default: '5000' },
+    all: { type: 'boolean', default: false },
+  },
+});
+
+const target = positionals[1] ?? process.env.BENCH_URL;
+const speed = Number(opts.speed);
+const timeout = Number(opts.timeout);
+
+if (!positionals[0] || !target || !(speed >= 0) || !(timeout > 0)) {
+  console.error('usage: replay.mjs <capture.json|-> [url] [--speed N] [--timeout ms] [--all]');
+  process.exit(2);
+}
+
+const RANGE = 'bytes=0-1023';
+const UNSAFE = new Set(['PUT', 'PATCH', 'DELETE']);
+
+async function readStdin() {
+  const chunks = [];
+  for await (const chunk of process.stdin) chunks.push(chunk);
+  return Buffer.concat(chunks).toString();
+}
+
+const capture = JSON.parse(positionals[0] === '-' ? await readStdin() : await readFile(positionals[0], 'utf8'));
+if (capture.dropped) {
+  console.error(`replay: the ring overflowed, the first ${capture.dropped} requests are missing`);
+}
+
+const entries = capture.entries.filter(
+  (e) => opts.all || (!UNSAFE.has(e.method) && !e.uri.startsWith('/api/ota')),
+);
+if (!entries.length) {
+  console.error('replay: nothing to replay');
+  process.exit(1);
+}
+
+const base = new URL(target);
+
+function request(agent, method, uri, headers, body) {
+  return new Promise((resolve) => {
+    const req = http.request(new URL(uri, base), { agent, method, headers, timeout }, (res) => {
+      let bytes = 0;
+      res.on('data', (chunk) => (bytes += chunk.length));
+      res.on('end', () => resolve({ status: res.statusCode, headers: res.headers, bytes }));
+      res.on('error', (err) => resolve({ error: err.code ?? 'io' }));
+    });
+    req.on('timeout', () => req.destroy(Object.assign(new Error('timeout'), { code: 'timeout' })));
+    req.on('error', (err) => resolve({ error: err.code ?? 'io' }));
+    req.end(body);
+  });
+}
+
+function acceptEncoding(e) {
+  return e.ae.length ? e.ae.join(', ') : 'identity';
+}
+
+// Validators of the current image, fetched once per uri and encoding, so conditional requests hit like they did
+const validators = new Map();
+const prefetch = new http.Agent({ keepAlive: true, maxSockets: 1 });
+for (const e of entries) {
+  const key = `${e.uri} ${acceptEncoding(e)}`;
+  if ((e.inm || e.ims) && !validators.has(key)) {
+    const res = await request(prefetch, 'GET', e.uri, { 'Accept-Encoding': acceptEncoding(e) });
+    validators.set(key, res.headers ?? {});
+  }
+}
+prefetch.destroy();
+
+function headersOf(e) {
+  const headers = { 'Accept-Encoding': acceptEncoding(e) };
+  const cached = validators.get(`${e.uri} ${acceptEncoding(e)}`);
+  if (e.inm && cached?.etag) headers['If-None-Match'] = cached.etag;
+  if (e.ims && cached?.['last-modified']) headers['If-Modified-Since'] = cached['last-modified'];
+  if (e.range) headers.Range = RANGE;
+  if (e.cbor) headers.Accept = 'application/cbor';
+  if (e.req_bytes) headers['Content-Length'] = e.req_bytes;
+  return headers;
+}
+
+const first = entries[0].at_us;
+const results = [];
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+async function replayConn(list) {
+  const agent = new http.Agent({ keepAlive: true, maxSockets: 1 });
+  for (const e of list) {
+    const due = speed ? (e.at_us - first) / 1000 / speed : 0;
+    const wait = due - (performance.now() - start);
+    if (wait > 0) await sleep(wait);
+
+    const begin = performance.now();
+    const body = e.req_bytes ? Buffer.alloc(e.req_bytes, ' ') : undefined;
+    const res = await request(agent, e.method, e.uri, headersOf(e), body);
+    results.push({ e, res, lag: begin - start - due, us: (performance.now() - begin) * 1000 });
+  }
+  agent.destroy();
+}
+
+const conns = new Map();
+for (const e of entries) {
+  if (!conns.has(e.conn)) conns.set(e.conn, []);
+  conns.get(e.conn).push(e);
+}
+
+const start = performance.now();
+await Promise.all([...conns.values()].map(replayConn));
+const elapsed = (performance.now() - start) / 1000;
+
+function percentiles(values) {
+  const sorted = values.toSorted((a, b) => a - b);
+  const at = (p) => Math.round(sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))] ?? 0);
+  return { count: sorted.length, p50: at(0.5), p99: at(0.99), p999: at(0.999), max: at(1) };
+}
+
+const ok = results.filter((r) => !r.res.error);
+const errors = {};
+const status = {};
+const mismatches = {};
+const byUri = {};
+
+for (const { e, res, us } of results) {
+  if (res.error) {
+    errors[res.error] = (errors[res.error] ?? 0) + 1;
+    continue;
+  }
+  status[res.status] = (status[res.status] ?? 0) + 1;
+  if (res.status !== e.status) {
+    const key = `${e.method} ${e.uri} ${e.status}->${res.status}`;
+    mismatches[key] = (mismatches[key] ?? 0) + 1;
+  }
+  (byUri[`${e.method} ${e.uri}`] ??= []).push(us);
+}
+
+console.log(
+  JSON.stringify(
+    {
+      url: base.href,
+      speed,
+      connections: conns.size,
+      duration_s: Number(elapsed.toFixed(3)),
+      requests: results.length,
+      skipped: capture.entries.length - entries.length,
+      rps: Number((results.length / elapsed).toFixed(1)),
+      bytes_received: ok.reduce((sum, r) => sum + r.res.bytes, 0),
+      errors,
+      status,
+      mismatches,
+      latency_us: percentiles(ok.map((r) => r.us)),
+      recorded_us: percentiles(entries.map((e) => e.dur_us)),
+      lag_ms: percentiles(results.map((r) => Math.max(0, r.lag))),
+      by_uri: Object.fromEntries(Object.entries(byUri).map(([uri, us]) => [uri, percentiles(us)])),
+    },
+    null,
+    2,
+  ),
+);
+
+process.exit(Object.keys(errors).length ? 1 : 0);
@@ -0,0 +1,87 @@
+#!/usr/bin/env node
+// Sends one command to the UDP listener of the firmware, see firmware/main/udp_cmd.h for the packet format.
+//
+//   HTTPD_AUTH_KEY=secret node tools/udp-cmd.mjs mydevice.local on
+//   node tools/udp-cmd.mjs 192.168.1.50 off --key secret --port 4242 --no-ack
+//
+// With acks the command is resent with the same sequence number until one arrives, the device executes it once.
+
+import { createHmac, timingSafeEqual } from 'node:crypto';
+import { createSocket } from 'node:dgram';
+import { lookup } from 'node:dns/promises';
+import { parseArgs } from 'node:util';
+
+const VERSION = 1;
+const MAC_LEN = 16;
+const PACKET_LEN = 12 + MAC_LEN;
+const ACK_BIT = 0x80;
+const FLAG_ACK = 0x01;
+
+const COMMANDS = { ping: 0x00, on: 0x01, off: 0x02 };
+const STATUS = ['ok', 'duplicate', 'failed', 'unknown command'];
+
+const { values: opts, positionals } = parseArgs({
+  allowPositionals: true,
+  options: {
+    port: { type: 'string', default: '4242' },
+    key: { type: 'string', default: process.env.HTTPD_AUTH_KEY ?? '' },
+    'no-ack': { type: 'boolean', default: false },
+    retries: { type: 'string', default: '3' },
+    timeout: { type: 'string', default: '200' },
+  },
+});
+
+const [host, name] = positionals;
+if (!host || !(name in COMMANDS) || !opts.key) {
+  console.error('usage: udp-cmd.mjs <host> <ping|on|off> --key <key> [--port n] [--no-ack] [--retries n] [--timeout ms]');
+  process.exit(2);
+}
+
+const mac = (buf) => createHmac('sha256', opts.key).update(buf.subarray(0, PACKET_LEN - MAC_LEN)).digest().subarray(0, MAC_LEN);
+
+// Microseconds since the epoch, so sequence numbers keep growing across restarts of both ends
+const seq = BigInt(Date.now()) * 1000n + BigInt(process.hrtime()[1] % 1000);
+
+const packet = Buffer.alloc(PACKET_LEN);
+packet[0] = VERSION;
+packet[1] = COMMANDS[name];
+packet[2] = opts['no-ack'] ? 0 : FLAG_ACK;
+packet.writeBigUInt64BE(seq, 4);
+mac(packet).copy(packet, PACKET_LEN - MAC_LEN);
+
+const { address } = await lookup(host, { family: 4 });
+const socket = createSocket('udp4');
+const port = Number(opts.port);
+
+if (opts['no-ack']) {
+  socket.send(packet, port, address, () => socket.close());
+} else {
+  const ack = new Promise((resolve) => {
+    socket.on('message', (msg) => {
+      if (msg.length !== PACKET_LEN || msg[0] !== VERSION || msg[1] !== (packet[1] | ACK_BIT)) return;
+      if (msg.readBigUInt64BE(4) !== seq) return;
+      if (!timingSafeEqual(mac(msg), msg.subarray(PACKET_LEN - MAC_LEN))) return;
+      resolve(msg);
+    });
+  });
+
+  const retries = Number(opts.retries);
+  const timeout = Number(opts.timeout);
+  let reply = null;
+  const start = process.hrtime.bigint();
+
+  for (let attempt = 0; attempt <= retries && !reply; attempt++) {
+    socket.send(packet, port, address);
+    reply = await Promise.race([ack, new Promise((resolve) => setTimeout(resolve, timeout, null))]);
+  }
+  socket.close();
+
+  if (!reply) {
+    console.error(`no ack from ${address}:${port}`);
+    process.exit(1);
+  }
+
+  const rtt = Number(process.hrtime.bigint() - start) / 1e6;
+  console.log(`${name}: ${STATUS[reply[2]] ?? reply[2]}, led ${reply[3] ? 'on' : 'off'}, ${rtt.toFixed(2)} ms`);
+  process.exit(reply[2] <= 1 ? 0 : 1);
+}
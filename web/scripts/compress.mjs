@@ -1,40 +1,269 @@
-import { readFileSync, writeFileSync, statSync } from 'node:fs'
-import { brotliCompressSync, constants, gzipSync } from 'node:zlib'
-import { resolve } from 'node:path'
+import { existsSync, mkdtempSync, readFileSync, writeFileSync, readdirSync, rmSync, statSync } from 'node:fs'
+import { createHash } from 'node:crypto'
+import { tmpdir } from 'node:os'
+import { spawnSync } from 'node:child_process'
+import { extname, join, relative, resolve, sep } from 'node:path'
+import * as zlib from 'node:zlib'
 
-const file = resolve('dist/index.html')
-const input = readFileSync(file)
-const originalSize = statSync(file).size
+const { constants } = zlib
 
-const brotli = brotliCompressSync(input, {
-  params: {
-    [constants.BROTLI_PARAM_QUALITY]: 11
+const dist = resolve('dist')
+const manifestFile = join(dist, 'manifest.json')
+
+// Identity files of the previous release, see scripts/release.mjs. Deltas are built against them
+const release = resolve(process.env.COMPRESS_DICT_DIR ?? 'release')
+
+// An encoding is embedded only if it is at most this fraction of the identity size
+const maxRatio = Number(process.env.COMPRESS_MAX_RATIO ?? 0.95)
+
+const encodedExt = { gzip: '.gz', br: '.br', zstd: '.zst', dcb: '.dcb', dcz: '.dcz' }
+const isEncoded = (file) => Object.values(encodedExt).some((ext) => file.endsWith(ext))
+
+const types = {
+  '.html': 'text/html; charset=utf-8',
+  '.js': 'text/javascript; charset=utf-8',
+  '.css': 'text/css; charset=utf-8',
+  '.json': 'application/json',
+  '.webmanifest': 'application/manifest+json',
+  '.svg': 'image/svg+xml',
+  '.png': 'image/png',
+  '.ico': 'image/x-icon',
+  '.txt': 'text/plain; charset=utf-8',
+}
+
+// Lower is requested more often, the firmware lays assets out in this order
+const priority = { '.html': 0, '.js': 1, '.css': 2, '.webmanifest': 3, '.json': 3, '.svg': 4, '.ico': 5 }
+
+// Built by the service-worker plugin in vite.config.js, served with the whole origin as its scope
+const serviceWorker = 'sw.js'
+
+// "no-cache, must-revalidate" - for dynamic content
+// "public, max-age=300, s-maxage=86400, stale-while-revalidate=300, stale-if-error=3600" - for static files
+// behind "public, max-age=31536000, immutable" - for versioned static files
+const cacheControl = (path) => {
+  if (extname(path) === '.html' || path === serviceWorker) return 'no-cache, must-revalidate'
+  if (/-[\w-]{8,}\.\w+$/.test(path)) return 'public, max-age=31536000, immutable'
+  return 'public, max-age=300, s-maxage=86400, stale-while-revalidate=300, stale-if-error=3600'
+}
+
+const walk = (dir) =>
+  readdirSync(dir, { withFileTypes: true }).flatMap((entry) => {
+    const path = join(dir, entry.name)
+    return entry.isDirectory() ? walk(path) : [path]
+  })
+
+const smallest = (candidates) =>
+  candidates.filter(Boolean).reduce((best, c) => (!best || c.length < best.length ? c : best), null)
+
+const tmp = mkdtempSync(join(tmpdir(), 'compress-'))
+process.on('exit', () => rmSync(tmp, { recursive: true, force: true }))
+
+// zopfli when it is installed, otherwise the best of zlib's strategies
+const gzip = (input) => {
+  const candidates = []
+
+  const file = join(tmp, 'input')
+  writeFileSync(file, input)
+  const zopfli = spawnSync('zopfli', ['--i1000', '-c', file], { maxBuffer: 64 * 1024 * 1024 })
+  if (!zopfli.error && zopfli.status === 0) candidates.push(zopfli.stdout)
+
+  for (const memLevel of [8, 9]) {
+    for (const strategy of [constants.Z_DEFAULT_STRATEGY, constants.Z_FILTERED]) {
+      candidates.push(zlib.gzipSync(input, { level: 9, memLevel, strategy }))
+    }
+  }
+
+  return smallest(candidates)
+}
+
+// A window just large enough for the asset is often smaller than the default one
+const brotli = (input) => {
+  const candidates = []
+
+  for (let lgwin = constants.BROTLI_MIN_WINDOW_BITS; lgwin <= constants.BROTLI_MAX_WINDOW_BITS; lgwin++) {
+    for (const mode of [constants.BROTLI_MODE_GENERIC, constants.BROTLI_MODE_TEXT]) {
+      candidates.push(
+        zlib.brotliCompressSync(input, {
+          params: {
+            [constants.BROTLI_PARAM_QUALITY]: constants.BROTLI_MAX_QUALITY,
+            [constants.BROTLI_PARAM_LGWIN]: lgwin,
+            [constants.BROTLI_PARAM_MODE]: mode,
+            [constants.BROTLI_PARAM_SIZE_HINT]: input.length,
+          },
+        }),
+      )
+    }
+  }
+
+  return smallest(candidates)
+}
+
+// zstd landed in node:zlib with Node 22.15 / 23.8
+const zstd = (input) => {
+  if (typeof zlib.zstdCompressSync !== 'function') return null
+
+  // Browsers refuse windows above 8 MB
+  const windowLog = Math.min(23, Math.max(10, Math.ceil(Math.log2(input.length || 1))))
+
+  return zlib.zstdCompressSync(input, {
+    params: {
+      [constants.ZSTD_c_compressionLevel]: 22,
+      [constants.ZSTD_c_windowLog]: windowLog,
+    },
+  })
+}
+
+// Hashed file names change every release, the dictionary pattern and the lookup of the
+// previous version both replace the hash with a wildcard
+const unhashed = (path) => path.replace(/-[\w-]{8,}(\.\w+)$/, '-*$1')
+
+const uri = (path) => (path === 'index.html' ? '/' : '/' + path)
+
+const previousVersions = existsSync(release)
+  ? new Map(walk(release).map((file) => [unhashed(relative(release, file).split(sep).join('/')), file]))
+  : new Map()
+
+// RFC 9842 framing: magic number and the SHA-256 of the dictionary ahead of the compressed stream
+const dcbMagic = Buffer.from([0xff, 0x44, 0x43, 0x42])
+const dczMagic = Buffer.from([0x5e, 0x2a, 0x4d, 0x18, 0x20, 0x00, 0x00, 0x00])
+
+// node:zlib takes no brotli dictionary, the brotli CLI (>= 1.1) does
+const dcb = (file, dictFile, dictHash) => {
+  const brotli = spawnSync('brotli', ['-c', '-q', '11', '-D', dictFile, file], { maxBuffer: 64 * 1024 * 1024 })
+  if (brotli.error || brotli.status !== 0) return null
+
+  return Buffer.concat([dcbMagic, dictHash, brotli.stdout])
+}
+
+const dcz = (file, input, dictFile, dict, dictHash) => {
+  let data = null
+
+  if (typeof zlib.zstdCompressSync === 'function') {
+    data = zlib.zstdCompressSync(input, {
+      params: { [constants.ZSTD_c_compressionLevel]: 22 },
+      dictionary: dict,
+    })
+  } else {
+    const zstd = spawnSync('zstd', ['-c', '-q', '--ultra', '-22', '-D', dictFile, file], {
+      maxBuffer: 64 * 1024 * 1024,
+    })
+    if (zstd.error || zstd.status !== 0) return null
+    data = zstd.stdout
   }
-})
-const brotliFile = file + '.br'
-writeFileSync(brotliFile, brotli)
-const brotliSize = brotli.length
-
-const gzip = gzipSync(input, { level: 9 })
-const gzipFile = file + '.gz'
-writeFileSync(gzipFile, gzip)
-const gzipSize = gzip.length
-
-const ratio = (orig, compressed) =>
-  (((orig - compressed) / orig) * 100).toFixed(2) + ' %'
-
-console.log('✔ brotli generated')
-
-console.table({
-  original: {
-    size: originalSize,
-  },
-  brotli: {
-    size: brotliSize,
-    compression: ratio(originalSize, brotliSize)
-  },
-   gzip: {
-    size: gzipSize,
-    compression: ratio(originalSize, gzipSize)
-  },
-})
+
+  return Buffer.concat([dczMagic, dictHash, data])
+}
+
+// Deltas of the asset against its previous release, for clients that still hold that one as a dictionary
+const deltas = (path, file, input) => {
+  const dictFile = previousVersions.get(unhashed(path))
+  if (!dictFile) return []
+
+  const dict = readFileSync(dictFile)
+  const dictHash = createHash('sha256').update(dict).digest()
+  if (dict.equals(input)) return []
+
+  return [
+    ['dcb', dcb(file, dictFile, dictHash)],
+    ['dcz', dcz(file, input, dictFile, dict, dictHash)],
+  ].map(([coding, data]) => ({
+    coding,
+    data,
+    dictionary: dictHash.toString('hex'),
+    availableDictionary: `:${dictHash.toString('base64')}:`,
+  }))
+}
+
+// Pages with a state element get one more gzip body, split right behind the start tag into two
+// members: with CONFIG_HTTPD_STATE_INJECT the firmware splices a stored member with the live state
+// in between. No other coding can be spliced like that, they are built as for any other asset and
+// served without the state.
+const injectionPoint = (path, input) => {
+  if (extname(path) !== '.html') return -1
+
+  const match = /<script id="?state"?[^>]*>/.exec(input.toString('latin1'))
+  return match ? match.index + match[0].length : -1
+}
+
+const ratio = (orig, compressed) => (((orig - compressed) / orig) * 100).toFixed(2) + ' %'
+
+for (const file of walk(dist)) {
+  if (isEncoded(file)) rmSync(file)
+}
+
+const files = walk(dist)
+  .filter((file) => file !== manifestFile)
+  .sort((a, b) => (priority[extname(a)] ?? 9) - (priority[extname(b)] ?? 9) || a.localeCompare(b))
+
+// Last-Modified of the assets in seconds since the epoch, UTC: SOURCE_DATE_EPOCH for reproducible builds,
+// otherwise the newest output of the web build
+const lastModified =
+  Number(process.env.SOURCE_DATE_EPOCH) || Math.floor(Math.max(...files.map((file) => statSync(file).mtimeMs)) / 1000)
+
+const assets = []
+const report = {}
+
+for (const file of files) {
+  const path = relative(dist, file).split(sep).join('/')
+  const input = readFileSync(file)
+  const sha256 = createHash('sha256').update(input).digest('hex')
+
+  const inject = injectionPoint(path, input)
+  const encodings = []
+
+  report[path] = { identity: input.length }
+
+  const results = [
+    { coding: 'gzip', data: gzip(input) },
+    { coding: 'br', data: brotli(input) },
+    { coding: 'zstd', data: zstd(input) },
+    ...deltas(path, file, input),
+  ]
+
+  for (const { coding, data, ...dictionary } of results) {
+    if (!data) continue
+
+    report[path][coding] = `${data.length} (${ratio(input.length, data.length)})`
+    if (data.length > input.length * maxRatio) continue
+
+    const encodedFile = file + encodedExt[coding]
+    writeFileSync(encodedFile, data)
+    encodings.push({ coding, file: relative(dist, encodedFile).split(sep).join('/'), size: data.length, ...dictionary })
+  }
+
+  // Kept whatever its ratio, web_assets.cmake embeds either this one or the plain gzip body
+  if (inject >= 0) {
+    const prefix = gzip(input.subarray(0, inject))
+    const data = Buffer.concat([prefix, gzip(input.subarray(inject))])
+
+    report[path].inject = `${data.length} (${ratio(input.length, data.length)}), split at ${inject}`
+
+    writeFileSync(file + '.inject' + encodedExt.gzip, data)
+    encodings.push({ coding: 'gzip', file: path + '.inject' + encodedExt.gzip, size: data.length, inject: prefix.length })
+  }
+
+  // Without gzip the firmware has nothing to inflate for clients that decode nothing
+  if (!encodings.some((e) => e.coding === 'gzip' && !e.inject)) {
+    encodings.push({ coding: 'identity', file: path, size: input.length })
+  }
+
+  encodings.sort((a, b) => a.size - b.size)
+
+  assets.push({
+    uri: uri(path),
+    file: path,
+    type: types[extname(path)] ?? 'application/octet-stream',
+    cacheControl: cacheControl(path),
+    useAsDictionary: `match="${uri(unhashed(path))}"`,
+    ...(path === serviceWorker && { serviceWorkerAllowed: '/' }),
+    size: input.length,
+    sha256,
+    encodings,
+  })
+}
+
+writeFileSync(manifestFile, JSON.stringify({ lastModified, assets }, null, 2) + '\n')
+
+console.log(`✔ ${assets.length} assets optimized, manifest written to ${relative(process.cwd(), manifestFile)}`)
+
+console.table(report)
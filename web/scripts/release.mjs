@@ -0,0 +1,18 @@
+import { copyFileSync, mkdirSync, readFileSync, rmSync } from 'node:fs'
+import { dirname, join, resolve } from 'node:path'
+
+// Snapshots the identity files of the current build. The next build ships dcb/dcz deltas
+// against them, so commit the snapshot together with the firmware that is released.
+const dist = resolve('dist')
+const release = resolve(process.env.COMPRESS_DICT_DIR ?? 'release')
+
+const { assets } = JSON.parse(readFileSync(join(dist, 'manifest.json'), 'utf8'))
+
+rmSync(release, { recursive: true, force: true })
+
+for (const { file } of assets) {
+  mkdirSync(dirname(join(release, file)), { recursive: true })
+  copyFileSync(join(dist, file), join(release, file))
+}
+
+console.log(`✔ ${assets.length} assets snapshotted to ${release}`)
@@ -0,0 +1,124 @@
+// Minimal CBOR (RFC 8949) decoder for the device API, the counterpart of firmware/main/cbor.h.
+// Tags are decoded as their content, simple values other than false/true/null/undefined as undefined.
+
+const textDecoder = new TextDecoder()
+
+const halfToFloat = (half) => {
+  const exp = (half >> 10) & 0x1f
+  const mant = half & 0x3ff
+  const val = exp === 0 ? mant * 2 ** -24 : exp !== 31 ? (mant + 1024) * 2 ** (exp - 25) : mant ? NaN : Infinity
+  return half & 0x8000 ? -val : val
+}
+
+export const decode = (buffer) => {
+  const view = new DataView(buffer instanceof ArrayBuffer ? buffer : buffer.buffer)
+  let offset = 0
+
+  const argument = (ai) => {
+    if (ai < 24) return ai
+    if (ai === 31) return -1
+    const size = 1 << (ai - 24)
+    const at = offset
+    offset += size
+    switch (size) {
+      case 1:
+        return view.getUint8(at)
+      case 2:
+        return view.getUint16(at)
+      case 4:
+        return view.getUint32(at)
+      case 8:
+        return Number(view.getBigUint64(at))
+    }
+    throw new Error(`cbor: invalid additional information ${ai}`)
+  }
+
+  const bytes = (length) => {
+    const out = new Uint8Array(view.buffer, view.byteOffset + offset, length)
+    offset += length
+    return out
+  }
+
+  // Indefinite strings are chunks of definite ones until the break
+  const chunks = (major) => {
+    const parts = []
+    while (view.getUint8(offset) !== 0xff) parts.push(item())
+    offset++
+    return major === 3 ? parts.join('') : new Uint8Array(parts.flatMap((part) => [...part]))
+  }
+
+  const item = () => {
+    const initial = view.getUint8(offset++)
+    const major = initial >> 5
+    const ai = initial & 0x1f
+
+    if (major === 7) {
+      switch (ai) {
+        case 20:
+          return false
+        case 21:
+          return true
+        case 22:
+          return null
+        case 25:
+          offset += 2
+          return halfToFloat(view.getUint16(offset - 2))
+        case 26:
+          offset += 4
+          return view.getFloat32(offset - 4)
+        case 27:
+          offset += 8
+          return view.getFloat64(offset - 8)
+        default:
+          if (ai === 24) offset++
+          return undefined
+      }
+    }
+
+    const arg = argument(ai)
+    switch (major) {
+      case 0:
+        return arg
+      case 1:
+        return -1 - arg
+      case 2:
+        return arg < 0 ? chunks(2) : bytes(arg).slice()
+      case 3:
+        return arg < 0 ? chunks(3) : textDecoder.decode(bytes(arg))
+      case 4: {
+        const out = []
+        if (arg < 0) {
+          while (view.getUint8(offset) !== 0xff) out.push(item())
+          offset++
+        } else {
+          for (let i = 0; i < arg; i++) out.push(item())
+        }
+        return out
+      }
+      case 5: {
+        const out = {}
+        const entry = () => {
+          const key = item()
+          out[key] = item()
+        }
+        if (arg < 0) {
+          while (view.getUint8(offset) !== 0xff) entry()
+          offset++
+        } else {
+          for (let i = 0; i < arg; i++) entry()
+        }
+        return out
+      }
+      default:
+        return item()
+    }
+  }
+
+  return item()
+}
+
+export const fetchCbor = async (input, init = {}) => {
+  const response = await fetch(input, { ...init, headers: { ...init.headers, Accept: 'application/cbor' } })
+  if (!response.ok) throw new Error(response.statusText)
+  return decode(await response.arrayBuffer())
+}
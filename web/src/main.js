@@ -1,18 +1,97 @@
 import './style.css'
+import { startRum, timedFetch } from './rum.js'
+
+// Live state spliced into the page by the firmware, empty when served without it
+const readState = () => {
+  try {
+    return JSON.parse(document.getElementById('state')?.textContent || '{}');
+  } catch {
+    return {};
+  }
+};
+
+const state = readState();
 
 const ledButton = document.getElementById('led_button');
-let ledEnable = false; // Initial state can be fetched from the server if needed
-ledButton.addEventListener('click', async () => {
-    
+let ledEnable = false; // last level confirmed by the server
+let desired = false; // level shown in the UI
+let inflight = null;
+let pending = null;
+
+// Clicks closer together than this are sent as one request
+const COALESCE_MS = 150;
+
+const applyState = (state) => {
+  ledEnable = state.led ?? ledEnable;
+  if (!inflight && !pending) desired = ledEnable;
+  ledButton.classList.toggle('fill', desired);
+
+  if (state.name) {
+    document.getElementById('device').textContent = `${state.name} ${state.version ?? ''}`.trim();
+  }
+};
+
+applyState(state);
+startRum();
+
+// Only a gzip page carries the state, a page served with another coding asks for it
+if (!('led' in state)) {
+  timedFetch('/api/state')
+    .then((response) => (response.ok ? response.json() : {}))
+    .then(applyState)
+    .catch(console.error);
+}
+
+if (import.meta.env.PROD && 'serviceWorker' in navigator) {
+  // A page served from the cache is followed by the state of the revalidated one
+  navigator.serviceWorker.addEventListener('message', ({ data }) => {
+    if (data?.type === 'state') applyState(data.state);
+  });
+  navigator.serviceWorker.register('/sw.js').catch(console.error);
+}
+
+// Latest wins: the UI flips at once, only the last desired level is sent and any
+// request it supersedes is aborted, the server's answer then settles the state
+const sendLed = async (level) => {
+  inflight?.abort();
+  const controller = new AbortController();
+  inflight = controller;
+
   try {
-    const response = await fetch(ledEnable ? '/api/led/off' : '/api/led/on', { method: 'POST' });
+    const response = await timedFetch(level ? '/api/led/on' : '/api/led/off', {
+      method: 'POST',
+      signal: controller.signal,
+    });
+    if (controller !== inflight) return;
+
     if (response.ok) {
-      ledEnable = !ledEnable;
-      ledButton.classList.toggle('fill');
+      ledEnable = level;
     } else {
       console.error(response.statusText);
     }
   } catch (error) {
+    if (error.name === 'AbortError') return;
     console.error(error);
   }
-});
\ No newline at end of file
+
+  if (controller !== inflight) return;
+  inflight = null;
+
+  // A failed request leaves the LED where it was, show that
+  if (!pending && desired !== ledEnable) {
+    desired = ledEnable;
+    ledButton.classList.toggle('fill', desired);
+  }
+};
+
+ledButton.addEventListener('click', () => {
+  desired = !desired;
+  ledButton.classList.toggle('fill', desired);
+
+  clearTimeout(pending);
+  pending = setTimeout(() => {
+    pending = null;
+    // Clicks that cancel out need no request, unless one in flight may have changed the LED
+    if (inflight || desired !== ledEnable) sendLed(desired);
+  }, COALESCE_MS);
+});
@@ -0,0 +1,115 @@
+// Real-user latency monitoring: navigation, resource and API timings as the browser sees them,
+// rolling percentiles in the diagnostics panel, batched to the device for /api/metrics.
+
+import { fetchCbor } from './cbor.js'
+
+const WINDOW = 200 // samples per metric kept in the page
+const FLUSH_MS = 30000
+const REPORT_URL = '/api/rum'
+
+const samples = new Map()
+let device = [] // [name, count, p50, p90, p99] rows aggregated by the device over all clients
+let queue = []
+
+const percentile = (sorted, p) => sorted[Math.min(sorted.length - 1, Math.ceil((p / 100) * sorted.length) - 1)]
+
+const row = (cells) => {
+  const tr = document.createElement('tr')
+  for (const cell of cells) {
+    const td = document.createElement('td')
+    td.textContent = cell
+    tr.append(td)
+  }
+  return tr
+}
+
+const render = () => {
+  const body = document.querySelector('#diagnostics tbody')
+  if (!body) return
+
+  const local = [...samples].map(([name, values]) => {
+    const sorted = [...values].sort((a, b) => a - b)
+    return [name, sorted.length, ...[50, 90, 99].map((p) => percentile(sorted, p).toFixed(1))]
+  })
+
+  body.replaceChildren(...[...local, ...device].map(row))
+}
+
+const refreshDevice = async () => {
+  try {
+    const { rum } = await fetchCbor('/api/metrics')
+    device = Object.entries(rum)
+      .filter(([, h]) => typeof h === 'object' && h.count)
+      .map(([name, h]) => [`device ${name}`, h.count, ...[h.p50_us, h.p90_us, h.p99_us].map((us) => (us / 1000).toFixed(1))])
+    render()
+  } catch (error) {
+    console.error(error)
+  }
+}
+
+export const record = (name, ms) => {
+  if (!Number.isFinite(ms) || ms < 0) return
+
+  const values = samples.get(name) ?? []
+  values.push(ms)
+  if (values.length > WINDOW) values.shift()
+  samples.set(name, values)
+
+  queue.push(`${name} ${ms.toFixed(1)}`)
+  render()
+}
+
+// fetch() that records its round trip, aborted requests are not samples
+export const timedFetch = async (input, init) => {
+  const start = performance.now()
+  const response = await fetch(input, init)
+  record('api', performance.now() - start)
+  return response
+}
+
+const flush = () => {
+  if (!queue.length) return
+
+  const body = queue.join('\n')
+  queue = []
+  navigator.sendBeacon(REPORT_URL, body)
+}
+
+const observeNavigation = () => {
+  const [nav] = performance.getEntriesByType('navigation')
+  if (!nav) return
+
+  record('ttfb', nav.responseStart - nav.requestStart)
+  record('load', nav.loadEventEnd - nav.startTime)
+}
+
+// API calls are timed by timedFetch(), the reports themselves are not worth a sample
+const observeResources = () => {
+  new PerformanceObserver((list) => {
+    for (const entry of list.getEntries()) {
+      if (entry.initiatorType === 'fetch' || entry.initiatorType === 'beacon') continue
+      if (new URL(entry.name).origin !== location.origin) continue
+      record('resource', entry.duration)
+    }
+  }).observe({ type: 'resource', buffered: true })
+}
+
+export const startRum = () => {
+  // loadEventEnd is only set once the load handlers have returned
+  if (document.readyState === 'complete') {
+    setTimeout(observeNavigation)
+  } else {
+    addEventListener('load', () => setTimeout(observeNavigation), { once: true })
+  }
+
+  observeResources()
+
+  document.getElementById('diagnostics')?.addEventListener('toggle', (event) => {
+    if (event.target.open) refreshDevice()
+  })
+
+  setInterval(flush, FLUSH_MS)
+  document.addEventListener('visibilitychange', () => {
+    if (document.visibilityState === 'hidden') flush()
+  })
+}
@@ -0,0 +1,60 @@
+// Offline-first shell: served from the cache at once, revalidated with the device in the background.
+// __BUILD_HASH__ is replaced at build time, a new build gets a cache of its own.
+const CACHE = 'shell-__BUILD_HASH__'
+const SHELL = ['/']
+
+self.addEventListener('install', (event) => {
+  event.waitUntil(
+    caches
+      .open(CACHE)
+      .then((cache) => cache.addAll(SHELL))
+      .then(() => self.skipWaiting()),
+  )
+})
+
+self.addEventListener('activate', (event) => {
+  event.waitUntil(
+    caches
+      .keys()
+      .then((keys) => Promise.all(keys.filter((key) => key !== CACHE).map((key) => caches.delete(key))))
+      .then(() => self.clients.claim()),
+  )
+})
+
+const stateRe = /<script id="?state"?[^>]*>(.*?)<\/script>/s
+
+// A page from the cache carries the device state of the day it was cached, the revalidated one is current
+const postState = async (clientId, response) => {
+  const client = clientId && (await self.clients.get(clientId))
+  const match = client && stateRe.exec(await response.text())
+  if (match?.[1]) client.postMessage({ type: 'state', state: JSON.parse(match[1]) })
+}
+
+const staleWhileRevalidate = async (event) => {
+  const { request } = event
+  const cache = await caches.open(CACHE)
+  const cached = await cache.match(request, { ignoreSearch: true })
+
+  const network = fetch(request).then(async (response) => {
+    if (response.ok) {
+      await cache.put(request, response.clone())
+      if (cached && request.mode === 'navigate') await postState(event.resultingClientId, response.clone())
+    }
+    return response
+  })
+
+  if (!cached) return network
+
+  event.waitUntil(network.catch(() => {}))
+  return cached
+}
+
+self.addEventListener('fetch', (event) => {
+  const { request } = event
+  const url = new URL(request.url)
+
+  // The API is never cached
+  if (request.method !== 'GET' || url.origin !== self.location.origin || url.pathname.startsWith('/api/')) return
+
+  event.respondWith(staleWhileRevalidate(event))
+})
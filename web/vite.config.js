@@ -1,13 +1,36 @@
 import { defineConfig } from "vite"
 import { viteSingleFile } from "vite-plugin-singlefile"
 import simpleHtmlPlugin from 'vite-plugin-simple-html';
+import { createHash } from 'node:crypto'
+import { readFileSync, writeFileSync } from 'node:fs'
+import { resolve } from 'node:path'
+import { fileURLToPath } from 'node:url'
+
+// Copies src/sw.js next to the page once it is written, with the cache name keyed by the page hash
+const serviceWorker = () => {
+  let outDir
+  return {
+    name: 'service-worker',
+    apply: 'build',
+    configResolved(config) {
+      outDir = resolve(config.root, config.build.outDir)
+    },
+    closeBundle() {
+      const page = readFileSync(resolve(outDir, 'index.html'))
+      const hash = createHash('sha256').update(page).digest('hex').slice(0, 16)
+      const sw = readFileSync(fileURLToPath(new URL('./src/sw.js', import.meta.url)), 'utf8')
+      writeFileSync(resolve(outDir, 'sw.js'), sw.replaceAll('__BUILD_HASH__', hash))
+    },
+  }
+}
 
 export default defineConfig({
 	plugins: [
         viteSingleFile(),
         simpleHtmlPlugin({
       minify: true,
-    }),],
+    }),
+        serviceWorker(),],
     build: {
     cssCodeSplit: false,
     rollupOptions: {